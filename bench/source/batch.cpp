@@ -0,0 +1,75 @@
+#include "GltfIblSampler.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+using namespace IBLLib;
+
+// samples the inputs with one sample call each, which creates a device per input and reads back after filtering,
+// and then with sampleBatch, which keeps the device and reads back each job while the next one is filtered
+// usage: bench_batch outputDirectory input0 [input1 ...]
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double elapsedMs(Clock::time_point _start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - _start).count();
+	}
+
+	void report(const char* _what, uint32_t _count, double _ms)
+	{
+		printf("%-16s %10.2f ms %10.2f ms per job\n", _what, _ms, _ms / _count);
+	}
+} // !anonymous
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		printf("usage: bench_batch outputDirectory input0 [input1 ...]\n");
+		return 1;
+	}
+
+	std::vector<SampleJob> jobs(argc - 2);
+	std::vector<std::string> outputPaths(jobs.size());
+	for (size_t i = 0u; i < jobs.size(); ++i)
+	{
+		outputPaths[i] = std::string(argv[1]) + "/batch" + std::to_string(i) + ".ktx2";
+
+		jobs[i].inputPath = argv[i + 2];
+		jobs[i].outputPathCubeMap = outputPaths[i].c_str();
+		// both runs sample every job, the second one would be skipped as up to date otherwise
+		jobs[i].options.force = true;
+	}
+
+	const uint32_t count = static_cast<uint32_t>(jobs.size());
+
+	Clock::time_point start = Clock::now();
+	for (const SampleJob& job : jobs)
+	{
+		if (sample(job.inputPath, job.outputPathCubeMap, job.outputPathLUT, job.distribution, job.cubemapResolution, job.mipmapCount, job.sampleCount, job.targetFormat, job.lodBias, false, job.options) != Result::Success)
+		{
+			printf("Failed to sample %s\n", job.inputPath);
+			return 1;
+		}
+	}
+	const double sequentialMs = elapsedMs(start);
+
+	start = Clock::now();
+	if (sampleBatch(jobs.data(), count, false) != Result::Success)
+	{
+		printf("Failed to sample the batch\n");
+		return 1;
+	}
+	const double batchMs = elapsedMs(start);
+
+	printf("%u jobs\n", count);
+	report("sample", count, sequentialMs);
+	report("sampleBatch", count, batchMs);
+
+	return 0;
+}
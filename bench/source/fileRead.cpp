@@ -0,0 +1,201 @@
+#include "FileHelper.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace IBLLib;
+
+// reads a file through MappedFile and through readFile (stdio into a heap buffer) and sums all bytes, as the decoders touch every byte.
+// cold runs drop the pages of the file from the page cache first, warm runs read it again right after
+// usage: bench_fileRead input [repetitions (default = 3)]
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double elapsedMs(Clock::time_point _start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - _start).count();
+	}
+
+	void report(const char* _what, size_t _byteSize, double _ms)
+	{
+		printf("%-24s %10.2f ms %10.1f MB/s\n", _what, _ms, _byteSize / (1000.0 * _ms));
+	}
+
+	uint64_t sumBytes(const uint8_t* _data, size_t _byteSize)
+	{
+		uint64_t sum = 0u;
+		for (size_t i = 0u; i < _byteSize; ++i)
+		{
+			sum += _data[i];
+		}
+		return sum;
+	}
+
+	bool readMapped(const char* _path, uint64_t& _outSum)
+	{
+		MappedFile file;
+		if (file.open(_path, MappedFile::Access::Sequential) == false)
+		{
+			return false;
+		}
+
+		_outSum = sumBytes(file.getData(), file.getSize());
+		return true;
+	}
+
+	bool readStdio(const char* _path, uint64_t& _outSum)
+	{
+		std::vector<char> buffer;
+		if (readFile(_path, buffer) == false)
+		{
+			return false;
+		}
+
+		_outSum = sumBytes(reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size());
+		return true;
+	}
+
+#if !defined(_WIN32)
+	// drops the clean pages of the file, returns the fraction that is still cached, e.g. pages mapped by other processes
+	bool dropPageCache(const char* _path, double& _outCachedFraction)
+	{
+		const int fd = open(_path, O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0 || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+
+		const size_t byteSize = static_cast<size_t>(info.st_size);
+		const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+		_outCachedFraction = 0.0;
+		void* data = mmap(nullptr, byteSize, PROT_READ, MAP_SHARED, fd, 0);
+		if (data != MAP_FAILED)
+		{
+			std::vector<unsigned char> residency((byteSize + pageSize - 1u) / pageSize);
+			if (mincore(data, byteSize, residency.data()) == 0)
+			{
+				const size_t cached = std::count_if(residency.begin(), residency.end(), [](unsigned char _page) { return (_page & 1u) != 0u; });
+				_outCachedFraction = static_cast<double>(cached) / residency.size();
+			}
+			munmap(data, byteSize);
+		}
+
+		::close(fd);
+		return true;
+	}
+#endif
+
+	// best time of _repetitions runs, cold runs drop the page cache before each run
+	bool measure(const char* _path, bool (*_read)(const char*, uint64_t&), bool _cold, uint32_t _repetitions, uint64_t& _outSum, double& _outMs)
+	{
+		_outMs = 1e30;
+		for (uint32_t i = 0u; i < _repetitions; ++i)
+		{
+#if !defined(_WIN32)
+			double cachedFraction = 0.0;
+			if (_cold && dropPageCache(_path, cachedFraction) && cachedFraction > 0.01)
+			{
+				printf("%.0f%% of the file is still cached after dropping it\n", 100.0 * cachedFraction);
+			}
+#endif
+
+			const Clock::time_point start = Clock::now();
+			if (_read(_path, _outSum) == false)
+			{
+				return false;
+			}
+			_outMs = std::min(_outMs, elapsedMs(start));
+		}
+		return true;
+	}
+} // !anonymous
+
+int main(int argc, char* argv[])
+{
+	const uint32_t repetitions = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], NULL, 0)) : 3u;
+	if (argc < 2 || repetitions == 0u)
+	{
+		printf("usage: bench_fileRead input [repetitions]\n");
+		return 1;
+	}
+
+	const char* path = argv[1];
+
+	size_t byteSize = 0u;
+	{
+		MappedFile file;
+		if (file.open(path) == false)
+		{
+			printf("Failed to open %s\n", path);
+			return 1;
+		}
+		byteSize = file.getSize();
+	}
+
+	printf("%s, %.1f MB, best of %u\n", path, byteSize / 1e6, repetitions);
+
+	struct Method
+	{
+		const char* name;
+		bool (*read)(const char*, uint64_t&);
+	};
+	const Method methods[] = { { "MappedFile", readMapped }, { "readFile (stdio)", readStdio } };
+
+	uint64_t expectedSum = 0u;
+	bool first = true;
+
+#if defined(_WIN32)
+	printf("Cold runs are not supported on this platform\n");
+	const bool coldRuns[] = { false };
+#else
+	const bool coldRuns[] = { true, false };
+#endif
+
+	for (const bool cold : coldRuns)
+	{
+		for (const Method& method : methods)
+		{
+			uint64_t sum = 0u;
+			double ms = 0.0;
+			if (measure(path, method.read, cold, repetitions, sum, ms) == false)
+			{
+				printf("Failed to read %s\n", path);
+				return 1;
+			}
+
+			if (first == false && sum != expectedSum)
+			{
+				printf("%s read different content\n", method.name);
+				return 1;
+			}
+			expectedSum = sum;
+			first = false;
+
+			char what[64];
+			snprintf(what, sizeof(what), "%s %s", method.name, cold ? "cold" : "warm");
+			report(what, byteSize, ms);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include "vkHelper.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace IBLLib;
+
+// creates, looks up and destroys buffers and images through vkHelper, destruction in random order so that handles are removed from the middle
+// usage: bench_handles [count (default = 10000)]
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double elapsedMs(Clock::time_point _start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - _start).count();
+	}
+
+	void report(const char* _what, uint32_t _count, double _ms)
+	{
+		printf("%-16s %10.2f ms %10.3f us per handle\n", _what, _ms, 1000.0 * _ms / _count);
+	}
+} // !anonymous
+
+int main(int argc, char* argv[])
+{
+	const uint32_t count = argc > 1 ? static_cast<uint32_t>(strtoul(argv[1], NULL, 0)) : 10000u;
+	if (count == 0u)
+	{
+		printf("usage: bench_handles [count]\n");
+		return 1;
+	}
+
+	vkHelper vulkan;
+	if (vulkan.initialize(0u, false) != VK_SUCCESS)
+	{
+		printf("Failed to initialize Vulkan\n");
+		return 1;
+	}
+
+	std::mt19937 random(1u);
+
+	printf("%u buffers\n", count);
+	{
+		std::vector<VkBuffer> buffers(count, VK_NULL_HANDLE);
+
+		Clock::time_point start = Clock::now();
+		for (VkBuffer& buffer : buffers)
+		{
+			if (vulkan.createBufferAndAllocate(buffer, 256u, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT) != VK_SUCCESS)
+			{
+				printf("Failed to create buffer\n");
+				return 1;
+			}
+		}
+		report("create", count, elapsedMs(start));
+
+		std::shuffle(buffers.begin(), buffers.end(), random);
+
+		start = Clock::now();
+		for (VkBuffer buffer : buffers)
+		{
+			vulkan.getMappedData(buffer);
+		}
+		report("lookup", count, elapsedMs(start));
+
+		start = Clock::now();
+		for (VkBuffer buffer : buffers)
+		{
+			vulkan.destroyBuffer(buffer);
+		}
+		report("destroy", count, elapsedMs(start));
+	}
+
+	printf("%u images\n", count);
+	{
+		std::vector<VkImage> images(count, VK_NULL_HANDLE);
+
+		Clock::time_point start = Clock::now();
+		for (VkImage& image : images)
+		{
+			if (vulkan.createImage2DAndAllocate(image, 16u, 16u, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT) != VK_SUCCESS)
+			{
+				printf("Failed to create image\n");
+				return 1;
+			}
+		}
+		report("create", count, elapsedMs(start));
+
+		std::shuffle(images.begin(), images.end(), random);
+
+		start = Clock::now();
+		for (VkImage image : images)
+		{
+			vulkan.getCreateInfo(image);
+		}
+		report("lookup", count, elapsedMs(start));
+
+		start = Clock::now();
+		for (VkImage image : images)
+		{
+			vulkan.destroyImage(image);
+		}
+		report("destroy", count, elapsedMs(start));
+	}
+
+	vulkan.shutdown();
+
+	return 0;
+}
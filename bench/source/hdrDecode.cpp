@@ -0,0 +1,127 @@
+#include "HdrReader.h"
+#include "ThreadPool.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace IBLLib;
+
+// decodes the same radiance file with HdrReader (to 32 bit floats and to undecoded RGBE) and with stbi_loadf, best of the repetitions
+// usage: bench_hdrDecode input.hdr [repetitions (default = 5)]
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double elapsedMs(Clock::time_point _start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - _start).count();
+	}
+
+	void report(const char* _what, uint32_t _texelCount, double _ms)
+	{
+		printf("%-24s %10.2f ms %10.2f Mtexel/s\n", _what, _ms, _texelCount / (1000.0 * _ms));
+	}
+
+	// the file is opened in each repetition, its pages stay cached after the first one
+	bool decodeHdr(const char* _path, ThreadPool* _threadPool, HdrReader::Format _format, double& _outMs)
+	{
+		Clock::time_point start = Clock::now();
+
+		HdrReader reader(_threadPool);
+		if (reader.open(_path) != Result::Success)
+		{
+			return false;
+		}
+
+		std::vector<uint8_t> data(reader.getRowByteSize(_format) * reader.getHeight());
+		if (reader.readScanlines(data.data(), reader.getHeight(), _format) != Result::Success)
+		{
+			return false;
+		}
+
+		_outMs = elapsedMs(start);
+		return true;
+	}
+
+	bool decodeStb(const char* _path, double& _outMs)
+	{
+		Clock::time_point start = Clock::now();
+
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+		float* data = stbi_loadf(_path, &width, &height, &channels, STBI_rgb_alpha);
+		if (data == nullptr)
+		{
+			return false;
+		}
+		stbi_image_free(data);
+
+		_outMs = elapsedMs(start);
+		return true;
+	}
+} // !anonymous
+
+int main(int argc, char* argv[])
+{
+	const uint32_t repetitions = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], NULL, 0)) : 5u;
+	if (argc < 2 || repetitions == 0u)
+	{
+		printf("usage: bench_hdrDecode input.hdr [repetitions]\n");
+		return 1;
+	}
+
+	const char* path = argv[1];
+
+	HdrReader header;
+	if (header.open(path) != Result::Success)
+	{
+		printf("Failed to open %s\n", path);
+		return 1;
+	}
+	const uint32_t texelCount = header.getWidth() * header.getHeight();
+	header.close();
+
+	ThreadPool threadPool;
+	printf("%s, %u threads, best of %u\n", path, threadPool.getThreadCount(), repetitions);
+
+	double float32Ms = 1e30;
+	double rgbeMs = 1e30;
+	double stbMs = 1e30;
+	for (uint32_t i = 0u; i < repetitions; ++i)
+	{
+		double ms = 0.0;
+		if (decodeHdr(path, &threadPool, HdrReader::Format::Float32, ms) == false)
+		{
+			printf("Failed to decode %s with HdrReader\n", path);
+			return 1;
+		}
+		float32Ms = std::min(float32Ms, ms);
+
+		if (decodeHdr(path, &threadPool, HdrReader::Format::RGBE, ms) == false)
+		{
+			printf("Failed to decode %s with HdrReader\n", path);
+			return 1;
+		}
+		rgbeMs = std::min(rgbeMs, ms);
+
+		if (decodeStb(path, ms) == false)
+		{
+			printf("Failed to decode %s with stb_image: %s\n", path, stbi_failure_reason());
+			return 1;
+		}
+		stbMs = std::min(stbMs, ms);
+	}
+
+	report("HdrReader Float32", texelCount, float32Ms);
+	report("HdrReader RGBE", texelCount, rgbeMs);
+	report("stbi_loadf", texelCount, stbMs);
+
+	return 0;
+}
@@ -17,6 +17,7 @@ int main(int argc, char* argv[])
 	Distribution distribution = Distribution::GGX;
 	float lodBias = 0.0f;
 	bool enableDebugOutput = false;
+	SampleOptions options;
 
 	const char* targetFormatString = "R16G16B16A16_SFLOAT";
 	const char* distributionString = "GGX";
@@ -27,15 +28,24 @@ int main(int argc, char* argv[])
 	{
 		printf("glTF-IBL-Sampler usage:\n");
 
-		printf("-inputPath: path to panorama image (default) or cube map (if inputIsCubeMap flag ist set) \n");
+		printf("-inputPath: path to panorama image (.hdr or .exr) or KTX2 cube map (detected by file header), other formats are not supported\n");
 		printf("-outCubeMap: output path for filtered cube map\n");
-		printf("-outLUT output path for BRDF LUT\n");
+		printf("-outLUT output path for BRDF LUT, the extension selects the format: .ktx2 (RGBA16F), .raw (RGBA32F rows without header) or PNG otherwise\n");
 		printf("-distribution NDF to sample (Lambertian, GGX, Charlie)\n");
 		printf("-sampleCount: number of samples used for filtering (default = 1024)\n");
-		printf("-mipLevelCount: number of mip levels of specular cube map. If omitted, an optimal mipmap level is chosen, based on the input panorama's resolution.\n");
-		printf("-cubeMapResolution: resolution of output cube map.  If omitted, an optimal resolution is chosen, based on the input panorama's resolution.\n");
+		printf("-mipLevelCount: number of mip levels of specular cube map. If omitted, an optimal mipmap level is chosen, based on the input's resolution.\n");
+		printf("-cubeMapResolution: resolution of output cube map.  If omitted, an optimal resolution is chosen, based on the input panorama's resolution (or the input cube map's resolution).\n");
 		printf("-targetFormat: specify output texture format (R8G8B8A8_UNORM, R16G16B16A16_SFLOAT, R32G32B32A32_SFLOAT)  \n");
 		printf("-lodBias: level of detail bias applied to filtering (default = 0) \n");
+		printf("-cacheDir: directory to cache cube maps converted from panoramas in, later runs on the same input and resolution skip the conversion\n");
+		printf("-cacheSizeMB: size limit of the cache, least recently used entries are removed beyond it (default = 1024)\n");
+		printf("-pipelineCacheDir: directory of the Vulkan pipeline cache (default = IBLSAMPLER_PIPELINE_CACHE_DIR or the working directory)\n");
+		printf("-force: sample even if the output was written from the same input with the same parameters\n");
+		printf("-hierarchical: filter GGX levels from the previous level with at most 64 samples, much faster for high sample counts\n");
+		printf("-mis: draw half of the samples from a luminance CDF of the input (multiple importance sampling), removes the noise of bright light sources like the sun\n");
+		printf("-compare: sample brute force to a .reference cube map next to outCubeMap and with -hierarchical and/or -mis (default -hierarchical) to outCubeMap, print error and speedup\n");
+		printf("-referenceSampleCount: sample count of the -compare reference, a higher count than -sampleCount also estimates the equal quality speedup\n");
+		printf("-extractSun: remove the brightest light source from the input before filtering and print it as an analytic light (direction, color, solid angle), also stored in the IBLSamplerLight metadata of outCubeMap\n");
 
 
 		return 0;
@@ -106,6 +116,42 @@ int main(int argc, char* argv[])
 		{
 			lodBias = atof(nextArg);
 		}
+		else if (strcmp(argv[i], "-cacheDir") == 0)
+		{
+			options.cacheDirectory = nextArg;
+		}
+		else if (strcmp(argv[i], "-cacheSizeMB") == 0)
+		{
+			options.cacheSizeLimit = strtoull(nextArg, NULL, 0) * 1024ull * 1024ull;
+		}
+		else if (strcmp(argv[i], "-pipelineCacheDir") == 0)
+		{
+			options.pipelineCacheDirectory = nextArg;
+		}
+		else if (strcmp(argv[i], "-force") == 0)
+		{
+			options.force = true;
+		}
+		else if (strcmp(argv[i], "-hierarchical") == 0)
+		{
+			options.hierarchicalFiltering = true;
+		}
+		else if (strcmp(argv[i], "-mis") == 0)
+		{
+			options.multipleImportanceSampling = true;
+		}
+		else if (strcmp(argv[i], "-compare") == 0)
+		{
+			options.compareFiltering = true;
+		}
+		else if (strcmp(argv[i], "-referenceSampleCount") == 0)
+		{
+			options.referenceSampleCount = strtoul(nextArg, NULL, 0);
+		}
+		else if (strcmp(argv[i], "-extractSun") == 0)
+		{
+			options.extractSun = true;
+		}
 		else if (strcmp(argv[i], "-debug") == 0)
 		{
 			enableDebugOutput = true;
@@ -148,7 +194,30 @@ int main(int argc, char* argv[])
 	printf("lodBias set to %f \n", lodBias);
 	printf("debug flag is set to %s\n", enableDebugOutput ? "True" : "False");
 
-	Result res = sample(pathIn, pathOutCubeMap, pathOutLUT, distribution, cubeMapResolution, mipLevelCount, sampleCount, targetFormat, lodBias, enableDebugOutput);
+	if (options.cacheDirectory != nullptr)
+	{
+		printf("cacheDir set to %s (%llu MB)\n", options.cacheDirectory, options.cacheSizeLimit / (1024ull * 1024ull));
+	}
+
+	// the outputs are written in the background while the Vulkan context is torn down
+	options.asyncOutput = true;
+
+	SampleStatistics statistics;
+	options.statistics = &statistics;
+
+	Result res = sample(pathIn, pathOutCubeMap, pathOutLUT, distribution, cubeMapResolution, mipLevelCount, sampleCount, targetFormat, lodBias, enableDebugOutput, options);
+
+	if (res == Result::Success && statistics.light.found)
+	{
+		const ExtractedLight& light = statistics.light;
+		printf("Sun direction %f %f %f color %f %f %f solid angle %g sr\n",
+			light.direction[0], light.direction[1], light.direction[2], light.color[0], light.color[1], light.color[2], light.solidAngle);
+	}
+
+	if (flushOutputs() != Result::Success)
+	{
+		return -1;
+	}
 
 	if (res != Result::Success)
 	{
@@ -0,0 +1,29 @@
+# Compiles one entry point of a shader embedded as raw string literal (R""( ... )"") to a SPIR-V C header.
+# Called by the custom commands in the top level CMakeLists.txt with GLSLANG_VALIDATOR, SOURCE, STAGE, ENTRY_POINT, VARIABLE, DEFINE (may be empty) and OUTPUT.
+
+file(READ "${SOURCE}" glsl)
+string(REGEX REPLACE "^[ \t\r\n]*R\"\"\\(" "" glsl "${glsl}")
+string(REGEX REPLACE "\\)\"\"[ \t\r\n]*$" "" glsl "${glsl}")
+
+set(define_args "")
+if (DEFINE)
+    set(define_args "-D${DEFINE}")
+endif()
+
+set(glsl_path "${OUTPUT}.${STAGE}")
+file(WRITE "${glsl_path}" "${glsl}")
+
+# same settings as ShaderCompiler::compile
+execute_process(
+    COMMAND "${GLSLANG_VALIDATOR}" -V --target-env vulkan1.0 -S ${STAGE}
+        -e ${ENTRY_POINT} --source-entrypoint ${ENTRY_POINT} ${define_args}
+        --auto-map-bindings --auto-map-locations -Os
+        --vn ${VARIABLE} -o "${OUTPUT}" "${glsl_path}"
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE output)
+
+if (NOT result EQUAL 0)
+    file(REMOVE "${OUTPUT}")
+    message(FATAL_ERROR "Failed to compile ${SOURCE} (${ENTRY_POINT}):\n${output}")
+endif()
@@ -17,5 +17,81 @@ namespace IBLLib
 		Charlie = 2
 	};
 
+	// the dominant light removed from the environment by SampleOptions::extractSun
+	struct ExtractedLight
+	{
+		// false if no texel is much brighter than the environment, the input is filtered unchanged then
+		bool found = false;
+		// unit vector towards the light in the directions the cube map is sampled with
+		float direction[3] = { 0.f, 0.f, 0.f };
+		// radiance above the surroundings integrated over the light, the linear RGB illuminance of a directional light facing it
+		float color[3] = { 0.f, 0.f, 0.f };
+		// of the removed texels in steradians, color / solidAngle is the radiance of a disk light
+		float solidAngle = 0.f;
+	};
+
+	struct SampleStatistics
+	{
+		ExtractedLight light;
+	};
+
+	struct SampleOptions
+	{
+		// directory of the cache for cube maps converted from panoramas, nullptr disables the cache.
+		// entries are keyed by the input content and the cube map resolution, a hit skips decoding, conversion and mip generation.
+		// libraries built with the runtime shader compiler also keep compiled SPIR-V in its shaders subdirectory
+		const char* cacheDirectory = nullptr;
+		// least recently used entries are evicted once the cache grows beyond this
+		unsigned long long cacheSizeLimit = 1024ull * 1024ull * 1024ull;
+		// outputs whose job hash (input content, parameters and library version) matches are skipped unless force is set
+		bool force = false;
+		// sample returns once the LUT is handed to a background writer, call flushOutputs before using it.
+		// cube maps are always streamed to disk while they are read back
+		bool asyncOutput = false;
+		// directory of the Vulkan pipeline cache, nullptr uses IBLSAMPLER_PIPELINE_CACHE_DIR or the working directory
+		const char* pipelineCacheDirectory = nullptr;
+		// GGX levels are filtered from the previous level with few samples instead of from the input, much faster at a small loss of accuracy
+		bool hierarchicalFiltering = false;
+		// half of the samples are drawn from a luminance CDF of the input and combined with the distribution samples by multiple importance sampling,
+		// which removes most of the noise of small bright light sources such as the sun
+		bool multipleImportanceSampling = false;
+		// additionally samples brute force to a ".reference" cube map next to the output and prints the error and speedup of
+		// hierarchical filtering and/or multiple importance sampling (hierarchical filtering if neither is set)
+		bool compareFiltering = false;
+		// sample count of the compareFiltering reference, 0 uses the sample count of the output.
+		// a higher count also compares brute force with the output's sample count and estimates the equal quality speedup
+		unsigned int referenceSampleCount = 0u;
+		// finds the brightest light source of the input with a reduction on the GPU, replaces its texels by their surroundings before filtering
+		// and reports it in statistics and the "IBLSamplerLight" metadata of the output, so that it can be rendered as an analytic light instead
+		bool extractSun = false;
+		// filled by sample if not nullptr, also if the output is up to date
+		SampleStatistics* statistics = nullptr;
+	};
+
 	Result sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int  _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput);
+	Result sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int  _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput, const SampleOptions& _options);
+
+	// the arguments of one sample call
+	struct SampleJob
+	{
+		const char* inputPath = nullptr;
+		const char* outputPathCubeMap = nullptr;
+		// nullptr skips the LUT
+		const char* outputPathLUT = nullptr;
+		Distribution distribution = Distribution::GGX;
+		unsigned int cubemapResolution = 0u;
+		unsigned int mipmapCount = 0u;
+		unsigned int sampleCount = 1024u;
+		OutputFormat targetFormat = OutputFormat::R16G16B16A16_SFLOAT;
+		float lodBias = 0.f;
+		SampleOptions options;
+	};
+
+	// samples the jobs in order on one Vulkan device, the readback and writing of a job overlap with the filter passes of the next one.
+	// the device uses the pipeline cache directory of the first job, jobs with compareFiltering are sampled on a device of their own.
+	// a failed job does not stop the batch, the first failure is returned
+	Result sampleBatch(const SampleJob* _jobs, unsigned int _jobCount, bool _debugOutput);
+
+	// waits until all outputs of sample calls with asyncOutput are written, returns the first write failure since the last flush
+	Result flushOutputs();
 } // !IBLLib
\ No newline at end of file
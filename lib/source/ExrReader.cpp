@@ -0,0 +1,1134 @@
+#include "ExrReader.h"
+#include "ThreadPool.h"
+#include "format.h"
+
+#include <stb_image.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+	constexpr uint32_t ExrMagic = 20000630u;
+	constexpr uint32_t ExrVersion = 2u;
+	constexpr uint32_t ExrTiledFlag = 0x200u;
+	constexpr uint32_t ExrDeepFlag = 0x800u;
+	constexpr uint32_t ExrMultiPartFlag = 0x1000u;
+
+	// long names are limited to 255 characters
+	constexpr size_t MaxNameLength = 256u;
+
+	constexpr uint16_t HalfOne = 0x3c00u;
+
+	uint32_t loadUint32(const uint8_t* _data)
+	{
+		return static_cast<uint32_t>(_data[0]) | (static_cast<uint32_t>(_data[1]) << 8u) | (static_cast<uint32_t>(_data[2]) << 16u) | (static_cast<uint32_t>(_data[3]) << 24u);
+	}
+
+	uint64_t loadUint64(const uint8_t* _data)
+	{
+		return static_cast<uint64_t>(loadUint32(_data)) | (static_cast<uint64_t>(loadUint32(_data + 4)) << 32u);
+	}
+
+	bool readUint32(const IBLLib::MappedFile& _file, size_t& _pos, uint32_t& _outValue)
+	{
+		if (_file.getSize() - _pos < 4u)
+		{
+			return false;
+		}
+
+		_outValue = loadUint32(_file.getData() + _pos);
+		_pos += 4u;
+		return true;
+	}
+
+	// returns the null terminated string at _pos inside the mapping, attribute and channel names are at most 255 characters long
+	const char* readName(const IBLLib::MappedFile& _file, size_t& _pos)
+	{
+		const char* name = reinterpret_cast<const char*>(_file.getData() + _pos);
+		const size_t maxLength = std::min(MaxNameLength, _file.getSize() - _pos);
+		const size_t length = strnlen(name, maxLength);
+
+		if (length == maxLength)
+		{
+			return nullptr;
+		}
+
+		_pos += length + 1u;
+		return name;
+	}
+
+	uint32_t getSampleSize(uint32_t _pixelType)
+	{
+		return _pixelType == 1u ? 2u : 4u;
+	}
+
+	// undoes the byte delta predictor and the split into even and odd bytes which RLE and ZIP apply before compression
+	void reconstructBytes(uint8_t* _data, size_t _byteSize, uint8_t* _outData)
+	{
+		for (size_t i = 1u; i < _byteSize; ++i)
+		{
+			_data[i] = static_cast<uint8_t>(_data[i - 1u] + _data[i] - 128u);
+		}
+
+		const uint8_t* even = _data;
+		const uint8_t* odd = _data + (_byteSize + 1u) / 2u;
+		for (size_t i = 0u; i < _byteSize; ++i)
+		{
+			_outData[i] = (i & 1u) ? *odd++ : *even++;
+		}
+	}
+
+	uint32_t loadUint16(const uint8_t* _data)
+	{
+		return static_cast<uint32_t>(_data[0]) | (static_cast<uint32_t>(_data[1]) << 8u);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////
+	// PIZ
+	// the 16 bit values of a chunk are mapped to the dense range of the values present in it, wavelet transformed per channel and Huffman coded.
+	// follows the reference implementation (ImfPizCompressor, ImfWav and ImfHuf of OpenEXR)
+
+	constexpr uint32_t PizValueRange = 1u << 16u;
+	constexpr uint32_t PizBitmapSize = PizValueRange >> 3u;
+
+	constexpr uint32_t HufEncodeSize = PizValueRange + 1u; // all values and the run length symbol
+	constexpr uint32_t HufDecodeBits = 14u; // resolved by one table lookup, longer codes are searched
+	constexpr uint32_t HufDecodeSize = 1u << HufDecodeBits;
+	constexpr uint32_t HufDecodeMask = HufDecodeSize - 1u;
+	constexpr uint32_t HufMaxCodeLength = 58u;
+	// code lengths 59 to 62 stand for 2 to 5 unused symbols, 63 is followed by 8 bits of the count - 6
+	constexpr uint32_t HufShortZeroRun = 59u;
+	constexpr uint32_t HufLongZeroRun = 63u;
+	constexpr uint32_t HufShortestLongRun = 2u + HufLongZeroRun - HufShortZeroRun;
+
+	struct HufDecodeEntry
+	{
+		uint32_t length = 0u; // of the short code starting with the bits of the entry, 0 if there is none
+		uint32_t symbol = 0u;
+		uint32_t longCount = 0u; // long codes starting with the bits of the entry
+		uint32_t longFirst = 0u; // of those in the long symbol list
+	};
+
+	// reads the code lengths of the symbols [_min, _max] and assigns canonical codes, the codes are stored as code << 6 | length
+	bool hufUnpackCodes(const uint8_t*& _data, const uint8_t* _end, uint32_t _min, uint32_t _max, std::vector<uint64_t>& _outCodes)
+	{
+		_outCodes.assign(HufEncodeSize, 0u);
+
+		uint64_t bits = 0u;
+		uint32_t bitCount = 0u;
+		auto getBits = [&](uint32_t _count, uint32_t& _outValue)
+		{
+			while (bitCount < _count)
+			{
+				if (_data == _end)
+				{
+					return false;
+				}
+				bits = (bits << 8u) | *_data++;
+				bitCount += 8u;
+			}
+			bitCount -= _count;
+			_outValue = static_cast<uint32_t>(bits >> bitCount) & ((1u << _count) - 1u);
+			return true;
+		};
+
+		for (uint32_t symbol = _min; symbol <= _max; ++symbol)
+		{
+			uint32_t length = 0u;
+			if (getBits(6u, length) == false)
+			{
+				return false;
+			}
+
+			uint32_t zeroRun = 0u;
+			if (length == HufLongZeroRun)
+			{
+				if (getBits(8u, zeroRun) == false)
+				{
+					return false;
+				}
+				zeroRun += HufShortestLongRun;
+			}
+			else if (length >= HufShortZeroRun)
+			{
+				zeroRun = length - HufShortZeroRun + 2u;
+			}
+
+			if (zeroRun == 0u)
+			{
+				_outCodes[symbol] = length;
+			}
+			else if (zeroRun > _max + 1u - symbol)
+			{
+				return false;
+			}
+			else
+			{
+				symbol += zeroRun - 1u;
+			}
+		}
+
+		// longer codes come first, the codes of one length are consecutive in symbol order
+		uint64_t nextCode[HufMaxCodeLength + 1u] = {};
+		for (uint32_t symbol = 0u; symbol < HufEncodeSize; ++symbol)
+		{
+			++nextCode[_outCodes[symbol]];
+		}
+
+		uint64_t code = 0u;
+		for (uint32_t length = HufMaxCodeLength; length > 0u; --length)
+		{
+			const uint64_t shorterCode = (code + nextCode[length]) >> 1u;
+			nextCode[length] = code;
+			code = shorterCode;
+		}
+
+		for (uint32_t symbol = 0u; symbol < HufEncodeSize; ++symbol)
+		{
+			const uint64_t length = _outCodes[symbol];
+			if (length > 0u)
+			{
+				_outCodes[symbol] = length | (nextCode[length]++ << 6u);
+			}
+		}
+
+		return true;
+	}
+
+	// short codes fill all entries starting with their bits, long codes are listed at the entry of their first HufDecodeBits bits
+	bool hufBuildDecodeTable(const std::vector<uint64_t>& _codes, uint32_t _min, uint32_t _max, std::vector<HufDecodeEntry>& _outTable, std::vector<uint32_t>& _outLongSymbols)
+	{
+		_outTable.assign(HufDecodeSize, HufDecodeEntry());
+
+		uint32_t longSymbolCount = 0u;
+		for (uint32_t symbol = _min; symbol <= _max; ++symbol)
+		{
+			const uint64_t code = _codes[symbol] >> 6u;
+			const uint32_t length = static_cast<uint32_t>(_codes[symbol] & 63u);
+
+			if ((code >> length) != 0u)
+			{
+				return false;
+			}
+
+			if (length > HufDecodeBits)
+			{
+				HufDecodeEntry& entry = _outTable[static_cast<size_t>(code >> (length - HufDecodeBits))];
+				if (entry.length != 0u)
+				{
+					return false;
+				}
+				++entry.longCount;
+				++longSymbolCount;
+			}
+			else if (length > 0u)
+			{
+				const size_t first = static_cast<size_t>(code << (HufDecodeBits - length));
+				for (size_t i = first; i < first + (1u << (HufDecodeBits - length)); ++i)
+				{
+					HufDecodeEntry& entry = _outTable[i];
+					if (entry.length != 0u || entry.longCount != 0u)
+					{
+						return false;
+					}
+					entry.length = length;
+					entry.symbol = symbol;
+				}
+			}
+		}
+
+		uint32_t longFirst = 0u;
+		for (HufDecodeEntry& entry : _outTable)
+		{
+			entry.longFirst = longFirst;
+			longFirst += entry.longCount;
+			entry.longCount = 0u;
+		}
+
+		_outLongSymbols.resize(longSymbolCount);
+		for (uint32_t symbol = _min; symbol <= _max; ++symbol)
+		{
+			const uint32_t length = static_cast<uint32_t>(_codes[symbol] & 63u);
+			if (length > HufDecodeBits)
+			{
+				HufDecodeEntry& entry = _outTable[static_cast<size_t>((_codes[symbol] >> 6u) >> (length - HufDecodeBits))];
+				_outLongSymbols[entry.longFirst + entry.longCount++] = symbol;
+			}
+		}
+
+		return true;
+	}
+
+	// _runSymbol repeats the previous value as often as the following 8 bits say
+	bool hufDecode(const std::vector<uint64_t>& _codes, const std::vector<HufDecodeEntry>& _table, const std::vector<uint32_t>& _longSymbols,
+				   const uint8_t* _data, uint32_t _bitCount, uint32_t _runSymbol, uint16_t* _outValues, size_t _valueCount)
+	{
+		const uint8_t* end = _data + (_bitCount + 7u) / 8u;
+		uint16_t* out = _outValues;
+		const uint16_t* outEnd = _outValues + _valueCount;
+
+		uint64_t bits = 0u;
+		int32_t bitCount = 0;
+
+		auto emit = [&](uint32_t _symbol)
+		{
+			if (_symbol != _runSymbol)
+			{
+				if (out == outEnd)
+				{
+					return false;
+				}
+				*out++ = static_cast<uint16_t>(_symbol);
+				return true;
+			}
+
+			if (bitCount < 8)
+			{
+				if (_data == end)
+				{
+					return false;
+				}
+				bits = (bits << 8u) | *_data++;
+				bitCount += 8;
+			}
+			bitCount -= 8;
+
+			const uint32_t run = static_cast<uint8_t>(bits >> bitCount);
+			if (out == _outValues || run > static_cast<size_t>(outEnd - out))
+			{
+				return false;
+			}
+
+			const uint16_t previous = out[-1];
+			for (uint32_t i = 0u; i < run; ++i)
+			{
+				*out++ = previous;
+			}
+			return true;
+		};
+
+		while (_data < end)
+		{
+			bits = (bits << 8u) | *_data++;
+			bitCount += 8;
+
+			while (bitCount >= static_cast<int32_t>(HufDecodeBits))
+			{
+				const HufDecodeEntry& entry = _table[static_cast<size_t>(bits >> (bitCount - HufDecodeBits)) & HufDecodeMask];
+
+				if (entry.length != 0u)
+				{
+					bitCount -= entry.length;
+					if (emit(entry.symbol) == false)
+					{
+						return false;
+					}
+					continue;
+				}
+
+				// the long codes starting with these bits are compared one by one
+				uint32_t i = 0u;
+				for (; i < entry.longCount; ++i)
+				{
+					const uint32_t symbol = _longSymbols[entry.longFirst + i];
+					const int32_t length = static_cast<int32_t>(_codes[symbol] & 63u);
+
+					while (bitCount < length && _data < end)
+					{
+						bits = (bits << 8u) | *_data++;
+						bitCount += 8;
+					}
+
+					if (bitCount >= length && (_codes[symbol] >> 6u) == ((bits >> (bitCount - length)) & ((uint64_t(1) << length) - 1u)))
+					{
+						bitCount -= length;
+						break;
+					}
+				}
+
+				if (i == entry.longCount || emit(_longSymbols[entry.longFirst + i]) == false)
+				{
+					return false;
+				}
+			}
+		}
+
+		// the padding of the last byte is not part of a code, the remaining codes are short
+		const int32_t padding = static_cast<int32_t>((8u - _bitCount) & 7u);
+		bits >>= padding;
+		bitCount -= padding;
+
+		while (bitCount > 0)
+		{
+			const HufDecodeEntry& entry = _table[static_cast<size_t>(bits << (HufDecodeBits - bitCount)) & HufDecodeMask];
+			if (entry.length == 0u || static_cast<int32_t>(entry.length) > bitCount)
+			{
+				return false;
+			}
+
+			bitCount -= entry.length;
+			if (emit(entry.symbol) == false)
+			{
+				return false;
+			}
+		}
+
+		return out == outEnd;
+	}
+
+	bool hufUncompress(const uint8_t* _data, size_t _byteSize, uint16_t* _outValues, size_t _valueCount)
+	{
+		if (_byteSize == 0u)
+		{
+			return _valueCount == 0u;
+		}
+
+		// smallest and largest symbol, table byte size, bit count of the codes and a reserved word
+		if (_byteSize < 20u)
+		{
+			return false;
+		}
+
+		const uint32_t minSymbol = loadUint32(_data);
+		const uint32_t maxSymbol = loadUint32(_data + 4);
+		const uint32_t bitCount = loadUint32(_data + 12);
+		if (minSymbol >= HufEncodeSize || maxSymbol >= HufEncodeSize)
+		{
+			return false;
+		}
+
+		const uint8_t* end = _data + _byteSize;
+		const uint8_t* data = _data + 20;
+
+		std::vector<uint64_t> codes;
+		std::vector<HufDecodeEntry> table;
+		std::vector<uint32_t> longSymbols;
+
+		if (hufUnpackCodes(data, end, minSymbol, maxSymbol, codes) == false ||
+			bitCount > 8u * static_cast<size_t>(end - data) ||
+			hufBuildDecodeTable(codes, minSymbol, maxSymbol, table, longSymbols) == false)
+		{
+			return false;
+		}
+
+		return hufDecode(codes, table, longSymbols, data, bitCount, maxSymbol, _outValues, _valueCount);
+	}
+
+	// inverse of one level of the Haar-like wavelet, the 14 bit variant requires all values below 1 << 14
+	void waveletDecode14(uint16_t _l, uint16_t _h, uint16_t& _outA, uint16_t& _outB)
+	{
+		const int32_t h = static_cast<int16_t>(_h);
+		const int32_t a = static_cast<int16_t>(_l) + (h & 1) + (h >> 1);
+
+		_outA = static_cast<uint16_t>(a);
+		_outB = static_cast<uint16_t>(a - h);
+	}
+
+	// computed modulo 1 << 16
+	void waveletDecode16(uint16_t _l, uint16_t _h, uint16_t& _outA, uint16_t& _outB)
+	{
+		const int32_t b = (static_cast<int32_t>(_l) - (_h >> 1)) & 0xffff;
+		const int32_t a = (static_cast<int32_t>(_h) + b - 0x8000) & 0xffff;
+
+		_outA = static_cast<uint16_t>(a);
+		_outB = static_cast<uint16_t>(b);
+	}
+
+	// undoes the 2D wavelet of a _width x _height plane, neighbours in x are _strideX values apart, in y _strideY values.
+	// the levels are decoded from the coarsest to the finest
+	void waveletDecode(uint16_t* _data, uint32_t _width, uint32_t _strideX, uint32_t _height, uint32_t _strideY, uint16_t _maxValue)
+	{
+		auto decode = _maxValue < (1u << 14u) ? waveletDecode14 : waveletDecode16;
+
+		const uint32_t n = std::min(_width, _height);
+		uint32_t p = 1u;
+		while (p <= n)
+		{
+			p <<= 1u;
+		}
+		p >>= 1u;
+		uint32_t p2 = p;
+		p >>= 1u;
+
+		uint16_t i00, i01, i10, i11;
+
+		for (; p >= 1u; p2 = p, p >>= 1u)
+		{
+			const size_t endY = static_cast<size_t>(_strideY) * (_height - p2);
+			const size_t oy1 = static_cast<size_t>(_strideY) * p;
+			const size_t oy2 = static_cast<size_t>(_strideY) * p2;
+			const size_t ox1 = static_cast<size_t>(_strideX) * p;
+			const size_t ox2 = static_cast<size_t>(_strideX) * p2;
+
+			size_t y = 0u;
+			for (; y <= endY; y += oy2)
+			{
+				const size_t endX = y + static_cast<size_t>(_strideX) * (_width - p2);
+
+				size_t x = y;
+				for (; x <= endX; x += ox2)
+				{
+					uint16_t* p00 = _data + x;
+					uint16_t* p01 = p00 + ox1;
+					uint16_t* p10 = p00 + oy1;
+					uint16_t* p11 = p10 + ox1;
+
+					decode(*p00, *p10, i00, i10);
+					decode(*p01, *p11, i01, i11);
+					decode(i00, i01, *p00, *p01);
+					decode(i10, i11, *p10, *p11);
+				}
+
+				// odd column
+				if (_width & p)
+				{
+					uint16_t* p00 = _data + x;
+					uint16_t* p10 = p00 + oy1;
+
+					decode(*p00, *p10, i00, *p10);
+					*p00 = i00;
+				}
+			}
+
+			// odd row
+			if (_height & p)
+			{
+				const size_t endX = y + static_cast<size_t>(_strideX) * (_width - p2);
+
+				for (size_t x = y; x <= endX; x += ox2)
+				{
+					uint16_t* p00 = _data + x;
+					uint16_t* p01 = p00 + ox1;
+
+					decode(*p00, *p01, i00, *p01);
+					*p00 = i00;
+				}
+			}
+		}
+	}
+} // !anonymous
+
+IBLLib::ExrReader::~ExrReader()
+{
+	close();
+}
+
+IBLLib::Result IBLLib::ExrReader::open(const char* _path)
+{
+	close();
+
+	if (m_file.open(_path, MappedFile::Access::Sequential) == false)
+	{
+		return FileNotFound;
+	}
+
+	size_t pos = 0u;
+	uint32_t magic = 0u;
+	uint32_t version = 0u;
+	if (readUint32(m_file, pos, magic) == false || magic != ExrMagic || readUint32(m_file, pos, version) == false)
+	{
+		close();
+		return InvalidArgument;
+	}
+
+	if ((version & 0xffu) != ExrVersion || (version & (ExrTiledFlag | ExrDeepFlag | ExrMultiPartFlag)) != 0u)
+	{
+		printf("Unsupported OpenEXR version or layout in %s, only single part scanline images are supported\n", _path);
+		close();
+		return InvalidArgument;
+	}
+
+	if (readHeader(pos) == false)
+	{
+		printf("Unsupported OpenEXR header in %s\n", _path);
+		close();
+		return InvalidArgument;
+	}
+
+	// the offset table follows the header and is ordered by increasing y for every line order
+	const uint32_t chunkCount = (m_height + m_rowsPerChunk - 1u) / m_rowsPerChunk;
+	if ((m_file.getSize() - pos) / sizeof(uint64_t) < chunkCount)
+	{
+		printf("Truncated OpenEXR offset table in %s\n", _path);
+		close();
+		return InvalidArgument;
+	}
+
+	m_chunkOffsets.resize(chunkCount);
+	for (uint32_t i = 0u; i < chunkCount; ++i)
+	{
+		m_chunkOffsets[i] = loadUint64(m_file.getData() + pos + i * sizeof(uint64_t));
+	}
+
+	m_currentRow = 0u;
+
+	return Success;
+}
+
+void IBLLib::ExrReader::close()
+{
+	m_file.close();
+
+	m_channels.clear();
+	m_chunkOffsets.clear();
+	m_stripChunks.clear();
+	m_format = Format::Half;
+}
+
+bool IBLLib::ExrReader::readHeader(size_t& _pos)
+{
+	bool hasChannels = false;
+	bool hasCompression = false;
+	bool hasDataWindow = false;
+
+	// attributes are name, type, size, value, the header is terminated by an empty name
+	while (true)
+	{
+		const char* name = readName(m_file, _pos);
+		if (name == nullptr)
+		{
+			return false;
+		}
+
+		if (name[0] == '\0')
+		{
+			break;
+		}
+
+		const char* type = readName(m_file, _pos);
+		uint32_t size = 0u;
+		if (type == nullptr || readUint32(m_file, _pos, size) == false || size > m_file.getSize() - _pos)
+		{
+			return false;
+		}
+
+		const uint8_t* value = m_file.getData() + _pos;
+		_pos += size;
+
+		if (strcmp(name, "channels") == 0 && strcmp(type, "chlist") == 0)
+		{
+			hasChannels = parseChannels(value, size);
+		}
+		else if (strcmp(name, "compression") == 0 && strcmp(type, "compression") == 0 && size == 1u)
+		{
+			m_compression = static_cast<Compression>(value[0]);
+			hasCompression = true;
+		}
+		else if (strcmp(name, "dataWindow") == 0 && strcmp(type, "box2i") == 0 && size == 16u)
+		{
+			const int32_t minX = static_cast<int32_t>(loadUint32(value));
+			const int32_t minY = static_cast<int32_t>(loadUint32(value + 4));
+			const int32_t maxX = static_cast<int32_t>(loadUint32(value + 8));
+			const int32_t maxY = static_cast<int32_t>(loadUint32(value + 12));
+
+			if (maxX < minX || maxY < minY)
+			{
+				return false;
+			}
+
+			m_minY = minY;
+			m_width = static_cast<uint32_t>(static_cast<int64_t>(maxX) - minX + 1);
+			m_height = static_cast<uint32_t>(static_cast<int64_t>(maxY) - minY + 1);
+			hasDataWindow = true;
+		}
+	}
+
+	if (hasChannels == false || hasCompression == false || hasDataWindow == false)
+	{
+		return false;
+	}
+
+	switch (m_compression)
+	{
+	case Compression::None:
+	case Compression::RLE:
+	case Compression::ZIPS:
+		m_rowsPerChunk = 1u;
+		break;
+	case Compression::ZIP:
+		m_rowsPerChunk = 16u;
+		break;
+	case Compression::PIZ:
+		m_rowsPerChunk = 32u;
+		break;
+	default:
+		printf("Unsupported OpenEXR compression %u\n", static_cast<uint32_t>(m_compression));
+		return false;
+	}
+
+	// channel samples are stored planar per scanline in the order of the channel list
+	m_rawRowByteSize = 0u;
+	for (Channel& channel : m_channels)
+	{
+		channel.byteOffset = m_rawRowByteSize * m_width;
+		m_rawRowByteSize += getSampleSize(static_cast<uint32_t>(channel.type));
+	}
+	m_rawRowByteSize *= m_width;
+
+	// half data is not widened, float data is not clamped to the half range
+	m_format = Format::Half;
+	for (const Channel& channel : m_channels)
+	{
+		if (channel.target >= 0 && channel.type != PixelType::Half)
+		{
+			m_format = Format::Float32;
+		}
+	}
+
+	return true;
+}
+
+bool IBLLib::ExrReader::parseChannels(const uint8_t* _value, size_t _byteSize)
+{
+	m_channels.clear();
+	m_gray = false;
+
+	int32_t grayChannel = -1;
+	bool hasColor = false;
+
+	// name, pixel type (int), linear (uchar), reserved (3 bytes), x sampling (int), y sampling (int), terminated by an empty name
+	size_t pos = 0u;
+	while (pos < _byteSize && _value[pos] != 0u)
+	{
+		const char* name = reinterpret_cast<const char*>(_value + pos);
+		const size_t nameLength = strnlen(name, _byteSize - pos);
+		pos += nameLength + 1u;
+
+		if (pos + 16u > _byteSize)
+		{
+			return false;
+		}
+
+		const uint32_t pixelType = loadUint32(_value + pos);
+		const uint32_t xSampling = loadUint32(_value + pos + 8);
+		const uint32_t ySampling = loadUint32(_value + pos + 12);
+		pos += 16u;
+
+		if (pixelType > static_cast<uint32_t>(PixelType::Float) || xSampling != 1u || ySampling != 1u)
+		{
+			printf("Unsupported OpenEXR channel %s\n", name);
+			return false;
+		}
+
+		Channel channel;
+		channel.type = static_cast<PixelType>(pixelType);
+
+		if (nameLength == 1u)
+		{
+			switch (name[0])
+			{
+			case 'R': channel.target = 0; hasColor = true; break;
+			case 'G': channel.target = 1; hasColor = true; break;
+			case 'B': channel.target = 2; hasColor = true; break;
+			case 'A': channel.target = 3; break;
+			case 'Y': grayChannel = static_cast<int32_t>(m_channels.size()); break;
+			default: break;
+			}
+		}
+
+		m_channels.push_back(channel);
+	}
+
+	if (hasColor == false)
+	{
+		if (grayChannel < 0)
+		{
+			printf("OpenEXR file has no R, G, B or Y channel\n");
+			return false;
+		}
+
+		m_channels[grayChannel].target = 0;
+		m_gray = true;
+	}
+
+	return m_channels.empty() == false;
+}
+
+IBLLib::Result IBLLib::ExrReader::readScanlines(void* _outData, uint32_t _rowCount)
+{
+	if (m_file.isOpen() == false || _rowCount == 0u || _rowCount > m_height - m_currentRow)
+	{
+		return InvalidArgument;
+	}
+
+	const uint32_t firstRow = m_currentRow;
+	const uint32_t firstChunk = firstRow / m_rowsPerChunk;
+	const uint32_t chunkCount = (firstRow + _rowCount - 1u) / m_rowsPerChunk - firstChunk + 1u;
+
+	// validate the chunk headers of the strip before decoding, the compressed data is read from the mapping directly
+	m_stripChunks.resize(chunkCount);
+
+	for (uint32_t i = 0u; i < chunkCount; ++i)
+	{
+		const uint32_t chunk = firstChunk + i;
+		const uint32_t chunkRows = std::min(m_rowsPerChunk, m_height - chunk * m_rowsPerChunk);
+
+		size_t pos = static_cast<size_t>(m_chunkOffsets[chunk]);
+		uint32_t y = 0u;
+		uint32_t byteSize = 0u;
+		if (m_chunkOffsets[chunk] >= m_file.getSize() || readUint32(m_file, pos, y) == false || readUint32(m_file, pos, byteSize) == false ||
+			static_cast<int64_t>(static_cast<int32_t>(y)) != static_cast<int64_t>(m_minY) + chunk * m_rowsPerChunk ||
+			byteSize > m_rawRowByteSize * chunkRows)
+		{
+			printf("Corrupt OpenEXR chunk %u\n", chunk);
+			return InvalidArgument;
+		}
+
+		if (byteSize > m_file.getSize() - pos)
+		{
+			printf("Truncated OpenEXR chunk %u\n", chunk);
+			return InvalidArgument;
+		}
+
+		m_stripChunks[i].offset = pos;
+		m_stripChunks[i].byteSize = byteSize;
+	}
+
+	uint8_t* outData = static_cast<uint8_t*>(_outData);
+	const size_t outRowByteSize = getRowByteSize();
+	std::atomic<bool> corrupt(false);
+
+	auto decodeChunk = [&](uint32_t _index)
+	{
+		const uint32_t chunkFirstRow = (firstChunk + _index) * m_rowsPerChunk;
+		const uint32_t chunkRows = std::min(m_rowsPerChunk, m_height - chunkFirstRow);
+
+		std::vector<uint8_t> raw(m_rawRowByteSize * chunkRows);
+		std::vector<uint8_t> scratch;
+
+		if (decompressChunk(m_file.getData() + m_stripChunks[_index].offset, m_stripChunks[_index].byteSize, raw.size(), raw.data(), scratch) == false)
+		{
+			corrupt = true;
+			return;
+		}
+
+		// the channels are planar, convert into a scratch scanline so _outData is written sequentially
+		std::vector<uint16_t> rgbaHalf(m_format == Format::Half ? static_cast<size_t>(m_width) * Channels : 0u);
+		std::vector<float> rgbaFloat(m_format == Format::Float32 ? static_cast<size_t>(m_width) * Channels : 0u);
+		const void* rgba = m_format == Format::Half ? static_cast<const void*>(rgbaHalf.data()) : static_cast<const void*>(rgbaFloat.data());
+
+		const uint32_t begin = std::max(chunkFirstRow, firstRow);
+		const uint32_t end = std::min(chunkFirstRow + chunkRows, firstRow + _rowCount);
+		for (uint32_t row = begin; row < end; ++row)
+		{
+			const uint8_t* rawRow = raw.data() + (row - chunkFirstRow) * m_rawRowByteSize;
+			if (m_format == Format::Half)
+			{
+				convertScanline(rawRow, rgbaHalf.data());
+			}
+			else
+			{
+				convertScanline(rawRow, rgbaFloat.data());
+			}
+			memcpy(outData + (row - firstRow) * outRowByteSize, rgba, outRowByteSize);
+		}
+	};
+
+	if (m_threadPool != nullptr)
+	{
+		m_threadPool->parallelFor(chunkCount, decodeChunk);
+	}
+	else
+	{
+		for (uint32_t i = 0u; i < chunkCount; ++i)
+		{
+			decodeChunk(i);
+		}
+	}
+
+	if (corrupt)
+	{
+		printf("Corrupt OpenEXR data in rows %u to %u\n", firstRow, firstRow + _rowCount - 1u);
+		return InvalidArgument;
+	}
+
+	m_currentRow += _rowCount;
+
+	// chunks which were completely consumed are not read again
+	for (uint32_t i = 0u; i < chunkCount; ++i)
+	{
+		if ((firstChunk + i + 1u) * m_rowsPerChunk <= m_currentRow || m_currentRow == m_height)
+		{
+			m_file.discard(m_stripChunks[i].offset, m_stripChunks[i].byteSize);
+		}
+	}
+
+	return Success;
+}
+
+bool IBLLib::ExrReader::decompressChunk(const uint8_t* _data, size_t _byteSize, size_t _rawByteSize, uint8_t* _outRaw, std::vector<uint8_t>& _scratch) const
+{
+	// chunks which do not get smaller are stored uncompressed
+	if (_byteSize == _rawByteSize)
+	{
+		memcpy(_outRaw, _data, _byteSize);
+		return true;
+	}
+
+	// PIZ does not apply the byte predictor
+	if (m_compression == Compression::PIZ)
+	{
+		return decompressPiz(_data, _byteSize, static_cast<uint32_t>(_rawByteSize / m_rawRowByteSize), _outRaw);
+	}
+
+	_scratch.resize(_rawByteSize);
+
+	switch (m_compression)
+	{
+	case Compression::RLE:
+	{
+		// negative count: -count literal bytes follow, otherwise the next byte is repeated count + 1 times
+		const uint8_t* end = _data + _byteSize;
+		size_t size = 0u;
+
+		while (_data < end)
+		{
+			const int32_t count = static_cast<int8_t>(*_data++);
+
+			if (count < 0)
+			{
+				const size_t literals = static_cast<size_t>(-count);
+				if (literals > static_cast<size_t>(end - _data) || literals > _rawByteSize - size)
+				{
+					return false;
+				}
+
+				memcpy(_scratch.data() + size, _data, literals);
+				_data += literals;
+				size += literals;
+			}
+			else
+			{
+				const size_t run = static_cast<size_t>(count) + 1u;
+				if (_data == end || run > _rawByteSize - size)
+				{
+					return false;
+				}
+
+				memset(_scratch.data() + size, *_data++, run);
+				size += run;
+			}
+		}
+
+		if (size != _rawByteSize)
+		{
+			return false;
+		}
+		break;
+	}
+	case Compression::ZIPS:
+	case Compression::ZIP:
+		if (stbi_zlib_decode_buffer(reinterpret_cast<char*>(_scratch.data()), static_cast<int>(_rawByteSize), reinterpret_cast<const char*>(_data), static_cast<int>(_byteSize)) != static_cast<int>(_rawByteSize))
+		{
+			return false;
+		}
+		break;
+	default:
+		return false;
+	}
+
+	reconstructBytes(_scratch.data(), _rawByteSize, _outRaw);
+
+	return true;
+}
+
+bool IBLLib::ExrReader::decompressPiz(const uint8_t* _data, size_t _byteSize, uint32_t _rowCount, uint8_t* _outRaw) const
+{
+	const uint8_t* end = _data + _byteSize;
+
+	// the bitmap of the values present in the chunk, only the bytes from the first to the last non zero one are stored
+	if (_byteSize < 4u)
+	{
+		return false;
+	}
+
+	const uint32_t minNonZero = loadUint16(_data);
+	const uint32_t maxNonZero = loadUint16(_data + 2);
+	_data += 4;
+
+	if (minNonZero >= PizBitmapSize || maxNonZero >= PizBitmapSize)
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> bitmap(PizBitmapSize, 0u);
+	if (minNonZero <= maxNonZero)
+	{
+		const size_t bitmapByteSize = maxNonZero - minNonZero + 1u;
+		if (bitmapByteSize > static_cast<size_t>(end - _data))
+		{
+			return false;
+		}
+
+		memcpy(bitmap.data() + minNonZero, _data, bitmapByteSize);
+		_data += bitmapByteSize;
+	}
+
+	// the values were replaced by their index among the present values, 0 is always present
+	std::vector<uint16_t> lut(PizValueRange, 0u);
+	uint32_t valueCount = 0u;
+	for (uint32_t i = 0u; i < PizValueRange; ++i)
+	{
+		if (i == 0u || (bitmap[i >> 3u] & (1u << (i & 7u))) != 0u)
+		{
+			lut[valueCount++] = static_cast<uint16_t>(i);
+		}
+	}
+	const uint16_t maxValue = static_cast<uint16_t>(valueCount - 1u);
+
+	uint32_t hufByteSize = 0u;
+	if (end - _data < 4 || (hufByteSize = loadUint32(_data)) > static_cast<size_t>(end - _data - 4))
+	{
+		return false;
+	}
+	_data += 4;
+
+	// the 16 bit values of all channels, each channel is a plane of _rowCount rows
+	std::vector<uint16_t> values(m_rawRowByteSize * _rowCount / sizeof(uint16_t));
+	if (hufUncompress(_data, hufByteSize, values.data(), values.size()) == false)
+	{
+		return false;
+	}
+
+	// FLOAT and UINT samples are transformed as two planes of interleaved 16 bit halves
+	std::vector<size_t> planeOffsets(m_channels.size());
+	size_t planeOffset = 0u;
+	for (size_t c = 0u; c < m_channels.size(); ++c)
+	{
+		const uint32_t components = getSampleSize(static_cast<uint32_t>(m_channels[c].type)) / 2u;
+		for (uint32_t j = 0u; j < components; ++j)
+		{
+			waveletDecode(values.data() + planeOffset + j, m_width, components, _rowCount, m_width * components, maxValue);
+		}
+
+		planeOffsets[c] = planeOffset;
+		planeOffset += static_cast<size_t>(m_width) * components * _rowCount;
+	}
+
+	for (uint16_t& value : values)
+	{
+		value = lut[value];
+	}
+
+	// back to scanlines with the channels one after another, little endian
+	uint8_t* out = _outRaw;
+	for (uint32_t row = 0u; row < _rowCount; ++row)
+	{
+		for (size_t c = 0u; c < m_channels.size(); ++c)
+		{
+			const size_t rowValueCount = static_cast<size_t>(m_width) * (getSampleSize(static_cast<uint32_t>(m_channels[c].type)) / 2u);
+			const uint16_t* src = values.data() + planeOffsets[c] + row * rowValueCount;
+
+			for (size_t i = 0u; i < rowValueCount; ++i)
+			{
+				*out++ = static_cast<uint8_t>(src[i]);
+				*out++ = static_cast<uint8_t>(src[i] >> 8u);
+			}
+		}
+	}
+
+	return true;
+}
+
+void IBLLib::ExrReader::convertScanline(const uint8_t* _raw, uint16_t* _outRGBA) const
+{
+	for (uint32_t x = 0u; x < m_width; ++x)
+	{
+		uint16_t* texel = _outRGBA + x * Channels;
+		texel[0] = texel[1] = texel[2] = 0u;
+		texel[3] = HalfOne;
+	}
+
+	for (const Channel& channel : m_channels)
+	{
+		if (channel.target < 0)
+		{
+			continue;
+		}
+
+		const uint8_t* samples = _raw + channel.byteOffset;
+		uint16_t* dst = _outRGBA + channel.target;
+
+		for (uint32_t x = 0u; x < m_width; ++x, dst += Channels)
+		{
+			switch (channel.type)
+			{
+			case PixelType::Half:
+				*dst = static_cast<uint16_t>(samples[x * 2u] | (samples[x * 2u + 1u] << 8u));
+				break;
+			case PixelType::Float:
+			{
+				const uint32_t bits = loadUint32(samples + x * 4u);
+				float value = 0.f;
+				memcpy(&value, &bits, sizeof(value));
+				*dst = floatToHalf(value);
+				break;
+			}
+			default:
+				*dst = floatToHalf(static_cast<float>(loadUint32(samples + x * 4u)));
+				break;
+			}
+		}
+	}
+
+	if (m_gray)
+	{
+		for (uint32_t x = 0u; x < m_width; ++x)
+		{
+			uint16_t* texel = _outRGBA + x * Channels;
+			texel[1] = texel[2] = texel[0];
+		}
+	}
+}
+
+void IBLLib::ExrReader::convertScanline(const uint8_t* _raw, float* _outRGBA) const
+{
+	for (uint32_t x = 0u; x < m_width; ++x)
+	{
+		float* texel = _outRGBA + x * Channels;
+		texel[0] = texel[1] = texel[2] = 0.f;
+		texel[3] = 1.f;
+	}
+
+	for (const Channel& channel : m_channels)
+	{
+		if (channel.target < 0)
+		{
+			continue;
+		}
+
+		const uint8_t* samples = _raw + channel.byteOffset;
+		float* dst = _outRGBA + channel.target;
+
+		for (uint32_t x = 0u; x < m_width; ++x, dst += Channels)
+		{
+			switch (channel.type)
+			{
+			case PixelType::Half:
+				*dst = halfToFloat(static_cast<uint16_t>(samples[x * 2u] | (samples[x * 2u + 1u] << 8u)));
+				break;
+			case PixelType::Float:
+			{
+				const uint32_t bits = loadUint32(samples + x * 4u);
+				memcpy(dst, &bits, sizeof(float));
+				break;
+			}
+			default:
+				*dst = static_cast<float>(loadUint32(samples + x * 4u));
+				break;
+			}
+		}
+	}
+
+	if (m_gray)
+	{
+		for (uint32_t x = 0u; x < m_width; ++x)
+		{
+			float* texel = _outRGBA + x * Channels;
+			texel[1] = texel[2] = texel[0];
+		}
+	}
+}
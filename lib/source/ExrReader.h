@@ -0,0 +1,116 @@
+#pragma once
+#include "ResultType.h"
+#include "FileHelper.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace IBLLib
+{
+	class ThreadPool;
+
+	// Decodes single part scanline OpenEXR images to RGBA half floats, or 32 bit floats if a color channel is FLOAT or UINT, in strips of scanlines.
+	// Supports NONE, RLE, ZIPS, ZIP and PIZ compression with HALF, FLOAT and UINT channels. Tiled, deep and multi part files are rejected.
+	// The file is memory mapped, the chunks of a strip are decompressed and converted straight from the mapping in parallel on the thread pool.
+	class ExrReader
+	{
+	public:
+		enum class Format
+		{
+			Float32 = 0, // RGBA
+			Half // RGBA, only used if all color channels are HALF
+		};
+
+		// _threadPool may be null to decode on the calling thread
+		explicit ExrReader(ThreadPool* _threadPool = nullptr) : m_threadPool(_threadPool) {}
+		~ExrReader();
+
+		// reads the header and the chunk offsets, fails if the file is not an OpenEXR file with a supported layout
+		Result open(const char* _path);
+		void close();
+
+		// decodes the next _rowCount scanlines in getFormat() into _outData, which must hold _rowCount * getRowByteSize() bytes.
+		// missing color channels are 0, a missing alpha channel is 1, a Y channel without R, G and B is read as gray.
+		// _outData is written sequentially and never read, so it can point to write combined memory
+		Result readScanlines(void* _outData, uint32_t _rowCount);
+
+		size_t getRowByteSize() const { return static_cast<size_t>(m_width) * Channels * (m_format == Format::Half ? sizeof(uint16_t) : sizeof(float)); }
+
+		// FLOAT and UINT channels exceed the half range, e.g. unclipped suns
+		Format getFormat() const { return m_format; }
+
+		// strips starting at multiples of this do not decompress a chunk twice
+		uint32_t getRowsPerChunk() const { return m_rowsPerChunk; }
+
+		uint32_t getWidth() const { return m_width; }
+		uint32_t getHeight() const { return m_height; }
+		uint32_t getCurrentRow() const { return m_currentRow; }
+
+		static constexpr uint32_t Channels = 4u;
+
+	private:
+		enum class Compression : uint8_t
+		{
+			None = 0,
+			RLE = 1,
+			ZIPS = 2,
+			ZIP = 3,
+			PIZ = 4
+		};
+
+		enum class PixelType : uint32_t
+		{
+			Uint = 0,
+			Half = 1,
+			Float = 2
+		};
+
+		struct Channel
+		{
+			PixelType type = PixelType::Half;
+			size_t byteOffset = 0u; // of the first sample in an uncompressed scanline
+			int32_t target = -1; // RGBA component, -1 if the channel is ignored
+		};
+
+		struct ChunkRange
+		{
+			size_t offset = 0u; // of the compressed data in the file
+			size_t byteSize = 0u;
+		};
+
+		// _pos is advanced past the header
+		bool readHeader(size_t& _pos);
+		bool parseChannels(const uint8_t* _value, size_t _byteSize);
+
+		// _outRaw receives _rawByteSize bytes, _scratch is resized as needed
+		bool decompressChunk(const uint8_t* _data, size_t _byteSize, size_t _rawByteSize, uint8_t* _outRaw, std::vector<uint8_t>& _scratch) const;
+		// Huffman decoding, inverse wavelet and lookup table of a chunk of _rowCount scanlines
+		bool decompressPiz(const uint8_t* _data, size_t _byteSize, uint32_t _rowCount, uint8_t* _outRaw) const;
+
+		// converts one uncompressed scanline to RGBA half
+		void convertScanline(const uint8_t* _raw, uint16_t* _outRGBA) const;
+		// converts one uncompressed scanline to RGBA float
+		void convertScanline(const uint8_t* _raw, float* _outRGBA) const;
+
+		ThreadPool* m_threadPool = nullptr;
+
+		MappedFile m_file;
+
+		Compression m_compression = Compression::None;
+		std::vector<Channel> m_channels;
+		bool m_gray = false;
+		Format m_format = Format::Half;
+
+		std::vector<uint64_t> m_chunkOffsets;
+		size_t m_rawRowByteSize = 0u;
+
+		// compressed chunks of the current strip
+		std::vector<ChunkRange> m_stripChunks;
+
+		int32_t m_minY = 0;
+		uint32_t m_width = 0u;
+		uint32_t m_height = 0u;
+		uint32_t m_rowsPerChunk = 1u;
+		uint32_t m_currentRow = 0u;
+	};
+} // !IBLLib
@@ -0,0 +1,183 @@
+#include "FileCache.h"
+#include "FileHelper.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <algorithm>
+
+namespace
+{
+	constexpr const char* IndexFileName = "index.txt";
+	constexpr const char* IndexHeader = "IBLSamplerFileCache 1";
+} // !anonymous
+
+bool IBLLib::FileCache::open(const char* _directory, uint64_t _sizeLimit)
+{
+	m_directory = _directory;
+	m_sizeLimit = _sizeLimit;
+	m_useCounter = 0u;
+	m_entries.clear();
+
+	if (m_directory.empty() == false && m_directory.back() != '/' && m_directory.back() != '\\')
+	{
+		m_directory += '/';
+	}
+
+	if (createDirectory(_directory) == false)
+	{
+		printf("Failed to create cache directory %s\n", _directory);
+		return false;
+	}
+
+	// a missing or unreadable index starts an empty cache, files it does not list are never used
+	FILE* file = fopen(getIndexPath().c_str(), "r");
+	if (file == nullptr)
+	{
+		return true;
+	}
+
+	char header[64] = {};
+	if (fgets(header, sizeof(header), file) != nullptr && strncmp(header, IndexHeader, strlen(IndexHeader)) == 0)
+	{
+		Entry entry;
+		while (fscanf(file, "%" SCNx64 " %" SCNu64 " %" SCNu64, &entry.key, &entry.byteSize, &entry.lastUse) == 3)
+		{
+			m_entries.push_back(entry);
+			m_useCounter = std::max(m_useCounter, entry.lastUse);
+		}
+	}
+
+	fclose(file);
+
+	return true;
+}
+
+bool IBLLib::FileCache::lookup(uint64_t _key, std::string& _outPath)
+{
+	auto it = std::find_if(m_entries.begin(), m_entries.end(), [_key](const Entry& _entry) { return _entry.key == _key; });
+	if (it == m_entries.end())
+	{
+		return false;
+	}
+
+	const std::string path = getEntryPath(_key);
+
+	// the file might have been deleted manually
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+	{
+		m_entries.erase(it);
+		writeIndex();
+		return false;
+	}
+	fclose(file);
+
+	it->lastUse = ++m_useCounter;
+	writeIndex();
+
+	_outPath = path;
+	return true;
+}
+
+std::string IBLLib::FileCache::getTemporaryPath(uint64_t _key) const
+{
+	return getEntryPath(_key) + ".tmp";
+}
+
+bool IBLLib::FileCache::insert(uint64_t _key)
+{
+	const std::string temporaryPath = getTemporaryPath(_key);
+
+	uint64_t byteSize = 0u;
+	{
+		MappedFile file;
+		if (file.open(temporaryPath.c_str(), MappedFile::Access::Random) == false)
+		{
+			return false;
+		}
+		byteSize = file.getSize();
+	}
+
+	if (replaceFile(temporaryPath.c_str(), getEntryPath(_key).c_str()) == false)
+	{
+		return false;
+	}
+
+	auto it = std::find_if(m_entries.begin(), m_entries.end(), [_key](const Entry& _entry) { return _entry.key == _key; });
+	if (it == m_entries.end())
+	{
+		it = m_entries.insert(m_entries.end(), Entry{});
+		it->key = _key;
+	}
+
+	it->byteSize = byteSize;
+	it->lastUse = ++m_useCounter;
+
+	evict(_key);
+
+	return writeIndex();
+}
+
+std::string IBLLib::FileCache::getEntryPath(uint64_t _key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016" PRIx64 ".ktx2", _key);
+	return m_directory + name;
+}
+
+std::string IBLLib::FileCache::getIndexPath() const
+{
+	return m_directory + IndexFileName;
+}
+
+bool IBLLib::FileCache::writeIndex() const
+{
+	// write a new index and swap it in, an interrupted write leaves the previous index intact
+	const std::string indexPath = getIndexPath();
+	const std::string temporaryPath = indexPath + ".tmp";
+
+	FILE* file = fopen(temporaryPath.c_str(), "w");
+	if (file == nullptr)
+	{
+		printf("Failed to write cache index %s\n", temporaryPath.c_str());
+		return false;
+	}
+
+	fprintf(file, "%s\n", IndexHeader);
+	for (const Entry& entry : m_entries)
+	{
+		fprintf(file, "%016" PRIx64 " %" PRIu64 " %" PRIu64 "\n", entry.key, entry.byteSize, entry.lastUse);
+	}
+
+	const bool written = ferror(file) == 0;
+	fclose(file);
+
+	return written && replaceFile(temporaryPath.c_str(), indexPath.c_str());
+}
+
+void IBLLib::FileCache::evict(uint64_t _keepKey)
+{
+	uint64_t totalSize = 0u;
+	for (const Entry& entry : m_entries)
+	{
+		totalSize += entry.byteSize;
+	}
+
+	// least recently used first
+	std::sort(m_entries.begin(), m_entries.end(), [](const Entry& _a, const Entry& _b) { return _a.lastUse < _b.lastUse; });
+
+	auto it = m_entries.begin();
+	while (totalSize > m_sizeLimit && it != m_entries.end())
+	{
+		if (it->key == _keepKey)
+		{
+			++it;
+			continue;
+		}
+
+		remove(getEntryPath(it->key).c_str());
+		totalSize -= it->byteSize;
+		it = m_entries.erase(it);
+	}
+}
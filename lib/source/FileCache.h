@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace IBLLib
+{
+	// On disk cache of files addressed by a 64 bit key, e.g. a content hash of the input combined with the processing parameters.
+	// Entries are tracked in an index file, the least recently used ones are evicted once the total size exceeds the limit.
+	// Not safe for concurrent use by several processes.
+	class FileCache
+	{
+	public:
+		// creates _directory if needed and loads its index
+		bool open(const char* _directory, uint64_t _sizeLimit);
+
+		// returns true and the path of the entry if _key is cached, the entry becomes the most recently used one
+		bool lookup(uint64_t _key, std::string& _outPath);
+
+		// new entries are written to this path and added with insert
+		std::string getTemporaryPath(uint64_t _key) const;
+
+		// moves the file at getTemporaryPath(_key) into the cache and evicts least recently used entries beyond the size limit
+		bool insert(uint64_t _key);
+
+	private:
+		struct Entry
+		{
+			uint64_t key = 0u;
+			uint64_t byteSize = 0u;
+			uint64_t lastUse = 0u;
+		};
+
+		std::string getEntryPath(uint64_t _key) const;
+		std::string getIndexPath() const;
+
+		bool writeIndex() const;
+		void evict(uint64_t _keepKey);
+
+		std::string m_directory;
+		uint64_t m_sizeLimit = 0u;
+		uint64_t m_useCounter = 0u;
+		std::vector<Entry> m_entries;
+	};
+} // !IBLLib
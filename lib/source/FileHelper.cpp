@@ -1,5 +1,22 @@
 #include "FileHelper.h"
 #include <stdio.h>
+#include <algorithm>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 bool IBLLib::readFile(const char* _path, std::vector<char>& _outBuffer)
 {
@@ -41,3 +58,180 @@ bool IBLLib::writeFile(const char* _path, const char* _data, size_t _bytes)
 
 	return sizeWritten > 0u;
 }
+
+bool IBLLib::replaceFile(const char* _src, const char* _dst)
+{
+#if defined(_WIN32)
+	const bool replaced = MoveFileExA(_src, _dst, MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+	const bool replaced = rename(_src, _dst) == 0;
+#endif
+
+	if (replaced == false)
+	{
+		printf("Failed to move file %s to %s\n", _src, _dst);
+	}
+
+	return replaced;
+}
+
+bool IBLLib::createDirectory(const char* _path)
+{
+#if defined(_WIN32)
+	return CreateDirectoryA(_path, nullptr) != FALSE || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+	return mkdir(_path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+IBLLib::MappedFile::~MappedFile()
+{
+	close();
+}
+
+#if defined(_WIN32)
+
+bool IBLLib::MappedFile::open(const char* _path, Access _access)
+{
+	close();
+
+	const DWORD flags = _access == Access::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+	HANDLE file = CreateFileA(_path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		printf("Failed to open file %s\n", _path);
+		return false;
+	}
+
+	LARGE_INTEGER size{};
+	if (GetFileSizeEx(file, &size) == FALSE || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0u, 0u, nullptr);
+	if (mapping == nullptr)
+	{
+		printf("Failed to map file %s\n", _path);
+		CloseHandle(file);
+		return false;
+	}
+
+	const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0u, 0u, 0u);
+	if (data == nullptr)
+	{
+		printf("Failed to map file %s\n", _path);
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_file = file;
+	m_mapping = mapping;
+	m_data = static_cast<const uint8_t*>(data);
+	m_size = static_cast<size_t>(size.QuadPart);
+
+	return true;
+}
+
+void IBLLib::MappedFile::close()
+{
+	if (m_data != nullptr)
+	{
+		UnmapViewOfFile(m_data);
+		m_data = nullptr;
+	}
+
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+
+	if (m_file != nullptr)
+	{
+		CloseHandle(m_file);
+		m_file = nullptr;
+	}
+
+	m_size = 0u;
+}
+
+void IBLLib::MappedFile::discard(size_t _offset, size_t _byteSize)
+{
+	// clean pages of a read only view are trimmed by the memory manager, nothing to do
+	(void)_offset;
+	(void)_byteSize;
+}
+
+#else
+
+bool IBLLib::MappedFile::open(const char* _path, Access _access)
+{
+	close();
+
+	const int file = ::open(_path, O_RDONLY);
+	if (file < 0)
+	{
+		printf("Failed to open file %s\n", _path);
+		return false;
+	}
+
+	struct stat info{};
+	if (fstat(file, &info) != 0 || info.st_size <= 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	const size_t size = static_cast<size_t>(info.st_size);
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+
+	// the mapping keeps its own reference to the file
+	::close(file);
+
+	if (data == MAP_FAILED)
+	{
+		printf("Failed to map file %s\n", _path);
+		return false;
+	}
+
+	madvise(data, size, _access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+
+	m_data = static_cast<const uint8_t*>(data);
+	m_size = size;
+
+	return true;
+}
+
+void IBLLib::MappedFile::close()
+{
+	if (m_data != nullptr)
+	{
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+		m_data = nullptr;
+	}
+
+	m_size = 0u;
+}
+
+void IBLLib::MappedFile::discard(size_t _offset, size_t _byteSize)
+{
+	if (m_data == nullptr || _offset >= m_size)
+	{
+		return;
+	}
+
+	// only whole pages inside the range can be dropped
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t end = std::min(_offset + _byteSize, m_size) / pageSize * pageSize;
+	const size_t begin = (_offset + pageSize - 1u) / pageSize * pageSize;
+
+	if (begin < end)
+	{
+		madvise(const_cast<uint8_t*>(m_data) + begin, end - begin, MADV_DONTNEED);
+	}
+}
+
+#endif
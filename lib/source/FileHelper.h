@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <stddef.h>
+#include <stdint.h>
 
 namespace IBLLib
 {
@@ -13,4 +14,47 @@ namespace IBLLib
 	{
 		return writeFile(_path, reinterpret_cast<const char*>(_outBuffer.data()), _outBuffer.size() * sizeof(T));
 	}
-} // !IBLLIb
\ No newline at end of file
+
+	// renames _src to _dst, replacing _dst if it exists. atomic on the same file system
+	bool replaceFile(const char* _src, const char* _dst);
+
+	// creates a single directory, succeeds if it already exists
+	bool createDirectory(const char* _path);
+
+	// read only memory mapping of a whole file, decoders read the mapped pages directly instead of copying the file to the heap
+	class MappedFile
+	{
+	public:
+		enum class Access
+		{
+			Sequential = 0, // read ahead aggressively, e.g. scanline decoders
+			Random // small files or scattered reads
+		};
+
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// fails for missing and empty files
+		bool open(const char* _path, Access _access = Access::Sequential);
+		void close();
+
+		// hint that [_offset, _offset + _byteSize) will not be read again so its pages can be dropped from the working set
+		void discard(size_t _offset, size_t _byteSize);
+
+		bool isOpen() const { return m_data != nullptr; }
+		const uint8_t* getData() const { return m_data; }
+		size_t getSize() const { return m_size; }
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0u;
+
+#if defined(_WIN32)
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#endif
+	};
+} // !IBLLIb
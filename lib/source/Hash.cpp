@@ -0,0 +1,124 @@
+#include "Hash.h"
+#include "FileHelper.h"
+
+#include <string.h>
+
+namespace
+{
+	constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+	constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+	constexpr uint64_t Prime3 = 0x165667B19E3779F9ull;
+	constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ull;
+	constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ull;
+
+	inline uint64_t rotateLeft(uint64_t _value, uint32_t _bits)
+	{
+		return (_value << _bits) | (_value >> (64u - _bits));
+	}
+
+	// little endian loads, memcpy avoids unaligned access
+	inline uint64_t load64(const uint8_t* _data)
+	{
+		uint64_t value;
+		memcpy(&value, _data, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t load32(const uint8_t* _data)
+	{
+		uint32_t value;
+		memcpy(&value, _data, sizeof(value));
+		return value;
+	}
+
+	inline uint64_t round(uint64_t _acc, uint64_t _input)
+	{
+		_acc += _input * Prime2;
+		_acc = rotateLeft(_acc, 31u);
+		return _acc * Prime1;
+	}
+
+	inline uint64_t mergeRound(uint64_t _acc, uint64_t _value)
+	{
+		_acc ^= round(0u, _value);
+		return _acc * Prime1 + Prime4;
+	}
+} // !anonymous
+
+uint64_t IBLLib::hash64(const void* _data, size_t _byteSize, uint64_t _seed)
+{
+	const uint8_t* data = static_cast<const uint8_t*>(_data);
+	const uint8_t* end = data + _byteSize;
+	uint64_t hash = 0u;
+
+	if (_byteSize >= 32u)
+	{
+		// four independent lanes over 32 byte stripes
+		uint64_t v1 = _seed + Prime1 + Prime2;
+		uint64_t v2 = _seed + Prime2;
+		uint64_t v3 = _seed;
+		uint64_t v4 = _seed - Prime1;
+
+		const uint8_t* limit = end - 32u;
+		do
+		{
+			v1 = round(v1, load64(data));
+			v2 = round(v2, load64(data + 8));
+			v3 = round(v3, load64(data + 16));
+			v4 = round(v4, load64(data + 24));
+			data += 32u;
+		} while (data <= limit);
+
+		hash = rotateLeft(v1, 1u) + rotateLeft(v2, 7u) + rotateLeft(v3, 12u) + rotateLeft(v4, 18u);
+		hash = mergeRound(hash, v1);
+		hash = mergeRound(hash, v2);
+		hash = mergeRound(hash, v3);
+		hash = mergeRound(hash, v4);
+	}
+	else
+	{
+		hash = _seed + Prime5;
+	}
+
+	hash += static_cast<uint64_t>(_byteSize);
+
+	for (; data + 8u <= end; data += 8u)
+	{
+		hash ^= round(0u, load64(data));
+		hash = rotateLeft(hash, 27u) * Prime1 + Prime4;
+	}
+
+	if (data + 4u <= end)
+	{
+		hash ^= static_cast<uint64_t>(load32(data)) * Prime1;
+		hash = rotateLeft(hash, 23u) * Prime2 + Prime3;
+		data += 4u;
+	}
+
+	for (; data < end; ++data)
+	{
+		hash ^= (*data) * Prime5;
+		hash = rotateLeft(hash, 11u) * Prime1;
+	}
+
+	// avalanche
+	hash ^= hash >> 33u;
+	hash *= Prime2;
+	hash ^= hash >> 29u;
+	hash *= Prime3;
+	hash ^= hash >> 32u;
+
+	return hash;
+}
+
+bool IBLLib::hashFile(const char* _path, uint64_t& _outHash, uint64_t _seed)
+{
+	MappedFile file;
+	if (file.open(_path, MappedFile::Access::Sequential) == false)
+	{
+		return false;
+	}
+
+	_outHash = hash64(file.getData(), file.getSize(), _seed);
+	return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace IBLLib
+{
+	// XXH64 of _data, fast non-cryptographic hash used to address cached files by content
+	uint64_t hash64(const void* _data, size_t _byteSize, uint64_t _seed = 0u);
+
+	// XXH64 of the file contents read through a memory mapping, fails for missing and empty files
+	bool hashFile(const char* _path, uint64_t& _outHash, uint64_t _seed = 0u);
+
+	// mixes _value into _hash, use to build keys from several parameters
+	inline uint64_t hashCombine(uint64_t _hash, uint64_t _value)
+	{
+		return hash64(&_value, sizeof(_value), _hash);
+	}
+} // !IBLLib
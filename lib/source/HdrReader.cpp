@@ -0,0 +1,407 @@
+#include "HdrReader.h"
+#include "ThreadPool.h"
+#include "format.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IBLSAMPLER_HDR_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	constexpr size_t MaxHeaderLineLength = 256u;
+
+	// new style RLE is only used for widths in [8, 32767] and starts with 2, 2, width (big endian)
+	bool isRLEScanline(const uint8_t* _head, uint32_t _width)
+	{
+		return _width >= 8u && _width < 32768u && _head[0] == 2u && _head[1] == 2u && (_head[2] & 0x80u) == 0u;
+	}
+
+	// same result as stbi__hdr_convert: rgb * 2^(e - 136), 0 for e == 0, alpha = 1
+	void convertRGBEToFloat(const uint8_t* _rgbe, float* _out, uint32_t _pixelCount)
+	{
+		uint32_t i = 0u;
+
+#if defined(IBLSAMPLER_HDR_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i exponentBias = _mm_set1_epi32(59);
+		const __m128 rgbMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+		const __m128 alpha = _mm_set_ps(1.f, 0.f, 0.f, 0.f);
+
+		for (; i + 4u <= _pixelCount; i += 4u, _rgbe += 16, _out += 16)
+		{
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_rgbe));
+			const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+			const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+			const __m128i pixels[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero), _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+
+			for (uint32_t p = 0u; p < 4u; ++p)
+			{
+				const __m128i e = _mm_shuffle_epi32(pixels[p], _MM_SHUFFLE(3, 3, 3, 3));
+
+				// 2^(e - 136) split into two normal factors so that only the final multiplication rounds (possibly to a denormal) like the scalar path
+				const __m128i eHalf = _mm_srli_epi32(e, 1);
+				const __m128 scale0 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(eHalf, exponentBias), 23));
+				const __m128 scale1 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_sub_epi32(e, eHalf), exponentBias), 23));
+
+				__m128 rgb = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(pixels[p]), scale0), scale1);
+				rgb = _mm_and_ps(rgb, _mm_castsi128_ps(_mm_cmpgt_epi32(e, zero)));
+
+				_mm_storeu_ps(_out + p * 4u, _mm_or_ps(_mm_and_ps(rgb, rgbMask), alpha));
+			}
+		}
+#endif
+
+		for (; i < _pixelCount; ++i, _rgbe += 4, _out += 4)
+		{
+			if (_rgbe[3] != 0u)
+			{
+				const float f = static_cast<float>(ldexp(1.0, _rgbe[3] - (128 + 8)));
+				_out[0] = _rgbe[0] * f;
+				_out[1] = _rgbe[1] * f;
+				_out[2] = _rgbe[2] * f;
+			}
+			else
+			{
+				_out[0] = _out[1] = _out[2] = 0.f;
+			}
+			_out[3] = 1.f;
+		}
+	}
+} // !anonymous
+
+IBLLib::HdrReader::~HdrReader()
+{
+	close();
+}
+
+IBLLib::Result IBLLib::HdrReader::open(const char* _path)
+{
+	if (m_file.isOpen())
+	{
+		return InvalidArgument;
+	}
+
+	if (m_file.open(_path, MappedFile::Access::Sequential) == false)
+	{
+		return FileNotFound;
+	}
+
+	m_readPos = 0u;
+	m_currentRow = 0u;
+
+	char line[MaxHeaderLineLength];
+
+	if (readLine(line, sizeof(line)) == false || (strcmp(line, "#?RADIANCE") != 0 && strcmp(line, "#?RGBE") != 0))
+	{
+		close();
+		return InvalidArgument;
+	}
+
+	// header lines are terminated by an empty line
+	bool validFormat = false;
+	while (true)
+	{
+		if (readLine(line, sizeof(line)) == false)
+		{
+			close();
+			return InvalidArgument;
+		}
+
+		if (line[0] == '\0')
+		{
+			break;
+		}
+
+		if (strcmp(line, "FORMAT=32-bit_rle_rgbe") == 0)
+		{
+			validFormat = true;
+		}
+	}
+
+	int width = 0;
+	int height = 0;
+	if (validFormat == false || readLine(line, sizeof(line)) == false || sscanf(line, "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0)
+	{
+		printf("Unsupported radiance header in %s\n", _path);
+		close();
+		return InvalidArgument;
+	}
+
+	m_width = static_cast<uint32_t>(width);
+	m_height = static_cast<uint32_t>(height);
+
+	return Success;
+}
+
+void IBLLib::HdrReader::close()
+{
+	m_file.close();
+	m_rowOffsets.clear();
+}
+
+bool IBLLib::HdrReader::readByte(uint8_t& _outByte)
+{
+	if (m_readPos == m_file.getSize())
+	{
+		return false;
+	}
+
+	_outByte = m_file.getData()[m_readPos++];
+	return true;
+}
+
+bool IBLLib::HdrReader::skip(size_t _byteCount)
+{
+	if (_byteCount > m_file.getSize() - m_readPos)
+	{
+		return false;
+	}
+
+	m_readPos += _byteCount;
+	return true;
+}
+
+bool IBLLib::HdrReader::readLine(char* _outLine, size_t _maxLength)
+{
+	size_t length = 0u;
+	uint8_t c = 0u;
+
+	while (readByte(c))
+	{
+		if (c == '\n')
+		{
+			_outLine[length] = '\0';
+			return true;
+		}
+
+		if (length + 1u < _maxLength)
+		{
+			_outLine[length++] = static_cast<char>(c);
+		}
+	}
+
+	return false;
+}
+
+size_t IBLLib::HdrReader::getRowByteSize(Format _format) const
+{
+	switch (_format)
+	{
+	case Format::Float32:
+		return static_cast<size_t>(m_width) * Channels * sizeof(float);
+	case Format::Half:
+		return static_cast<size_t>(m_width) * Channels * sizeof(uint16_t);
+	default:
+		return static_cast<size_t>(m_width) * Channels;
+	}
+}
+
+IBLLib::Result IBLLib::HdrReader::readScanlines(void* _outData, uint32_t _rowCount, Format _format)
+{
+	if (m_file.isOpen() == false || _rowCount > m_height - m_currentRow)
+	{
+		return InvalidArgument;
+	}
+
+	// the scanline lengths are only known after parsing the RLE packets, so the strip is indexed serially
+	m_rowOffsets.resize(_rowCount + 1u);
+
+	for (uint32_t row = 0u; row < _rowCount; ++row)
+	{
+		m_rowOffsets[row] = m_readPos;
+
+		if (indexScanline() == false)
+		{
+			printf("Corrupt radiance scanline %u\n", m_currentRow + row);
+			return InvalidArgument;
+		}
+	}
+	m_rowOffsets[_rowCount] = m_readPos;
+
+	const size_t rgbeRowByteSize = static_cast<size_t>(m_width) * Channels;
+	const size_t outRowByteSize = getRowByteSize(_format);
+	uint8_t* outData = static_cast<uint8_t*>(_outData);
+	std::atomic<bool> corrupt(false);
+
+	auto decodeRow = [&](uint32_t _row)
+	{
+		// RLE decoding writes every 4th byte, decode into a scratch scanline so _outData is written sequentially
+		std::vector<uint8_t> rgbe(rgbeRowByteSize);
+		uint8_t* outRow = outData + _row * outRowByteSize;
+
+		if (decodeScanline(m_file.getData() + m_rowOffsets[_row], m_rowOffsets[_row + 1u] - m_rowOffsets[_row], rgbe.data()) == false)
+		{
+			corrupt = true;
+			return;
+		}
+
+		switch (_format)
+		{
+		case Format::Float32:
+			convertRGBEToFloat(rgbe.data(), reinterpret_cast<float*>(outRow), m_width);
+			break;
+		case Format::Half:
+		{
+			std::vector<float> rgba(rgbeRowByteSize);
+			convertRGBEToFloat(rgbe.data(), rgba.data(), m_width);
+			convertFloatToHalf(rgba.data(), reinterpret_cast<uint16_t*>(outRow), rgba.size());
+			break;
+		}
+		default:
+			memcpy(outRow, rgbe.data(), rgbeRowByteSize);
+			break;
+		}
+	};
+
+	if (m_threadPool != nullptr)
+	{
+		m_threadPool->parallelFor(_rowCount, decodeRow);
+	}
+	else
+	{
+		for (uint32_t row = 0u; row < _rowCount; ++row)
+		{
+			decodeRow(row);
+		}
+	}
+
+	if (corrupt)
+	{
+		printf("Corrupt radiance scanline in rows %u to %u\n", m_currentRow, m_currentRow + _rowCount - 1u);
+		return InvalidArgument;
+	}
+
+	m_currentRow += _rowCount;
+
+	// the decoded strip is not read again
+	m_file.discard(m_rowOffsets[0], m_rowOffsets[_rowCount] - m_rowOffsets[0]);
+
+	return Success;
+}
+
+bool IBLLib::HdrReader::indexScanline()
+{
+	const uint8_t* head = m_file.getData() + m_readPos;
+	if (skip(4u) == false)
+	{
+		return false;
+	}
+
+	if (isRLEScanline(head, m_width) == false)
+	{
+		// flat scanline, the header already is the first pixel
+		return skip((static_cast<size_t>(m_width) - 1u) * 4u);
+	}
+
+	if (((static_cast<uint32_t>(head[2]) << 8u) | head[3]) != m_width)
+	{
+		return false;
+	}
+
+	// each channel is run length encoded separately, only validate and skip the packets here
+	for (uint32_t channel = 0u; channel < 4u; ++channel)
+	{
+		uint32_t x = 0u;
+		while (x < m_width)
+		{
+			uint8_t count = 0u;
+			if (readByte(count) == false)
+			{
+				return false;
+			}
+
+			if (count > 128u)
+			{
+				// run
+				count -= 128u;
+				if (count > m_width - x || skip(1u) == false)
+				{
+					return false;
+				}
+			}
+			else
+			{
+				// literals
+				if (count == 0u || count > m_width - x || skip(count) == false)
+				{
+					return false;
+				}
+			}
+
+			x += count;
+		}
+	}
+
+	return true;
+}
+
+bool IBLLib::HdrReader::decodeScanline(const uint8_t* _data, size_t _byteSize, uint8_t* _outScanline) const
+{
+	if (_byteSize < 4u)
+	{
+		return false;
+	}
+
+	if (isRLEScanline(_data, m_width) == false)
+	{
+		if (_byteSize != static_cast<size_t>(m_width) * 4u)
+		{
+			return false;
+		}
+
+		memcpy(_outScanline, _data, _byteSize);
+		return true;
+	}
+
+	const uint8_t* end = _data + _byteSize;
+	_data += 4u;
+
+	for (uint32_t channel = 0u; channel < 4u; ++channel)
+	{
+		uint32_t x = 0u;
+		while (x < m_width && _data < end)
+		{
+			uint32_t count = *_data++;
+
+			if (count > 128u)
+			{
+				count -= 128u;
+				if (count > m_width - x || _data == end)
+				{
+					return false;
+				}
+
+				const uint8_t value = *_data++;
+				for (uint32_t i = 0u; i < count; ++i, ++x)
+				{
+					_outScanline[x * 4u + channel] = value;
+				}
+			}
+			else
+			{
+				if (count == 0u || count > m_width - x || count > static_cast<size_t>(end - _data))
+				{
+					return false;
+				}
+
+				for (uint32_t i = 0u; i < count; ++i, ++x)
+				{
+					_outScanline[x * 4u + channel] = *_data++;
+				}
+			}
+		}
+
+		if (x != m_width)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
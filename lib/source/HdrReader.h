@@ -0,0 +1,68 @@
+#pragma once
+#include "ResultType.h"
+#include "FileHelper.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace IBLLib
+{
+	class ThreadPool;
+
+	// Decodes Radiance .hdr (RGBE) images in strips of scanlines straight from a memory mapping of the file, pages of decoded strips are dropped again.
+	// Supports the standard "-Y height +X width" orientation with flat and new-style RLE scanlines, which covers what stbi_loadf supports.
+	// The compressed scanlines of a strip are located serially, decoding and conversion runs in parallel on the thread pool.
+	class HdrReader
+	{
+	public:
+		enum class Format
+		{
+			Float32 = 0, // RGBA, alpha = 1
+			Half, // RGBA, alpha = 1, clamped to the half range
+			RGBE // undecoded radiance bytes
+		};
+
+		// _threadPool may be null to decode on the calling thread
+		explicit HdrReader(ThreadPool* _threadPool = nullptr) : m_threadPool(_threadPool) {}
+		~HdrReader();
+
+		// reads the header, fails if the file is not a radiance file with a supported layout
+		Result open(const char* _path);
+		void close();
+
+		// decodes the next _rowCount scanlines into _outData, which must hold _rowCount * getRowByteSize(_format) bytes.
+		// _outData is written sequentially and never read, so it can point to write combined memory
+		Result readScanlines(void* _outData, uint32_t _rowCount, Format _format);
+
+		size_t getRowByteSize(Format _format) const;
+
+		uint32_t getWidth() const { return m_width; }
+		uint32_t getHeight() const { return m_height; }
+		uint32_t getCurrentRow() const { return m_currentRow; }
+
+		static constexpr uint32_t Channels = 4u;
+
+	private:
+		bool readByte(uint8_t& _outByte);
+		bool skip(size_t _byteCount);
+		bool readLine(char* _outLine, size_t _maxLength);
+
+		// validates the next compressed scanline and moves the read position past it
+		bool indexScanline();
+
+		// decodes a compressed scanline from the mapped file into _outScanline as RGBE
+		bool decodeScanline(const uint8_t* _data, size_t _byteSize, uint8_t* _outScanline) const;
+
+		ThreadPool* m_threadPool = nullptr;
+
+		MappedFile m_file;
+		size_t m_readPos = 0u;
+
+		// file offsets of the compressed scanlines of the current strip, row i spans [m_rowOffsets[i], m_rowOffsets[i + 1])
+		std::vector<size_t> m_rowOffsets;
+
+		uint32_t m_width = 0u;
+		uint32_t m_height = 0u;
+		uint32_t m_currentRow = 0u;
+	};
+} // !IBLLib
@@ -0,0 +1,149 @@
+#include "OutputWriter.h"
+#include "FileHelper.h"
+
+#include <stdio.h>
+
+IBLLib::OutputWriter::OutputWriter(uint32_t _threadCount, uint32_t _queueCapacity) :
+	m_queueCapacity(_queueCapacity > 0u ? _queueCapacity : 1u)
+{
+	for (uint32_t i = 0u; i < _threadCount || i == 0u; ++i)
+	{
+		m_workers.emplace_back(&OutputWriter::workerLoop, this);
+	}
+}
+
+IBLLib::OutputWriter::~OutputWriter()
+{
+	flush();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_jobAvailable.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+void IBLLib::OutputWriter::enqueue(const char* _path, WriteFunction _write)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_queueNotFull.wait(lock, [this]() { return m_queue.size() < m_queueCapacity; });
+
+		Job job;
+		job.path = _path;
+		job.write = std::move(_write);
+		m_queue.push_back(std::move(job));
+	}
+	m_jobAvailable.notify_one();
+}
+
+IBLLib::Result IBLLib::OutputWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this]() { return m_queue.empty() && m_activeJobs == 0u; });
+
+	if (m_fileCount > 0u)
+	{
+		const double seconds = std::chrono::duration<double>(m_lastEnd - m_firstStart).count();
+		const double megabytes = m_byteCount / (1024.0 * 1024.0);
+		printf("Wrote %u files (%.2f MB) in %.2f ms, %.2f MB/s\n", m_fileCount, megabytes, seconds * 1000.0, seconds > 0.0 ? megabytes / seconds : 0.0);
+	}
+
+	const Result res = m_firstError;
+	m_firstError = Success;
+	m_fileCount = 0u;
+	m_byteCount = 0u;
+
+	return res;
+}
+
+IBLLib::OutputWriter& IBLLib::OutputWriter::getShared()
+{
+	static OutputWriter writer;
+	return writer;
+}
+
+void IBLLib::OutputWriter::workerLoop()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [this]() { return m_stop || m_queue.empty() == false; });
+
+			if (m_queue.empty())
+			{
+				return;
+			}
+
+			job = std::move(m_queue.front());
+			m_queue.pop_front();
+
+			if (m_fileCount == 0u && m_activeJobs == 0u)
+			{
+				m_firstStart = std::chrono::steady_clock::now();
+			}
+			++m_activeJobs;
+		}
+		m_queueNotFull.notify_one();
+
+		uint64_t byteSize = 0u;
+		const Result res = write(job, byteSize);
+
+		// release the output data before reporting completion
+		job.write = nullptr;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (res != Success && m_firstError == Success)
+			{
+				m_firstError = res;
+			}
+			else if (res == Success)
+			{
+				++m_fileCount;
+				m_byteCount += byteSize;
+				m_lastEnd = std::chrono::steady_clock::now();
+			}
+
+			if (--m_activeJobs == 0u && m_queue.empty())
+			{
+				m_idle.notify_all();
+			}
+		}
+	}
+}
+
+IBLLib::Result IBLLib::OutputWriter::write(const Job& _job, uint64_t& _outByteSize)
+{
+	const std::string temporaryPath = _job.path + ".tmp";
+
+	Result res = _job.write(temporaryPath.c_str());
+	if (res == Success)
+	{
+		MappedFile file;
+		if (file.open(temporaryPath.c_str(), MappedFile::Access::Random))
+		{
+			_outByteSize = file.getSize();
+		}
+	}
+
+	if (res == Success && replaceFile(temporaryPath.c_str(), _job.path.c_str()) == false)
+	{
+		res = FileNotFound;
+	}
+
+	if (res != Success)
+	{
+		printf("Could not write %s\n", _job.path.c_str());
+		remove(temporaryPath.c_str());
+	}
+
+	return res;
+}
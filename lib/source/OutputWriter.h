@@ -0,0 +1,68 @@
+#pragma once
+#include "ResultType.h"
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+namespace IBLLib
+{
+	// Writes output files on background threads so the caller can continue once the data is handed off.
+	// Every file is written to a temporary path next to its destination and renamed into place, readers never see partial files.
+	class OutputWriter
+	{
+	public:
+		// serializes the output to the path passed in, the function owns everything it needs (e.g. through captured shared pointers)
+		using WriteFunction = std::function<Result(const char* _path)>;
+
+		// at most _queueCapacity outputs wait for a writer thread, enqueue blocks beyond that to bound the memory held by pending outputs
+		explicit OutputWriter(uint32_t _threadCount = 2u, uint32_t _queueCapacity = 4u);
+		// flushes pending outputs
+		~OutputWriter();
+
+		OutputWriter(const OutputWriter&) = delete;
+		OutputWriter& operator=(const OutputWriter&) = delete;
+
+		void enqueue(const char* _path, WriteFunction _write);
+
+		// blocks until every enqueued output is written, returns the first failure since the last flush and prints the write throughput
+		Result flush();
+
+		// writer used by sample() for asynchronous outputs, lives until the end of the process
+		static OutputWriter& getShared();
+
+	private:
+		struct Job
+		{
+			std::string path;
+			WriteFunction write;
+		};
+
+		void workerLoop();
+		Result write(const Job& _job, uint64_t& _outByteSize);
+
+		std::vector<std::thread> m_workers;
+
+		std::mutex m_mutex;
+		std::condition_variable m_jobAvailable;
+		std::condition_variable m_queueNotFull;
+		std::condition_variable m_idle;
+
+		std::deque<Job> m_queue;
+		uint32_t m_queueCapacity = 0u;
+		uint32_t m_activeJobs = 0u;
+		bool m_stop = false;
+
+		// since the last flush
+		Result m_firstError = Success;
+		uint32_t m_fileCount = 0u;
+		uint64_t m_byteCount = 0u;
+		std::chrono::steady_clock::time_point m_firstStart;
+		std::chrono::steady_clock::time_point m_lastEnd;
+	};
+} // !IBLLib
@@ -1,4 +1,7 @@
 #include "STBImage.h"
+#include "FileHelper.h"
+
+#include <limits.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -32,7 +35,15 @@ IBLLib::Result IBLLib::STBImage::loadHdr(const char* _path)
 		return InvalidArgument;
 	}
 
-	int isHdrFile = stbi_is_hdr(_path); // 0 == false, 1 == true
+	// decode from the mapped file instead of reading it through stdio, stb takes the size as int
+	MappedFile file;
+	if (file.open(_path, MappedFile::Access::Sequential) == false || file.getSize() > static_cast<size_t>(INT_MAX))
+	{
+		return FileNotFound;
+	}
+
+	const int byteSize = static_cast<int>(file.getSize());
+	int isHdrFile = stbi_is_hdr_from_memory(file.getData(), byteSize); // 0 == false, 1 == true
 
 	if (isHdrFile == 0)
 	{
@@ -41,7 +52,7 @@ IBLLib::Result IBLLib::STBImage::loadHdr(const char* _path)
 	}
 
 	// stbi_loadf
-	m_hdrData = stbi_loadf(_path, &m_width, &m_height, &m_channels, STBI_rgb_alpha);
+	m_hdrData = stbi_loadf_from_memory(file.getData(), byteSize, &m_width, &m_height, &m_channels, STBI_rgb_alpha);
 
 	if (m_hdrData == nullptr)
 	{
@@ -1,8 +1,22 @@
 #include "ShaderCompiler.h"
+#include "FileHelper.h"
+#include "Hash.h"
 
 #include <glslang/Public/ShaderLang.h>
 #include <SPIRV/GlslangToSpv.h>
 
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <chrono>
+
+namespace
+{
+	// bump whenever the compile settings below change
+	constexpr uint64_t CacheVersion = 1u;
+	constexpr uint32_t SpirvMagic = 0x07230203u;
+} // !anonymous
+
 static const TBuiltInResource DefaultTBuiltInResource = {
 	/* .MaxLights = */ 32,
 	/* .MaxClipPlanes = */ 6,
@@ -110,6 +124,121 @@ static const TBuiltInResource DefaultTBuiltInResource = {
  };
 
 bool IBLLib::ShaderCompiler::compile(const std::string& _glslBlob, const char* _entryPoint, Stage _stage, std::vector<uint32_t>& _outSpvBlob)
+{
+	const auto start = std::chrono::steady_clock::now();
+	const uint64_t key = getCacheKey(_glslBlob, _entryPoint, _stage);
+
+	std::string cachePath;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_requests;
+
+		auto it = m_cache.find(key);
+		if (it != m_cache.end())
+		{
+			_outSpvBlob = it->second;
+			++m_memoryHits;
+			m_compileMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			return true;
+		}
+
+		cachePath = getCachePath(key);
+	}
+
+	bool diskHit = false;
+	if (cachePath.empty() == false)
+	{
+		MappedFile file;
+		FILE* probe = fopen(cachePath.c_str(), "rb");
+		if (probe != nullptr)
+		{
+			fclose(probe);
+
+			// entries are written atomically, a wrong size or magic means the file was not written by this cache
+			if (file.open(cachePath.c_str(), MappedFile::Access::Random) && file.getSize() % sizeof(uint32_t) == 0u &&
+				file.getSize() >= sizeof(uint32_t) && memcmp(file.getData(), &SpirvMagic, sizeof(SpirvMagic)) == 0)
+			{
+				_outSpvBlob.resize(file.getSize() / sizeof(uint32_t));
+				memcpy(_outSpvBlob.data(), file.getData(), file.getSize());
+				diskHit = true;
+			}
+		}
+	}
+
+	if (diskHit == false)
+	{
+		if (compileGlsl(_glslBlob, _entryPoint, _stage, _outSpvBlob) == false)
+		{
+			return false;
+		}
+
+		if (cachePath.empty() == false)
+		{
+			const std::string temporaryPath = cachePath + ".tmp";
+			if (writeFile(temporaryPath.c_str(), _outSpvBlob) == false || replaceFile(temporaryPath.c_str(), cachePath.c_str()) == false)
+			{
+				remove(temporaryPath.c_str());
+				printf("Failed to write shader cache entry %s\n", cachePath.c_str());
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cache[key] = _outSpvBlob;
+	m_diskHits += diskHit ? 1u : 0u;
+	m_compileMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	return true;
+}
+
+void IBLLib::ShaderCompiler::setCacheDirectory(const char* _directory)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_cacheDirectory.clear();
+	if (_directory != nullptr && createDirectory(_directory))
+	{
+		m_cacheDirectory = _directory;
+		if (m_cacheDirectory.empty() == false && m_cacheDirectory.back() != '/' && m_cacheDirectory.back() != '\\')
+		{
+			m_cacheDirectory += '/';
+		}
+	}
+}
+
+void IBLLib::ShaderCompiler::printStatistics() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	printf("Shaders: %u requests, %u memory cache hits, %u disk cache hits, %u glslang compiles, %.2f ms\n",
+				 m_requests, m_memoryHits, m_diskHits, m_requests - m_memoryHits - m_diskHits, m_compileMilliseconds);
+}
+
+uint64_t IBLLib::ShaderCompiler::getCacheKey(const std::string& _glslBlob, const char* _entryPoint, Stage _stage) const
+{
+	const char* glslangVersion = glslang::GetGlslVersionString();
+
+	uint64_t key = hash64(_glslBlob.data(), _glslBlob.size(), CacheVersion);
+	key = hash64(_entryPoint, strlen(_entryPoint), key);
+	key = hashCombine(key, static_cast<uint64_t>(_stage));
+	key = hash64(glslangVersion, strlen(glslangVersion), key);
+	key = hashCombine(key, static_cast<uint64_t>(glslang::GetSpirvGeneratorVersion()));
+
+	return key;
+}
+
+std::string IBLLib::ShaderCompiler::getCachePath(uint64_t _key) const
+{
+	if (m_cacheDirectory.empty())
+	{
+		return std::string();
+	}
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016" PRIx64 ".spv", _key);
+	return m_cacheDirectory + name;
+}
+
+bool IBLLib::ShaderCompiler::compileGlsl(const std::string& _glslBlob, const char* _entryPoint, Stage _stage, std::vector<uint32_t>& _outSpvBlob)
 {
 	_outSpvBlob.clear();
 
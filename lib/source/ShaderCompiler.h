@@ -2,6 +2,8 @@
 #include <vector>
 #include <stdint.h>
 #include <string>
+#include <mutex>
+#include <unordered_map>
 
 namespace IBLLib
 {
@@ -19,11 +21,31 @@ namespace IBLLib
 
 		static ShaderCompiler& instance() { static ShaderCompiler inst; return inst; }
 
+		// SPIR-V of earlier compiles is reused from memory and from the cache directory, glslang only runs on a miss
 		bool compile(const std::string& _glslBlob, const char* _entryPoint, Stage _stage, std::vector<uint32_t>& _outSpvBlob);
 
+		// directory of the SPIR-V disk cache, entries are keyed by source, entry point, stage and glslang version. nullptr disables it
+		void setCacheDirectory(const char* _directory);
+
+		// prints cache hits and the time spent in compile
+		void printStatistics() const;
+
 	private:
+		bool compileGlsl(const std::string& _glslBlob, const char* _entryPoint, Stage _stage, std::vector<uint32_t>& _outSpvBlob);
+
+		uint64_t getCacheKey(const std::string& _glslBlob, const char* _entryPoint, Stage _stage) const;
+		std::string getCachePath(uint64_t _key) const;
 
 		ShaderCompiler();
 		~ShaderCompiler();
+
+		mutable std::mutex m_mutex;
+		std::unordered_map<uint64_t, std::vector<uint32_t>> m_cache;
+		std::string m_cacheDirectory;
+
+		uint32_t m_requests = 0u;
+		uint32_t m_memoryHits = 0u;
+		uint32_t m_diskHits = 0u;
+		double m_compileMilliseconds = 0.0;
 	};
 }
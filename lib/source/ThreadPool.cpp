@@ -0,0 +1,101 @@
+#include "ThreadPool.h"
+
+IBLLib::ThreadPool::ThreadPool(uint32_t _threadCount) :
+	m_next(0u)
+{
+	if (_threadCount == 0u)
+	{
+		_threadCount = std::thread::hardware_concurrency();
+	}
+
+	for (uint32_t i = 1u; i < _threadCount; ++i)
+	{
+		m_workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+IBLLib::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_jobAvailable.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+void IBLLib::ThreadPool::parallelFor(uint32_t _count, const std::function<void(uint32_t)>& _func)
+{
+	if (_count == 0u)
+	{
+		return;
+	}
+
+	if (m_workers.empty() || _count == 1u)
+	{
+		for (uint32_t i = 0u; i < _count; ++i)
+		{
+			_func(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_func = &_func;
+		m_count = _count;
+		m_next = 0u;
+		m_activeWorkers = static_cast<uint32_t>(m_workers.size());
+		++m_generation;
+	}
+	m_jobAvailable.notify_all();
+
+	runJob();
+
+	// every worker has to have left runJob before _func goes out of scope
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_jobFinished.wait(lock, [this]() { return m_activeWorkers == 0u; });
+	m_func = nullptr;
+}
+
+void IBLLib::ThreadPool::workerLoop()
+{
+	uint64_t generation = 0u;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [this, generation]() { return m_stop || m_generation != generation; });
+
+			if (m_stop)
+			{
+				return;
+			}
+
+			generation = m_generation;
+		}
+
+		runJob();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_activeWorkers == 0u)
+			{
+				m_jobFinished.notify_one();
+			}
+		}
+	}
+}
+
+void IBLLib::ThreadPool::runJob()
+{
+	for (uint32_t i = m_next++; i < m_count; i = m_next++)
+	{
+		(*m_func)(i);
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+namespace IBLLib
+{
+	// Fixed set of worker threads for data parallel loops, the calling thread participates in the work.
+	class ThreadPool
+	{
+	public:
+		// _threadCount = 0: one thread per hardware thread (including the calling thread)
+		explicit ThreadPool(uint32_t _threadCount = 0u);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// number of threads executing parallelFor, including the calling thread
+		uint32_t getThreadCount() const { return static_cast<uint32_t>(m_workers.size()) + 1u; }
+
+		// calls _func(i) for every i in [0, _count) and blocks until all calls returned. not reentrant
+		void parallelFor(uint32_t _count, const std::function<void(uint32_t)>& _func);
+
+	private:
+		void workerLoop();
+		void runJob();
+
+		std::vector<std::thread> m_workers;
+
+		std::mutex m_mutex;
+		std::condition_variable m_jobAvailable;
+		std::condition_variable m_jobFinished;
+
+		const std::function<void(uint32_t)>* m_func = nullptr;
+		uint32_t m_count = 0u;
+		std::atomic<uint32_t> m_next;
+		uint32_t m_activeWorkers = 0u;
+		uint64_t m_generation = 0u;
+		bool m_stop = false;
+	};
+} // !IBLLib
@@ -1,6 +1,12 @@
 
 #include "format.h"
 #include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
 
 uint32_t IBLLib::getFormatSize(VkFormat _vkFormat)
 {
@@ -65,6 +71,7 @@ uint32_t IBLLib::getFormatSize(VkFormat _vkFormat)
 	case VK_FORMAT_A2B10G10R10_SINT_PACK32:
 
 	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+	case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
 
 	case VK_FORMAT_R8G8B8A8_UNORM:
 	case VK_FORMAT_R8G8B8A8_SNORM:
@@ -254,6 +261,7 @@ uint32_t IBLLib::getChannelCount(VkFormat _vkFormat)
 	case VK_FORMAT_R5G6B5_UNORM_PACK16:
 	case VK_FORMAT_B5G6R5_UNORM_PACK16:
 	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+	case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
 
 	case VK_FORMAT_R8G8B8_UNORM:
 	case VK_FORMAT_R8G8B8_SNORM:
@@ -364,3 +372,104 @@ uint32_t IBLLib::getChannelCount(VkFormat _vkFormat)
 		return 0u; // invalid
 	}
 }
+
+uint16_t IBLLib::floatToHalf(float _value)
+{
+	// bit twiddling conversion with round to nearest even, handles denormals
+	constexpr uint32_t denormMagicBits = ((127u - 15u) + (23u - 10u) + 1u) << 23u;
+	float denormMagic = 0.f;
+	memcpy(&denormMagic, &denormMagicBits, sizeof(float));
+
+	uint32_t bits = 0u;
+	memcpy(&bits, &_value, sizeof(float));
+
+	const uint32_t sign = bits & 0x80000000u;
+	bits ^= sign;
+
+	uint32_t half = 0u;
+
+	if (bits > 0x7f800000u)
+	{
+		half = 0x7e00u; // NaN
+	}
+	else if (bits >= 0x477fe000u)
+	{
+		// clamped after the NaN test, like the min/max of the F16C path which keeps NaN
+		half = 0x7bffu; // 65504
+	}
+	else if (bits < (113u << 23u))
+	{
+		// result is a half denormal or zero, let the float addition do the rounding
+		float value = 0.f;
+		memcpy(&value, &bits, sizeof(float));
+		value += denormMagic;
+		memcpy(&half, &value, sizeof(float));
+		half -= denormMagicBits;
+	}
+	else
+	{
+		const uint32_t mantissaOdd = (bits >> 13u) & 1u;
+		bits += ((15u - 127u) << 23u) + 0xfffu; // rebias exponent and round
+		bits += mantissaOdd;
+		half = bits >> 13u;
+	}
+
+	return static_cast<uint16_t>(half | (sign >> 16u));
+}
+
+void IBLLib::convertFloatToHalf(const float* _src, uint16_t* _dst, size_t _count)
+{
+	size_t i = 0u;
+
+#if defined(__F16C__)
+	const __m128 halfMax = _mm_set1_ps(65504.f);
+	const __m128 halfMin = _mm_set1_ps(-65504.f);
+
+	for (; i + 4u <= _count; i += 4u)
+	{
+		const __m128 values = _mm_max_ps(halfMin, _mm_min_ps(halfMax, _mm_loadu_ps(_src + i)));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(_dst + i), _mm_cvtps_ph(values, _MM_FROUND_TO_NEAREST_INT));
+	}
+#endif
+
+	for (; i < _count; ++i)
+	{
+		_dst[i] = floatToHalf(_src[i]);
+	}
+}
+
+float IBLLib::halfToFloat(uint16_t _value)
+{
+	const uint32_t sign = static_cast<uint32_t>(_value & 0x8000u) << 16u;
+	const uint32_t exponent = (_value >> 10u) & 0x1fu;
+	uint32_t mantissa = _value & 0x3ffu;
+
+	uint32_t bits = 0u;
+	if (exponent == 0x1fu)
+	{
+		bits = sign | 0x7f800000u | (mantissa << 13u); // infinity or NaN
+	}
+	else if (exponent != 0u)
+	{
+		bits = sign | ((exponent + 127u - 15u) << 23u) | (mantissa << 13u);
+	}
+	else if (mantissa != 0u)
+	{
+		// denormal, normalize the mantissa
+		uint32_t shift = 0u;
+		while ((mantissa & 0x400u) == 0u)
+		{
+			mantissa <<= 1u;
+			++shift;
+		}
+		bits = sign | ((127u - 15u + 1u - shift) << 23u) | ((mantissa & 0x3ffu) << 13u);
+	}
+	else
+	{
+		bits = sign;
+	}
+
+	float value = 0.f;
+	memcpy(&value, &bits, sizeof(float));
+	return value;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 
 #include <vulkan/vulkan.h>
 
@@ -10,4 +11,13 @@ namespace IBLLib
 uint32_t getFormatSize(VkFormat _vkFormat);
 
 uint32_t getChannelCount(VkFormat _vkFormat);
+
+// round to nearest even, values outside of the half range are clamped to +-65504 instead of becoming infinite
+uint16_t floatToHalf(float _value);
+
+// uses F16C when the compiler targets it
+void convertFloatToHalf(const float* _src, uint16_t* _dst, size_t _count);
+
+// exact, handles denormals, infinities and NaN
+float halfToFloat(uint16_t _value);
 }// IBLLib
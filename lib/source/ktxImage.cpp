@@ -1,6 +1,8 @@
 #include "ktxImage.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -10,11 +12,34 @@
 
 using namespace IBLLib;
 
+namespace
+{
+	// KTX2 header (identifier, 9 uint32 fields) and index (4 uint32 and 2 uint64 fields) precede the level index
+	constexpr size_t Ktx2LevelIndexOffset = 80u;
+	constexpr size_t Ktx2LevelIndexEntrySize = 3u * sizeof(uint64_t);
+	constexpr size_t Ktx2KeyValueIndexOffset = 56u;
+
+	uint32_t loadUint32(const uint8_t* _data)
+	{
+		return static_cast<uint32_t>(_data[0]) | (static_cast<uint32_t>(_data[1]) << 8u) | (static_cast<uint32_t>(_data[2]) << 16u) | (static_cast<uint32_t>(_data[3]) << 24u);
+	}
+
+	uint64_t loadUint64(const uint8_t* _data)
+	{
+		uint64_t value = 0u;
+		for (uint32_t i = 0u; i < 8u; ++i)
+		{
+			value |= static_cast<uint64_t>(_data[i]) << (8u * i);
+		}
+		return value;
+	}
+} // !anonymous
+
 KtxImage::KtxImage()
 {
 }
 
-KtxImage::KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32_t _levels, bool _isCubeMap)
+KtxImage::KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32_t _levels, bool _isCubeMap, bool _allocateStorage)
 {
 		// fill the create info for ktx2 (we don't support ktx 1)
 	ktxTextureCreateInfo createInfo;
@@ -31,7 +56,7 @@ KtxImage::KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32
 
 	KTX_error_code result;
 	result = ktxTexture2_Create(&createInfo,
-															KTX_TEXTURE_CREATE_ALLOC_STORAGE,
+															_allocateStorage ? KTX_TEXTURE_CREATE_ALLOC_STORAGE : KTX_TEXTURE_CREATE_NO_STORAGE,
 															&m_ktxTexture);
 	if(result != KTX_SUCCESS)
 	{
@@ -47,24 +72,67 @@ KtxImage::~KtxImage()
 
 Result KtxImage::loadKtx2(const char* _pFilePath)
 {
-	assert(((void)"m_ktxTexture must be uninitialized.", m_ktxTexture != nullptr));
+	assert(((void)"m_ktxTexture must be uninitialized.", m_ktxTexture == nullptr));
+
+	if (m_file.open(_pFilePath, MappedFile::Access::Sequential) == false)
+	{
+		return Result::FileNotFound;
+	}
 
+	// only parse the header, the image data is read from the mapping
 	KTX_error_code result;
-	result = ktxTexture2_CreateFromNamedFile(_pFilePath,
-																					KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
-																					&m_ktxTexture);
+	result = ktxTexture2_CreateFromMemory(m_file.getData(), m_file.getSize(),
+																				KTX_TEXTURE_CREATE_NO_FLAGS,
+																				&m_ktxTexture);
 
 	if(result != KTX_SUCCESS)
 	{
 		printf("Could not load ktx file at %s \n", _pFilePath);
+		m_ktxTexture = nullptr;
+		m_file.close();
+		return Result::KtxError;
 	}
 
 	return Result::Success;
 }
 
+const uint8_t* KtxImage::getMappedImageData(uint32_t _level, uint32_t _side) const
+{
+	assert(((void)"Ktx texture must be loaded", m_ktxTexture != nullptr && m_file.isOpen()));
+
+	if (m_ktxTexture->supercompressionScheme != KTX_SS_NONE || _level >= m_ktxTexture->numLevels || _side >= m_ktxTexture->numFaces)
+	{
+		return nullptr;
+	}
+
+	const size_t entryOffset = Ktx2LevelIndexOffset + _level * Ktx2LevelIndexEntrySize;
+	if (entryOffset + Ktx2LevelIndexEntrySize > m_file.getSize())
+	{
+		return nullptr;
+	}
+
+	// faces of a level are stored consecutively
+	const uint64_t levelOffset = loadUint64(m_file.getData() + entryOffset);
+	const uint64_t levelSize = loadUint64(m_file.getData() + entryOffset + sizeof(uint64_t));
+	const size_t imageSize = getImageSize(_level);
+
+	if (levelSize < static_cast<uint64_t>(imageSize) * m_ktxTexture->numFaces || levelOffset > m_file.getSize() || levelSize > m_file.getSize() - levelOffset)
+	{
+		printf("Invalid ktx level index for level %u\n", _level);
+		return nullptr;
+	}
+
+	return m_file.getData() + levelOffset + _side * imageSize;
+}
+
 Result KtxImage::writeFace(const std::vector<uint8_t>& _inData, uint32_t _side, uint32_t _level)
 {
-	KTX_error_code result = ktxTexture_SetImageFromMemory(ktxTexture(m_ktxTexture), _level, 0u, _side, _inData.data(), _inData.size());
+	return writeFace(_inData.data(), _inData.size(), _side, _level);
+}
+
+Result KtxImage::writeFace(const uint8_t* _pData, size_t _byteSize, uint32_t _side, uint32_t _level)
+{
+	KTX_error_code result = ktxTexture_SetImageFromMemory(ktxTexture(m_ktxTexture), _level, 0u, _side, _pData, _byteSize);
 
 	if(result != KTX_SUCCESS)
 	{
@@ -89,32 +157,170 @@ Result KtxImage::save(const char* _pathOut)
 	return Success;
 }
 
+Result KtxImage::setMetadata(const char* _key, const char* _value)
+{
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
+
+	// string values include the terminating zero
+	ktxHashList_DeleteKVPair(&m_ktxTexture->kvDataHead, _key);
+	KTX_error_code result = ktxHashList_AddKVPair(&m_ktxTexture->kvDataHead, _key, static_cast<unsigned int>(strlen(_value) + 1u), _value);
+
+	if (result != KTX_SUCCESS)
+	{
+		printf("Could not add ktx metadata %s\n", _key);
+		return Result::KtxError;
+	}
+
+	return Success;
+}
+
+bool KtxImage::readMetadata(const char* _path, const char* _key, std::string& _outValue)
+{
+	static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	// a missing output is the common case, don't report it
+	FILE* probe = fopen(_path, "rb");
+	if (probe == nullptr)
+	{
+		return false;
+	}
+	fclose(probe);
+
+	// only the header and the key/value data are touched
+	MappedFile file;
+	if (file.open(_path, MappedFile::Access::Random) == false || file.getSize() < Ktx2LevelIndexOffset || memcmp(file.getData(), identifier, sizeof(identifier)) != 0)
+	{
+		return false;
+	}
+
+	const uint64_t kvdOffset = loadUint32(file.getData() + Ktx2KeyValueIndexOffset);
+	const uint64_t kvdByteSize = loadUint32(file.getData() + Ktx2KeyValueIndexOffset + sizeof(uint32_t));
+	if (kvdOffset > file.getSize() || kvdByteSize > file.getSize() - kvdOffset)
+	{
+		return false;
+	}
+
+	// entries are a uint32 length followed by the zero terminated key and the value, padded to 4 bytes
+	const uint8_t* kvd = file.getData() + kvdOffset;
+	const size_t keyLength = strlen(_key);
+	size_t pos = 0u;
+
+	while (pos + sizeof(uint32_t) <= kvdByteSize)
+	{
+		const size_t entrySize = loadUint32(kvd + pos);
+		pos += sizeof(uint32_t);
+
+		if (entrySize > kvdByteSize - pos)
+		{
+			return false;
+		}
+
+		const char* entry = reinterpret_cast<const char*>(kvd + pos);
+		if (entrySize > keyLength && memcmp(entry, _key, keyLength + 1u) == 0)
+		{
+			const char* value = entry + keyLength + 1u;
+			size_t valueLength = entrySize - keyLength - 1u;
+			while (valueLength > 0u && value[valueLength - 1u] == '\0')
+			{
+				--valueLength;
+			}
+
+			_outValue.assign(value, valueLength);
+			return true;
+		}
+
+		pos += (entrySize + 3u) & ~static_cast<size_t>(3u);
+	}
+
+	return false;
+}
+
+Result KtxImage::getHeaderData(std::vector<uint8_t>& _outDfd, std::vector<uint8_t>& _outKvd)
+{
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
+
+	// the first word of the descriptor is its total size
+	const uint8_t* dfd = reinterpret_cast<const uint8_t*>(m_ktxTexture->pDfd);
+	_outDfd.assign(dfd, dfd + m_ktxTexture->pDfd[0]);
+
+	// libktx adds the writer entry when it saves a texture itself
+	if (setMetadata("KTXwriter", "glTF-IBL-Sampler") != Success || ktxHashList_Sort(&m_ktxTexture->kvDataHead) != KTX_SUCCESS)
+	{
+		return Result::KtxError;
+	}
+
+	unsigned int kvdByteSize = 0u;
+	unsigned char* kvd = nullptr;
+	if (ktxHashList_Serialize(&m_ktxTexture->kvDataHead, &kvdByteSize, &kvd) != KTX_SUCCESS)
+	{
+		printf("Could not serialize ktx metadata\n");
+		return Result::KtxError;
+	}
+
+	_outKvd.assign(kvd, kvd + kvdByteSize);
+	free(kvd);
+
+	return Success;
+}
+
+size_t KtxImage::getImageOffset(uint32_t _level, uint32_t _side) const
+{
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
+
+	ktx_size_t offset = 0u;
+	if (ktxTexture_GetImageOffset(ktxTexture(m_ktxTexture), _level, 0u, _side, &offset) != KTX_SUCCESS)
+	{
+		printf("Invalid ktx image level %u face %u\n", _level, _side);
+		return 0u;
+	}
+
+	return offset;
+}
+
+size_t KtxImage::getImageSize(uint32_t _level) const
+{
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
+	return ktxTexture_GetImageSize(ktxTexture(m_ktxTexture), _level);
+}
+
+uint8_t* KtxImage::getData()
+{
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
+	return ktxTexture_GetData(ktxTexture(m_ktxTexture));
+}
+
+size_t KtxImage::getDataSize() const
+{
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
+	return ktxTexture_GetDataSize(ktxTexture(m_ktxTexture));
+}
+
 uint32_t KtxImage::getWidth() const
 {
-	assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
 	return m_ktxTexture->baseWidth;
 }
 
 uint32_t KtxImage::getHeight() const
 {
-	assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
 	return m_ktxTexture->baseHeight;
 }
 
 uint32_t KtxImage::getLevels() const
 {
-	assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
 	return m_ktxTexture->numLevels;
 }
 
 bool KtxImage::isCubeMap() const
 {
-	assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
 	return m_ktxTexture->numFaces == 6u;
 }
 
 VkFormat KtxImage::getFormat() const
 {
-	assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
 	return static_cast<VkFormat>(m_ktxTexture->vkFormat);
 }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include <vulkan/vulkan.h>
 #include "ResultType.h"
+#include "FileHelper.h"
 
 struct ktxTexture2;
 
@@ -13,15 +15,39 @@ namespace IBLLib
 	public:
 		// use this constructor if you want to load a ktx file
 		KtxImage();
-		// use this constructor if you want to create a ktx file
-		KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32_t _levels, bool _isCubeMap);
+		// use this constructor if you want to create a ktx file.
+		// without storage the image only describes the layout and metadata, e.g. for KtxStreamWriter
+		KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32_t _levels, bool _isCubeMap, bool _allocateStorage = true);
 		~KtxImage();
 
+		// the file stays memory mapped, image data is not copied to the heap but read with getMappedImageData
 		Result loadKtx2(const char* _pFilePath);
 
+		// image (level, face) of a texture loaded with loadKtx2 inside the file mapping, nullptr for supercompressed textures
+		const uint8_t* getMappedImageData(uint32_t _level, uint32_t _side) const;
+
 		Result writeFace(const std::vector<uint8_t>& _inData, uint32_t _side, uint32_t _level);
+		Result writeFace(const uint8_t* _pData, size_t _byteSize, uint32_t _side, uint32_t _level);
 		Result save(const char* _pathOut);
 
+		// adds a key/value entry with a string value, written by save
+		Result setMetadata(const char* _key, const char* _value);
+
+		// reads the string value of _key from the key/value data of the KTX2 file at _path without loading the texture,
+		// fails if the file is missing, no KTX2 file or has no such entry
+		static bool readMetadata(const char* _path, const char* _key, std::string& _outValue);
+
+		// data format descriptor and key/value data (sorted, with a writer entry) as they are stored in a KTX2 file
+		Result getHeaderData(std::vector<uint8_t>& _outDfd, std::vector<uint8_t>& _outKvd);
+
+		// byte offset of (level, face) inside the texture storage, levels are stored with KTX2 alignment
+		size_t getImageOffset(uint32_t _level, uint32_t _side) const;
+		size_t getImageSize(uint32_t _level) const;
+
+		// texture storage, can be filled directly instead of using writeFace
+		uint8_t* getData();
+		size_t getDataSize() const;
+
 		uint32_t getWidth() const;
 		uint32_t getHeight() const;
 		uint32_t getLevels() const;
@@ -30,6 +56,7 @@ namespace IBLLib
 
 	private:
 		ktxTexture2* m_ktxTexture = nullptr;
+		MappedFile m_file;
 	};
 
 } // !IBLLIb
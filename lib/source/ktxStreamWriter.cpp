@@ -0,0 +1,205 @@
+#include "ktxStreamWriter.h"
+#include "ktxImage.h"
+#include "FileHelper.h"
+#include "format.h"
+
+#include <algorithm>
+
+namespace
+{
+	constexpr uint8_t Ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	constexpr size_t Ktx2HeaderSize = 80u;
+	constexpr size_t Ktx2LevelIndexEntrySize = 24u;
+
+	void storeUint32(std::vector<uint8_t>& _out, uint32_t _value)
+	{
+		for (uint32_t i = 0u; i < 4u; ++i)
+		{
+			_out.push_back(static_cast<uint8_t>(_value >> (8u * i)));
+		}
+	}
+
+	void storeUint64(std::vector<uint8_t>& _out, uint64_t _value)
+	{
+		for (uint32_t i = 0u; i < 8u; ++i)
+		{
+			_out.push_back(static_cast<uint8_t>(_value >> (8u * i)));
+		}
+	}
+
+	uint64_t alignUp(uint64_t _value, uint64_t _alignment)
+	{
+		return (_value + _alignment - 1u) / _alignment * _alignment;
+	}
+
+	// levels are aligned to the least common multiple of the texel size and 4
+	uint64_t getLevelAlignment(uint32_t _texelSize)
+	{
+		uint64_t alignment = _texelSize;
+		while (alignment % 4u != 0u)
+		{
+			alignment += _texelSize;
+		}
+		return alignment;
+	}
+} // !anonymous
+
+IBLLib::KtxStreamWriter::~KtxStreamWriter()
+{
+	if (m_file != nullptr)
+	{
+		fclose(m_file);
+		remove(m_temporaryPath.c_str());
+	}
+}
+
+IBLLib::Result IBLLib::KtxStreamWriter::open(KtxImage& _layout, const char* _path)
+{
+	if (m_file != nullptr)
+	{
+		return InvalidArgument;
+	}
+
+	const VkFormat format = _layout.getFormat();
+	const uint32_t texelSize = getFormatSize(format);
+	const uint32_t channelCount = getChannelCount(format);
+	const uint32_t faceCount = _layout.isCubeMap() ? 6u : 1u;
+	const uint32_t levelCount = _layout.getLevels();
+
+	if (texelSize == 0u || channelCount == 0u || levelCount == 0u)
+	{
+		return InvalidArgument;
+	}
+
+	std::vector<uint8_t> dfd;
+	std::vector<uint8_t> kvd;
+	Result res = _layout.getHeaderData(dfd, kvd);
+	if (res != Success)
+	{
+		return res;
+	}
+
+	const uint64_t dfdOffset = Ktx2HeaderSize + Ktx2LevelIndexEntrySize * levelCount;
+	const uint64_t kvdOffset = dfdOffset + dfd.size();
+
+	// level data follows the key/value data, the smallest level comes first
+	m_levels.resize(levelCount);
+	uint64_t offset = alignUp(kvdOffset + kvd.size(), getLevelAlignment(texelSize));
+	for (uint32_t level = levelCount; level-- > 0u;)
+	{
+		m_levels[level].offset = offset;
+		m_levels[level].byteSize = static_cast<uint64_t>(_layout.getImageSize(level)) * faceCount;
+		offset = alignUp(offset + m_levels[level].byteSize, getLevelAlignment(texelSize));
+	}
+
+	std::vector<uint8_t> header(Ktx2Identifier, Ktx2Identifier + sizeof(Ktx2Identifier));
+	storeUint32(header, format);
+	storeUint32(header, texelSize / channelCount); // typeSize
+	storeUint32(header, _layout.getWidth());
+	storeUint32(header, _layout.getHeight());
+	storeUint32(header, 0u); // pixelDepth
+	storeUint32(header, 0u); // layerCount
+	storeUint32(header, faceCount);
+	storeUint32(header, levelCount);
+	storeUint32(header, 0u); // supercompressionScheme
+	storeUint32(header, static_cast<uint32_t>(dfdOffset));
+	storeUint32(header, static_cast<uint32_t>(dfd.size()));
+	storeUint32(header, kvd.empty() ? 0u : static_cast<uint32_t>(kvdOffset));
+	storeUint32(header, static_cast<uint32_t>(kvd.size()));
+	storeUint64(header, 0u); // sgdByteOffset
+	storeUint64(header, 0u); // sgdByteLength
+
+	for (const Level& level : m_levels)
+	{
+		storeUint64(header, level.offset);
+		storeUint64(header, level.byteSize);
+		storeUint64(header, level.byteSize); // uncompressedByteLength
+	}
+
+	header.insert(header.end(), dfd.begin(), dfd.end());
+	header.insert(header.end(), kvd.begin(), kvd.end());
+
+	m_path = _path;
+	m_temporaryPath = m_path + ".tmp";
+	m_file = fopen(m_temporaryPath.c_str(), "wb");
+	if (m_file == nullptr)
+	{
+		printf("Could not open %s for writing\n", m_temporaryPath.c_str());
+		return FileNotFound;
+	}
+
+	m_nextLevel = levelCount - 1u;
+	m_writePos = 0u;
+
+	if (fwrite(header.data(), 1u, header.size(), m_file) != header.size())
+	{
+		printf("Could not write ktx header\n");
+		return FileNotFound;
+	}
+	m_writePos = header.size();
+
+	return Success;
+}
+
+IBLLib::Result IBLLib::KtxStreamWriter::writeLevel(uint32_t _level, const uint8_t* _data, size_t _byteSize)
+{
+	if (m_file == nullptr || m_levels.empty() || _level != m_nextLevel || _byteSize != m_levels[_level].byteSize)
+	{
+		return InvalidArgument;
+	}
+
+	if (writePadding(m_levels[_level].offset) == false || fwrite(_data, 1u, _byteSize, m_file) != _byteSize)
+	{
+		printf("Could not write ktx level %u\n", _level);
+		return FileNotFound;
+	}
+	m_writePos += _byteSize;
+
+	// level 0 is the last one, m_nextLevel wraps around to mark completion
+	--m_nextLevel;
+
+	return Success;
+}
+
+IBLLib::Result IBLLib::KtxStreamWriter::close()
+{
+	if (m_file == nullptr)
+	{
+		return InvalidArgument;
+	}
+
+	if (m_nextLevel != UINT32_MAX)
+	{
+		printf("Ktx stream closed before level %u was written\n", m_nextLevel);
+		return InvalidArgument;
+	}
+
+	const bool written = fclose(m_file) == 0;
+	m_file = nullptr;
+
+	if (written == false || replaceFile(m_temporaryPath.c_str(), m_path.c_str()) == false)
+	{
+		remove(m_temporaryPath.c_str());
+		printf("Could not write ktx file %s\n", m_path.c_str());
+		return FileNotFound;
+	}
+
+	return Success;
+}
+
+bool IBLLib::KtxStreamWriter::writePadding(uint64_t _offset)
+{
+	static const uint8_t zeros[16] = {};
+
+	while (m_writePos < _offset)
+	{
+		const size_t byteCount = static_cast<size_t>(std::min<uint64_t>(_offset - m_writePos, sizeof(zeros)));
+		if (fwrite(zeros, 1u, byteCount, m_file) != byteCount)
+		{
+			return false;
+		}
+		m_writePos += byteCount;
+	}
+
+	return m_writePos == _offset;
+}
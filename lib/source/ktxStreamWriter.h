@@ -0,0 +1,59 @@
+#pragma once
+#include "ResultType.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace IBLLib
+{
+	class KtxImage;
+
+	// Writes an uncompressed KTX2 file one mip level at a time, the texture data never has to be in memory at once.
+	// The level index is computed up front from the layout, levels are written in file order (smallest first).
+	// The file is written next to its destination and renamed into place by close.
+	class KtxStreamWriter
+	{
+	public:
+		KtxStreamWriter() = default;
+		// removes an unfinished file
+		~KtxStreamWriter();
+
+		KtxStreamWriter(const KtxStreamWriter&) = delete;
+		KtxStreamWriter& operator=(const KtxStreamWriter&) = delete;
+
+		// _layout describes format, size, levels, faces and metadata, it does not need storage.
+		// writes header, level index, data format descriptor and key/value data
+		Result open(KtxImage& _layout, const char* _path);
+
+		// level that has to be written next, levels are written from getLevelCount() - 1 down to 0
+		uint32_t getNextLevel() const { return m_nextLevel; }
+		uint32_t getLevelCount() const { return static_cast<uint32_t>(m_levels.size()); }
+
+		// all faces of a level, tightly packed
+		size_t getLevelSize(uint32_t _level) const { return static_cast<size_t>(m_levels[_level].byteSize); }
+
+		Result writeLevel(uint32_t _level, const uint8_t* _data, size_t _byteSize);
+
+		// fails if a level is missing
+		Result close();
+
+	private:
+		struct Level
+		{
+			uint64_t offset = 0u;
+			uint64_t byteSize = 0u;
+		};
+
+		bool writePadding(uint64_t _offset);
+
+		FILE* m_file = nullptr;
+		std::string m_path;
+		std::string m_temporaryPath;
+
+		std::vector<Level> m_levels;
+		uint32_t m_nextLevel = 0u;
+		uint64_t m_writePos = 0u;
+	};
+} // !IBLLib
@@ -1,19 +1,52 @@
 #include "GltfIblSampler.h"
 #include "vkHelper.h"
-#include "ShaderCompiler.h"
 #include "STBImage.h"
 #include "FileHelper.h"
 #include "ktxImage.h"
+#include "ktxStreamWriter.h"
+#include "HdrReader.h"
+#include "ExrReader.h"
+#include "ThreadPool.h"
+#include "Hash.h"
+#include "FileCache.h"
+#include "OutputWriter.h"
 #include <algorithm>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
-//#include <string>
+#include <inttypes.h>
+#include <chrono>
+#include <memory>
+#include <string>
 
 #include "format.h"
 
+#if defined(IBLSAMPLER_RUNTIME_SHADER_COMPILER)
+#include "ShaderCompiler.h"
+#else
+// generated by the build from lib/source/shaders, see compile_shader in CMakeLists.txt
+#include "spirv/primitive.vert.main.h"
+#include "spirv/filter.frag.filterCubeMap.h"
+#include "spirv/filter.frag.panoramaToCubeMap.h"
+#include "spirv/filter.frag.filterCubeMap.multiview.h"
+#include "spirv/filter.frag.panoramaToCubeMap.multiview.h"
+#include "spirv/filter.frag.computeLUT.multiview.h"
+#include "spirv/filter.frag.filterCubeMapLightSampled.h"
+#include "spirv/filter.frag.filterCubeMapLightSampled.multiview.h"
+#include "spirv/filter.frag.lightRowCdf.h"
+#include "spirv/filter.frag.lightMarginalCdf.h"
+#include "spirv/filter.frag.sunRowPeaks.h"
+#include "spirv/filter.frag.sunPeak.h"
+#include "spirv/filter.frag.sunRowSums.h"
+#include "spirv/filter.frag.sunLight.h"
+#include "spirv/filter.frag.removeSun.h"
+#include "spirv/filter.frag.removeSun.multiview.h"
+#endif
+
 namespace IBLLib
 {
 
+#if defined(IBLSAMPLER_RUNTIME_SHADER_COMPILER)
 constexpr auto filterFragmentShader =
 #include "shaders/filter.frag"
 ;
@@ -21,17 +54,188 @@ constexpr auto filterFragmentShader =
 constexpr auto primitiveVertexShader =
 #include "shaders/primitive.vert"
 ;
+#endif
+
+enum class Shader
+{
+	FullscreenVertex = 0, // primitive.vert main
+	FilterCubeMap, // filter.frag filterCubeMap
+	PanoramaToCubeMap, // filter.frag panoramaToCubeMap
+	// MULTIVIEW variants of filter.frag, rendering one face per view
+	FilterCubeMapMultiview, // filterCubeMap
+	PanoramaToCubeMapMultiview, // panoramaToCubeMap
+	LUTMultiview, // computeLUT
+	// light sampling with the luminance CDF of the input
+	FilterCubeMapLightSampled, // filter.frag filterCubeMapLightSampled
+	FilterCubeMapLightSampledMultiview, // filterCubeMapLightSampled with MULTIVIEW
+	LightRowCdf, // filter.frag lightRowCdf
+	LightMarginalCdf, // filter.frag lightMarginalCdf
+	// sun extraction
+	SunRowPeaks, // filter.frag sunRowPeaks
+	SunPeak, // filter.frag sunPeak
+	SunRowSums, // filter.frag sunRowSums
+	SunLight, // filter.frag sunLight
+	RemoveSun, // filter.frag removeSun
+	RemoveSunMultiview // removeSun with MULTIVIEW
+};
+
+bool isMultiviewShader(Shader _shader)
+{
+	return _shader == Shader::FilterCubeMapMultiview || _shader == Shader::PanoramaToCubeMapMultiview || _shader == Shader::LUTMultiview ||
+		_shader == Shader::FilterCubeMapLightSampledMultiview || _shader == Shader::RemoveSunMultiview;
+}
+
+// view i renders face i of a 6 layer attachment
+constexpr uint32_t CubeFaceViewMask = 0x3Fu;
 
-Result compileShader(vkHelper& _vulkan, const char* _shaderText, const char* _entryPoint, VkShaderModule& _outModule, ShaderCompiler::Stage _stage)
+#if defined(IBLSAMPLER_RUNTIME_SHADER_COMPILER)
+// the define has to follow the #version line
+std::string addDefine(const char* _source, const char* _define)
 {
+	std::string source(_source);
+	const size_t version = source.find("#version");
+	const size_t lineEnd = version != std::string::npos ? source.find('\n', version) : std::string::npos;
+	if (lineEnd != std::string::npos)
+	{
+		source.insert(lineEnd + 1u, std::string("#define ") + _define + "\n");
+	}
+	return source;
+}
+#endif
+
+// creates the module from the embedded SPIR-V, or compiles the embedded GLSL if the library is built with the runtime shader compiler
+Result loadShader(vkHelper& _vulkan, Shader _shader, VkShaderModule& _outModule)
+{
+#if defined(IBLSAMPLER_RUNTIME_SHADER_COMPILER)
+	const char* entryPoint = "main";
+	switch (_shader)
+	{
+	case Shader::FilterCubeMap:
+	case Shader::FilterCubeMapMultiview:
+		entryPoint = "filterCubeMap";
+		break;
+	case Shader::PanoramaToCubeMap:
+	case Shader::PanoramaToCubeMapMultiview:
+		entryPoint = "panoramaToCubeMap";
+		break;
+	case Shader::LUTMultiview:
+		entryPoint = "computeLUT";
+		break;
+	case Shader::FilterCubeMapLightSampled:
+	case Shader::FilterCubeMapLightSampledMultiview:
+		entryPoint = "filterCubeMapLightSampled";
+		break;
+	case Shader::LightRowCdf:
+		entryPoint = "lightRowCdf";
+		break;
+	case Shader::LightMarginalCdf:
+		entryPoint = "lightMarginalCdf";
+		break;
+	case Shader::SunRowPeaks:
+		entryPoint = "sunRowPeaks";
+		break;
+	case Shader::SunPeak:
+		entryPoint = "sunPeak";
+		break;
+	case Shader::SunRowSums:
+		entryPoint = "sunRowSums";
+		break;
+	case Shader::SunLight:
+		entryPoint = "sunLight";
+		break;
+	case Shader::RemoveSun:
+	case Shader::RemoveSunMultiview:
+		entryPoint = "removeSun";
+		break;
+	default:
+		break;
+	}
+
+	const ShaderCompiler::Stage stage = _shader == Shader::FullscreenVertex ? ShaderCompiler::Stage::Vertex : ShaderCompiler::Stage::Fragment;
+	const std::string shaderText = _shader == Shader::FullscreenVertex ? primitiveVertexShader :
+		(isMultiviewShader(_shader) ? addDefine(filterFragmentShader, "MULTIVIEW") : filterFragmentShader);
+
 	std::vector<uint32_t> outSpvBlob;
 
-	if (ShaderCompiler::instance().compile(_shaderText, _entryPoint, _stage, outSpvBlob) == false)
+	if (ShaderCompiler::instance().compile(shaderText, entryPoint, stage, outSpvBlob) == false)
 	{
 		return Result::ShaderCompilationFailed;
 	}
 
-	if (_vulkan.loadShaderModule(_outModule, outSpvBlob.data(), outSpvBlob.size() * 4) != VK_SUCCESS)
+	const uint32_t* spirv = outSpvBlob.data();
+	const size_t spirvByteSize = outSpvBlob.size() * sizeof(uint32_t);
+#else
+	const uint32_t* spirv = primitiveVertexShaderSpv;
+	size_t spirvByteSize = sizeof(primitiveVertexShaderSpv);
+
+	switch (_shader)
+	{
+	case Shader::FilterCubeMap:
+		spirv = filterCubeMapShaderSpv;
+		spirvByteSize = sizeof(filterCubeMapShaderSpv);
+		break;
+	case Shader::PanoramaToCubeMap:
+		spirv = panoramaToCubeMapShaderSpv;
+		spirvByteSize = sizeof(panoramaToCubeMapShaderSpv);
+		break;
+	case Shader::FilterCubeMapMultiview:
+		spirv = filterCubeMapMultiviewShaderSpv;
+		spirvByteSize = sizeof(filterCubeMapMultiviewShaderSpv);
+		break;
+	case Shader::PanoramaToCubeMapMultiview:
+		spirv = panoramaToCubeMapMultiviewShaderSpv;
+		spirvByteSize = sizeof(panoramaToCubeMapMultiviewShaderSpv);
+		break;
+	case Shader::LUTMultiview:
+		spirv = computeLUTMultiviewShaderSpv;
+		spirvByteSize = sizeof(computeLUTMultiviewShaderSpv);
+		break;
+	case Shader::FilterCubeMapLightSampled:
+		spirv = filterCubeMapLightSampledShaderSpv;
+		spirvByteSize = sizeof(filterCubeMapLightSampledShaderSpv);
+		break;
+	case Shader::FilterCubeMapLightSampledMultiview:
+		spirv = filterCubeMapLightSampledMultiviewShaderSpv;
+		spirvByteSize = sizeof(filterCubeMapLightSampledMultiviewShaderSpv);
+		break;
+	case Shader::LightRowCdf:
+		spirv = lightRowCdfShaderSpv;
+		spirvByteSize = sizeof(lightRowCdfShaderSpv);
+		break;
+	case Shader::LightMarginalCdf:
+		spirv = lightMarginalCdfShaderSpv;
+		spirvByteSize = sizeof(lightMarginalCdfShaderSpv);
+		break;
+	case Shader::SunRowPeaks:
+		spirv = sunRowPeaksShaderSpv;
+		spirvByteSize = sizeof(sunRowPeaksShaderSpv);
+		break;
+	case Shader::SunPeak:
+		spirv = sunPeakShaderSpv;
+		spirvByteSize = sizeof(sunPeakShaderSpv);
+		break;
+	case Shader::SunRowSums:
+		spirv = sunRowSumsShaderSpv;
+		spirvByteSize = sizeof(sunRowSumsShaderSpv);
+		break;
+	case Shader::SunLight:
+		spirv = sunLightShaderSpv;
+		spirvByteSize = sizeof(sunLightShaderSpv);
+		break;
+	case Shader::RemoveSun:
+		spirv = removeSunShaderSpv;
+		spirvByteSize = sizeof(removeSunShaderSpv);
+		break;
+	case Shader::RemoveSunMultiview:
+		spirv = removeSunMultiviewShaderSpv;
+		spirvByteSize = sizeof(removeSunMultiviewShaderSpv);
+		break;
+	default:
+		break;
+	}
+#endif
+
+	if (_vulkan.loadShaderModule(_outModule, spirv, spirvByteSize) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
@@ -39,67 +243,492 @@ Result compileShader(vkHelper& _vulkan, const char* _shaderText, const char* _en
 	return Result::Success;
 }
 
-Result uploadImage(vkHelper& _vulkan, const char* _inputPath, VkImage& _outImage)
+// hashes what the shader modules are created from
+uint64_t hashShaders(uint64_t _seed)
+{
+#if defined(IBLSAMPLER_RUNTIME_SHADER_COMPILER)
+	uint64_t hash = hash64(filterFragmentShader, strlen(filterFragmentShader), _seed);
+	return hash64(primitiveVertexShader, strlen(primitiveVertexShader), hash);
+#else
+	uint64_t hash = hash64(primitiveVertexShaderSpv, sizeof(primitiveVertexShaderSpv), _seed);
+	hash = hash64(filterCubeMapShaderSpv, sizeof(filterCubeMapShaderSpv), hash);
+	hash = hash64(panoramaToCubeMapShaderSpv, sizeof(panoramaToCubeMapShaderSpv), hash);
+	// which variants run depends on the device, which is not known yet
+	hash = hash64(filterCubeMapMultiviewShaderSpv, sizeof(filterCubeMapMultiviewShaderSpv), hash);
+	hash = hash64(panoramaToCubeMapMultiviewShaderSpv, sizeof(panoramaToCubeMapMultiviewShaderSpv), hash);
+	hash = hash64(computeLUTMultiviewShaderSpv, sizeof(computeLUTMultiviewShaderSpv), hash);
+	hash = hash64(filterCubeMapLightSampledShaderSpv, sizeof(filterCubeMapLightSampledShaderSpv), hash);
+	hash = hash64(filterCubeMapLightSampledMultiviewShaderSpv, sizeof(filterCubeMapLightSampledMultiviewShaderSpv), hash);
+	hash = hash64(lightRowCdfShaderSpv, sizeof(lightRowCdfShaderSpv), hash);
+	hash = hash64(lightMarginalCdfShaderSpv, sizeof(lightMarginalCdfShaderSpv), hash);
+	hash = hash64(sunRowPeaksShaderSpv, sizeof(sunRowPeaksShaderSpv), hash);
+	hash = hash64(sunPeakShaderSpv, sizeof(sunPeakShaderSpv), hash);
+	hash = hash64(sunRowSumsShaderSpv, sizeof(sunRowSumsShaderSpv), hash);
+	hash = hash64(sunLightShaderSpv, sizeof(sunLightShaderSpv), hash);
+	hash = hash64(removeSunShaderSpv, sizeof(removeSunShaderSpv), hash);
+	return hash64(removeSunMultiviewShaderSpv, sizeof(removeSunMultiviewShaderSpv), hash);
+#endif
+}
+
+// bump whenever the output of sample() changes for the same input and parameters, the shader sources are hashed separately
+constexpr uint64_t LibraryVersion = 1u;
+constexpr const char* JobHashKey = "IBLSamplerJobHash";
+// the light removed by SampleOptions::extractSun, only written if one was found
+constexpr const char* LightKey = "IBLSamplerLight";
+// hash of the pixel data of the LUT written with the cube map, see hashLUTFile
+constexpr const char* LUTHashKey = "IBLSamplerLUTHash";
+
+// hash of everything the outputs of sample() depend on
+uint64_t computeJobHash(uint64_t _inputHash, bool _writeLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _hierarchical, bool _lightSampling, bool _extractSun)
+{
+	uint32_t lodBiasBits = 0u;
+	memcpy(&lodBiasBits, &_lodBias, sizeof(lodBiasBits));
+
+	uint64_t hash = hashCombine(_inputHash, LibraryVersion);
+	hash = hashShaders(hash);
+	hash = hashCombine(hash, _writeLUT ? 1u : 0u);
+	hash = hashCombine(hash, static_cast<uint64_t>(_distribution));
+	hash = hashCombine(hash, _cubemapResolution);
+	hash = hashCombine(hash, _mipmapCount);
+	hash = hashCombine(hash, _sampleCount);
+	hash = hashCombine(hash, static_cast<uint64_t>(_targetFormat));
+	hash = hashCombine(hash, lodBiasBits);
+	hash = hashCombine(hash, _hierarchical ? 1u : 0u);
+	hash = hashCombine(hash, _lightSampling ? 1u : 0u);
+	hash = hashCombine(hash, _extractSun ? 1u : 0u);
+
+	return hash;
+}
+
+// value of LightKey: "direction x y z color r g b solidAngle s"
+std::string formatLight(const ExtractedLight& _light)
+{
+	char value[256];
+	snprintf(value, sizeof(value), "direction %.6f %.6f %.6f color %.6g %.6g %.6g solidAngle %.6g",
+					 _light.direction[0], _light.direction[1], _light.direction[2], _light.color[0], _light.color[1], _light.color[2], _light.solidAngle);
+	return value;
+}
+
+bool parseLight(const std::string& _value, ExtractedLight& _outLight)
+{
+	ExtractedLight light;
+	if (sscanf(_value.c_str(), "direction %f %f %f color %f %f %f solidAngle %f",
+						 &light.direction[0], &light.direction[1], &light.direction[2], &light.color[0], &light.color[1], &light.color[2], &light.solidAngle) != 7)
+	{
+		return false;
+	}
+
+	light.found = true;
+	_outLight = light;
+	return true;
+}
+
+// texel format the panorama is uploaded in, must match cPanorama* in filter.frag
+enum class PanoramaFormat : uint32_t
+{
+	Float32 = 0, // R32G32B32A32_SFLOAT
+	Half, // R16G16B16A16_SFLOAT, converted on the host
+	RGBE // raw radiance bytes in R8G8B8A8_UNORM, decoded in the panoramaToCubeMap shader
+};
+
+VkFormat getPanoramaVkFormat(PanoramaFormat _format)
+{
+	switch (_format)
+	{
+	case PanoramaFormat::Half:
+		return VK_FORMAT_R16G16B16A16_SFLOAT;
+	case PanoramaFormat::RGBE:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+	default:
+		return VK_FORMAT_R32G32B32A32_SFLOAT;
+	}
+}
+
+// rows of the panorama per staging buffer and number of staging buffers in flight, bounds the host memory used by the upload
+constexpr VkDeviceSize UploadStripByteSize = 16u * 1024u * 1024u;
+constexpr uint32_t UploadStagingRingSize = 3u;
+
+enum class PanoramaSource
+{
+	Radiance = 0,
+	OpenEXR,
+	STB
+};
+
+// streams the panorama to the device in strips of scanlines through a ring of staging buffers on the transfer queue (or the graphics queue if the transfer queue only copies whole images).
+// the reader is chosen by the file magic: radiance files are read strip by strip and uploaded as RGBE (4 bytes per texel), OpenEXR files are read strip by strip as half floats (8 bytes per texel)
+// or as 32 bit floats (16 bytes per texel) if they have FLOAT or UINT color channels,
+// other formats are decoded by stb as a whole and uploaded as half floats.
+// the last strip signals _signalSemaphore, the graphics submission of _graphicsCmdBuffer (which receives the ownership acquire) has to wait on it at the fragment shader stage.
+// _outStagingBuffers have to stay alive until _outTicket completed
+Result uploadImage(vkHelper& _vulkan, const VkCommandBuffer _graphicsCmdBuffer, const char* _inputPath, const VkSemaphore _signalSemaphore, VkImage& _outImage, PanoramaFormat& _outFormat, std::vector<VkBuffer>& _outStagingBuffers, SubmissionTicket& _outTicket)
 {
 	_outImage = VK_NULL_HANDLE;
+	_outStagingBuffers.clear();
+
+	// decodes (and decompresses) the scanlines of a strip in parallel
+	ThreadPool threadPool;
+	HdrReader hdrReader(&threadPool);
+	ExrReader exrReader(&threadPool);
 	STBImage panorama;
+	PanoramaSource source = PanoramaSource::STB;
+	uint32_t width = 0u;
+	uint32_t height = 0u;
 
-	if (panorama.loadHdr(_inputPath) != Result::Success)
+	if (hdrReader.open(_inputPath) == Result::Success)
 	{
-		return Result::InputPanoramaFileNotFound;
+		source = PanoramaSource::Radiance;
+		width = hdrReader.getWidth();
+		height = hdrReader.getHeight();
+	}
+	else if (exrReader.open(_inputPath) == Result::Success)
+	{
+		source = PanoramaSource::OpenEXR;
+		width = exrReader.getWidth();
+		height = exrReader.getHeight();
+	}
+	else
+	{
+		if (panorama.loadHdr(_inputPath) != Result::Success)
+		{
+			return Result::InputPanoramaFileNotFound;
+		}
+		width = static_cast<uint32_t>(panorama.getWidth());
+		height = static_cast<uint32_t>(panorama.getHeight());
 	}
 
-	VkCommandBuffer uploadCmds = VK_NULL_HANDLE;
-	if (_vulkan.createCommandBuffer(uploadCmds) != VK_SUCCESS)
+	if (source != PanoramaSource::STB)
 	{
-		return Result::VulkanError;
+		printf("Streaming %s %u x %u\n", _inputPath, width, height);
 	}
 
-	// create staging buffer for image data
-	VkBuffer stagingBuffer = VK_NULL_HANDLE;
-	if (_vulkan.createBufferAndAllocate(stagingBuffer, static_cast<uint32_t>(panorama.getByteSize()), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
+	_outFormat = source == PanoramaSource::Radiance ? PanoramaFormat::RGBE : PanoramaFormat::Half;
+	if (source == PanoramaSource::OpenEXR && exrReader.getFormat() == ExrReader::Format::Float32)
+	{
+		_outFormat = PanoramaFormat::Float32;
+	}
+	const VkFormat format = getPanoramaVkFormat(_outFormat);
+
+	const VkDeviceSize rowByteSize = static_cast<VkDeviceSize>(width) * getFormatSize(format);
+	uint32_t stripRows = static_cast<uint32_t>(std::min<VkDeviceSize>(std::max<VkDeviceSize>(UploadStripByteSize / rowByteSize, 1u), height));
+
+	// strips span the whole width, their first and last rows have to be multiples of the granularity height (or the last row of the image).
+	// a granularity of (0,0,0) only allows whole images, the strips are copied on the graphics queue then
+	const VkExtent3D granularity = _vulkan.getMinImageTransferGranularity(QueueType::Transfer);
+	const QueueType uploadQueue = granularity.height == 0u && stripRows < height ? QueueType::Graphics : QueueType::Transfer;
+	const uint32_t granularityRows = uploadQueue == QueueType::Transfer ? std::max(granularity.height, 1u) : 1u;
+
+	// align strips to OpenEXR chunks so that no chunk is decompressed twice, the smallest multiple of both
+	uint32_t rowAlignment = granularityRows;
+	if (source == PanoramaSource::OpenEXR && stripRows > exrReader.getRowsPerChunk())
+	{
+		while (rowAlignment % exrReader.getRowsPerChunk() != 0u)
+		{
+			rowAlignment += granularityRows;
+		}
+	}
+	stripRows = std::min(std::max(stripRows - stripRows % rowAlignment, rowAlignment), height);
+	const uint32_t stripCount = (height + stripRows - 1u) / stripRows;
+	const uint32_t ringSize = std::min(UploadStagingRingSize, stripCount);
+
+	// create the destination image we want to sample in the shader
+	if (_vulkan.createImage2DAndAllocate(_outImage, width, height, format, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	// transfer data to the host coherent staging buffer
-	if (_vulkan.writeBufferData(stagingBuffer, panorama.getHdrData(), panorama.getByteSize()) != VK_SUCCESS)
+	// create staging buffers for one strip each
+	_outStagingBuffers.resize(ringSize, VK_NULL_HANDLE);
+	for (VkBuffer& stagingBuffer : _outStagingBuffers)
+	{
+		if (_vulkan.createBufferAndAllocate(stagingBuffer, rowByteSize * stripRows, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_SHARING_MODE_EXCLUSIVE, 0u, AllocationScope::Transient) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+
+	// ticket of the last copy out of each staging buffer
+	std::vector<SubmissionTicket> stagingTickets(ringSize);
+
+	std::chrono::steady_clock::duration decodeTime(0);
+
+	for (uint32_t strip = 0u; strip < stripCount; ++strip)
+	{
+		const uint32_t slot = strip % ringSize;
+		const VkBuffer stagingBuffer = _outStagingBuffers[slot];
+		const uint32_t firstRow = strip * stripRows;
+		const uint32_t rows = std::min(stripRows, height - firstRow);
+		const bool lastStrip = strip + 1u == stripCount;
+
+		// wait until the previous copy out of this staging buffer finished
+		if (_vulkan.wait(stagingTickets[slot]) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		// decode / copy the strip straight into the persistently mapped staging memory
+		void* stagingData = _vulkan.getMappedData(stagingBuffer);
+		if (stagingData == nullptr)
+		{
+			return Result::VulkanError;
+		}
+
+		if (source != PanoramaSource::STB)
+		{
+			const auto decodeStart = std::chrono::steady_clock::now();
+			Result res = source == PanoramaSource::Radiance ?
+				hdrReader.readScanlines(stagingData, rows, HdrReader::Format::RGBE) :
+				exrReader.readScanlines(stagingData, rows);
+			decodeTime += std::chrono::steady_clock::now() - decodeStart;
+
+			if (res != Result::Success)
+			{
+				return res;
+			}
+		}
+		else
+		{
+			const size_t stripOffset = static_cast<size_t>(firstRow) * width * HdrReader::Channels;
+			convertFloatToHalf(panorama.getHdrData() + stripOffset, static_cast<uint16_t*>(stagingData), static_cast<size_t>(rows) * width * HdrReader::Channels);
+		}
+
+		if (_vulkan.flushBufferData(stagingBuffer, 0u, rowByteSize * rows) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		VkCommandBuffer uploadCmd = VK_NULL_HANDLE;
+		if (_vulkan.createCommandBuffer(uploadCmd, VK_COMMAND_BUFFER_LEVEL_PRIMARY, uploadQueue) != VK_SUCCESS ||
+			_vulkan.beginCommandBuffer(uploadCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		// transition to write dst layout, later strips are ordered after this barrier by submission order
+		if (strip == 0u)
+		{
+			_vulkan.transitionImageToTransferWrite(uploadCmd, _outImage);
+		}
+
+		VkBufferImageCopy region{};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1u;
+		region.imageOffset = { 0, static_cast<int32_t>(firstRow), 0 };
+		region.imageExtent = { width, rows, 1u };
+
+		_vulkan.copyBufferToImage2D(uploadCmd, stagingBuffer, _outImage, region);
+
+		if (lastStrip)
+		{
+			// hand the image over to the graphics queue in shader read layout
+			_vulkan.transferImageOwnership(uploadCmd, _graphicsCmdBuffer, _outImage,
+										   uploadQueue, QueueType::Graphics,
+										   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+										   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+										   VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		}
+
+		if (_vulkan.endCommandBuffer(uploadCmd) != VK_SUCCESS ||
+			_vulkan.submit({ uploadCmd }, stagingTickets[slot], uploadQueue, {}, {}, lastStrip ? std::vector<VkSemaphore>{ _signalSemaphore } : std::vector<VkSemaphore>{}) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		// recycled once the copy completed
+		_vulkan.destroyCommandBuffer(uploadCmd);
+
+		_outTicket = stagingTickets[slot];
+	}
+
+	if (source != PanoramaSource::STB)
+	{
+		printf("Decoded %u scanlines on %u threads in %.2f ms\n", height, threadPool.getThreadCount(), std::chrono::duration<double, std::milli>(decodeTime).count());
+	}
+
+	return Result::Success;
+}
+
+// KTX2 files start with the identifier «KTX 20»\r\n\x1A\n
+bool isKtx2File(const char* _path)
+{
+	static const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	FILE* file = fopen(_path, "rb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	uint8_t header[sizeof(identifier)] = {};
+	const size_t bytesRead = fread(header, 1u, sizeof(header), file);
+	fclose(file);
+
+	return bytesRead == sizeof(header) && memcmp(header, identifier, sizeof(identifier)) == 0;
+}
+
+// uploads the faces and levels stored in a KTX2 cube map into _outImage (format of the file, levels down to 1x1) on the transfer queue.
+// the whole image is handed over to the graphics queue in shader read layout, levels beyond _outLoadedLevels are undefined and have to be generated.
+// the submission signals _signalSemaphore like uploadImage, _outStagingBuffers have to stay alive until _outTicket completed
+Result uploadCubeMap(vkHelper& _vulkan, const VkCommandBuffer _graphicsCmdBuffer, const KtxImage& _ktxImage, const VkSemaphore _signalSemaphore, VkImage& _outImage, uint32_t& _outLoadedLevels, std::vector<VkBuffer>& _outStagingBuffers, SubmissionTicket& _outTicket)
+{
+	_outImage = VK_NULL_HANDLE;
+	_outStagingBuffers.clear();
+
+	const uint32_t sideLength = _ktxImage.getWidth();
+	if (_ktxImage.isCubeMap() == false || _ktxImage.getHeight() != sideLength)
+	{
+		printf("Input KTX2 file is not a cube map\n");
+		return Result::InvalidArgument;
+	}
+
+	uint32_t levelCount = 0u;
+	for (uint32_t m = sideLength; m > 0; m = m >> 1, ++levelCount) {}
+
+	_outLoadedLevels = std::min(_ktxImage.getLevels(), levelCount);
+
+	const VkFormat format = _ktxImage.getFormat();
+
+	// the filter samples the cube map linearly, missing levels are generated with blits
+	VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	if (_outLoadedLevels < levelCount)
+	{
+		requiredFeatures |= VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+	}
+
+	if ((_vulkan.getFormatFeatures(format) & requiredFeatures) != requiredFeatures)
+	{
+		printf("Cube map format %u is not supported for filtering%s on this device\n", static_cast<uint32_t>(format), _outLoadedLevels < levelCount ? " and mipmap generation" : "");
+		return Result::InvalidArgument;
+	}
+
+	// levels are copied to the staging buffer in order, offsets have to be a multiple of the texel size and 4
+	const VkDeviceSize texelSize = getFormatSize(format);
+	if (texelSize == 0u)
+	{
+		printf("Cube map format %u is not supported\n", static_cast<uint32_t>(format));
+		return Result::InvalidArgument;
+	}
+
+	VkDeviceSize alignment = texelSize;
+	while (alignment % 4u != 0u)
+	{
+		alignment += texelSize;
+	}
+
+	std::vector<VkBufferImageCopy> regions(_outLoadedLevels);
+	VkDeviceSize stagingSize = 0u;
+
+	for (uint32_t level = 0u; level < _outLoadedLevels; ++level)
+	{
+		const uint32_t levelSideLength = std::max(sideLength >> level, 1u);
+
+		stagingSize = (stagingSize + alignment - 1u) / alignment * alignment;
+
+		VkBufferImageCopy& region = regions[level];
+		region.bufferOffset = stagingSize;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0u, 6u };
+		region.imageExtent = { levelSideLength, levelSideLength, 1u };
+
+		stagingSize += static_cast<VkDeviceSize>(_ktxImage.getImageSize(level)) * 6u;
+	}
+
+	if (_vulkan.createImage2DAndAllocate(_outImage, sideLength, sideLength, format,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		levelCount, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	// create the destination image we want to sample in the shader
-	if (_vulkan.createImage2DAndAllocate(_outImage, panorama.getWidth(), panorama.getHeight(), VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != VK_SUCCESS)
+	_outStagingBuffers.resize(1u, VK_NULL_HANDLE);
+	VkBuffer& stagingBuffer = _outStagingBuffers.front();
+	if (_vulkan.createBufferAndAllocate(stagingBuffer, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_SHARING_MODE_EXCLUSIVE, 0u, AllocationScope::Transient) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	if (_vulkan.beginCommandBuffer(uploadCmds, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	uint8_t* stagingData = static_cast<uint8_t*>(_vulkan.getMappedData(stagingBuffer));
+	if (stagingData == nullptr)
 	{
 		return Result::VulkanError;
 	}
 
-	// transition to write dst layout
-	_vulkan.transitionImageToTransferWrite(uploadCmds, _outImage);
-	_vulkan.copyBufferToBasicImage2D(uploadCmds, stagingBuffer, _outImage);
-	_vulkan.transitionImageToShaderRead(uploadCmds, _outImage);
+	// faces are copied straight from the file mapping
+	for (uint32_t level = 0u; level < _outLoadedLevels; ++level)
+	{
+		const size_t imageSize = _ktxImage.getImageSize(level);
+
+		for (uint32_t face = 0u; face < 6u; ++face)
+		{
+			const uint8_t* imageData = _ktxImage.getMappedImageData(level, face);
+			if (imageData == nullptr)
+			{
+				printf("Supercompressed KTX2 cube maps are not supported as input\n");
+				return Result::InvalidArgument;
+			}
+
+			memcpy(stagingData + regions[level].bufferOffset + face * imageSize, imageData, imageSize);
+		}
+	}
+
+	if (_vulkan.flushBufferData(stagingBuffer) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
 
-	if (_vulkan.endCommandBuffer(uploadCmds) != VK_SUCCESS)
+	VkCommandBuffer uploadCmd = VK_NULL_HANDLE;
+	if (_vulkan.createCommandBuffer(uploadCmd, VK_COMMAND_BUFFER_LEVEL_PRIMARY, QueueType::Transfer) != VK_SUCCESS ||
+		_vulkan.beginCommandBuffer(uploadCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	if (_vulkan.executeCommandBuffer(uploadCmds) != VK_SUCCESS)
+	const VkImageSubresourceRange completeRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, levelCount, 0u, 6u };
+
+	_vulkan.imageBarrier(uploadCmd, _outImage,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		completeRange);
+
+	vkCmdCopyBufferToImage(uploadCmd, stagingBuffer, _outImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+	_vulkan.transferImageOwnership(uploadCmd, _graphicsCmdBuffer, _outImage,
+		QueueType::Transfer, QueueType::Graphics,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+		completeRange);
+
+	if (_vulkan.endCommandBuffer(uploadCmd) != VK_SUCCESS ||
+		_vulkan.submit({ uploadCmd }, _outTicket, QueueType::Transfer, {}, {}, { _signalSemaphore }) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	_vulkan.destroyBuffer(stagingBuffer);
-	_vulkan.destroyCommandBuffer(uploadCmds);
+	_vulkan.destroyCommandBuffer(uploadCmd);
+
+	printf("Uploaded cube map %u x %u with %u of %u levels\n", sideLength, sideLength, _outLoadedLevels, levelCount);
 
 	return Result::Success;
 }
 
+// prefer cached memory for readback, CPU reads from uncached memory are slow
+VkResult createReadbackBuffer(vkHelper& _vulkan, VkBuffer& _outBuffer, VkDeviceSize _byteSize)
+{
+	VkResult res = _vulkan.createBufferAndAllocate(_outBuffer, _byteSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+		VK_SHARING_MODE_EXCLUSIVE, 0u, AllocationScope::Transient);
+
+	if (res == VK_ERROR_FEATURE_NOT_PRESENT)
+	{
+		res = _vulkan.createBufferAndAllocate(_outBuffer, _byteSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VK_SHARING_MODE_EXCLUSIVE, 0u, AllocationScope::Transient);
+	}
+
+	return res;
+}
+
 Result convertVkFormat(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkImage _srcImage, VkImage& _outImage, VkFormat _dstFormat, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
 {
 	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
@@ -183,7 +812,24 @@ Result convertVkFormat(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer,
 	return Result::Success;
 }
 
-Result downloadCubemap(vkHelper& _vulkan, const VkImage _srcImage, const char* _outputPath, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+// stage and access mask of the last write into an image left in _layout by the passes in sample()
+void getLastWriteScope(const VkImageLayout _layout, VkPipelineStageFlags& _outStage, VkAccessFlags& _outAccess)
+{
+	if (_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+	{
+		_outStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		_outAccess = VK_ACCESS_TRANSFER_WRITE_BIT;
+	}
+	else
+	{
+		_outStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		_outAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	}
+}
+
+// records the ownership release into _graphicsCmdBuffer and the acquire into _transferCmdBuffer, the image is left in TRANSFER_SRC for streamCubemap.
+// the transfer submission has to wait on the graphics submission at the transfer stage
+Result releaseCubemapForReadback(vkHelper& _vulkan, const VkCommandBuffer _graphicsCmdBuffer, const VkCommandBuffer _transferCmdBuffer, const VkImage _srcImage, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
 {
 	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
 	if (pInfo == nullptr)
@@ -191,153 +837,157 @@ Result downloadCubemap(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 		return Result::InvalidArgument;
 	}
 
-	Result res = Success;
+	// barrier on complete image
+	VkImageSubresourceRange  subresourceRange{};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.baseArrayLayer = 0u;
+	subresourceRange.layerCount = 6u;
+	subresourceRange.baseMipLevel = 0u;
+	subresourceRange.levelCount = pInfo->mipLevels;
 
-	const VkFormat cubeMapFormat = pInfo->format;
-	const uint32_t cubeMapFormatByteSize = getFormatSize(cubeMapFormat);
-	const uint32_t cubeMapSideLength = pInfo->extent.width;
-	const uint32_t mipLevels = pInfo->mipLevels;
+	VkPipelineStageFlags srcStage = 0u;
+	VkAccessFlags srcAccess = 0u;
+	getLastWriteScope(inputImageLayout, srcStage, srcAccess);
 
-	using Faces = std::vector<VkBuffer>;
-	using MipLevels = std::vector<Faces>;
+	_vulkan.transferImageOwnership(_graphicsCmdBuffer, _transferCmdBuffer, _srcImage,
+																 QueueType::Graphics, QueueType::Transfer,
+																 inputImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+																 srcStage, srcAccess, // src stage, access
+																 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+																 subresourceRange);//dst stage, access
 
-	MipLevels stagingBuffer(mipLevels);
+	return Result::Success;
+}
 
+// call after the submission recorded by releaseCubemapForReadback completed.
+// the levels of _srcImage are read back in KTX2 file order (smallest first) and written to _outputPath as soon as their copy completed,
+// the copy of the next level runs while a level is written. host memory is bounded by the size of the two largest levels. _layout describes the file and needs no storage
+Result streamCubemap(vkHelper& _vulkan, const VkImage _srcImage, KtxImage& _layout, const char* _outputPath)
+{
+	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
+	if (pInfo == nullptr || _layout.getLevels() > pInfo->mipLevels)
 	{
-		uint32_t currentSideLength = cubeMapSideLength;
-
-		for (uint32_t level = 0; level < mipLevels; level++)
-		{
-			Faces& faces = stagingBuffer[level];
-			faces.resize(6u);
-
-			for (uint32_t face = 0; face < 6u; face++)
-			{
-				if (_vulkan.createBufferAndAllocate(
-																						faces[face], currentSideLength * currentSideLength * cubeMapFormatByteSize,
-																						VK_BUFFER_USAGE_TRANSFER_DST_BIT,// VkBufferUsageFlags _usage,
-																						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)//VkMemoryPropertyFlags _memoryFlags,
-						!= VK_SUCCESS)
-				{
-					return Result::VulkanError;
-				}
-			}
-
-			currentSideLength = currentSideLength >> 1;
-		}
+		return Result::InvalidArgument;
 	}
 
-	VkCommandBuffer downloadCmds = VK_NULL_HANDLE;
-	if (_vulkan.createCommandBuffer(downloadCmds) != VK_SUCCESS)
+	KtxStreamWriter ktxWriter;
+	Result res = ktxWriter.open(_layout, _outputPath);
+	if (res != Result::Success)
 	{
-		return Result::VulkanError;
+		printf("Could not save to path %s \n", _outputPath);
+		return res;
 	}
 
-	if (_vulkan.beginCommandBuffer(downloadCmds, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	// even levels are copied into the staging buffer of level 0, odd levels into the one of level 1, consecutive levels never share a buffer
+	const uint32_t stagingCount = std::min(ktxWriter.getLevelCount(), 2u);
+	VkBuffer stagingBuffers[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	const uint8_t* stagingData[2] = { nullptr, nullptr };
+	VkCommandBuffer copyCmds[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	SubmissionTicket copyTickets[2];
+
+	for (uint32_t i = 0u; i < stagingCount && res == Result::Success; ++i)
 	{
-		return Result::VulkanError;
+		if (createReadbackBuffer(_vulkan, stagingBuffers[i], ktxWriter.getLevelSize(i)) != VK_SUCCESS ||
+			(stagingData[i] = static_cast<const uint8_t*>(_vulkan.getMappedData(stagingBuffers[i]))) == nullptr)
+		{
+			res = Result::VulkanError;
+		}
 	}
 
-	// barrier on complete image
-	VkImageSubresourceRange  subresourceRange{};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.baseArrayLayer = 0u;
-	subresourceRange.layerCount = 6u;
-	subresourceRange.baseMipLevel = 0u;
-	subresourceRange.levelCount = mipLevels;
-
-	_vulkan.imageBarrier(downloadCmds, _srcImage,
-											 inputImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-											 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // src stage, access
-											 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
-											 subresourceRange);//dst stage, access
-
-	// copy all faces & levels into staging buffers
+	// records and submits the copy of all faces of _level into its staging buffer
+	auto submitCopy = [&](const uint32_t _level) -> Result
 	{
-		uint32_t currentSideLength = cubeMapSideLength;
+		const uint32_t slot = _level & 1u;
+		const uint32_t sideLength = std::max(pInfo->extent.width >> _level, 1u);
+		const size_t imageSize = _layout.getImageSize(_level);
 
-		VkBufferImageCopy region{};
+		if (_vulkan.createCommandBuffer(copyCmds[slot], VK_COMMAND_BUFFER_LEVEL_PRIMARY, QueueType::Transfer) != VK_SUCCESS ||
+			_vulkan.beginCommandBuffers({ copyCmds[slot] }, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
 
+		// faces of a level are stored consecutively
+		VkBufferImageCopy region{};
 		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		region.imageSubresource.layerCount = 1u;
+		region.imageSubresource.mipLevel = _level;
+		region.imageExtent = { sideLength, sideLength, 1u };
 
-		for (uint32_t level = 0; level < mipLevels; level++)
+		for (uint32_t face = 0; face < 6u; face++)
 		{
-			region.imageSubresource.mipLevel = level;
-			Faces& faces = stagingBuffer[level];
+			region.bufferOffset = face * imageSize;
+			region.imageSubresource.baseArrayLayer = face;
 
-			for (uint32_t face = 0; face < 6u; face++)
-			{
-				region.imageSubresource.baseArrayLayer = face;
-				region.imageExtent = { currentSideLength , currentSideLength , 1u };
+			_vulkan.copyImage2DToBuffer(copyCmds[slot], _srcImage, stagingBuffers[slot], region);
+		}
 
-				_vulkan.copyImage2DToBuffer(downloadCmds, _srcImage, faces[face], region);
-			}
+		_vulkan.transitionBufferToHostRead(copyCmds[slot], stagingBuffers[slot]);
 
-			currentSideLength = currentSideLength >> 1;
+		if (_vulkan.endCommandBuffers({ copyCmds[slot] }) != VK_SUCCESS ||
+			_vulkan.submit({ copyCmds[slot] }, copyTickets[slot], QueueType::Transfer) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
 		}
-	}
 
-	if (_vulkan.endCommandBuffer(downloadCmds) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
+		return Result::Success;
+	};
 
-	if (_vulkan.executeCommandBuffer(downloadCmds) != VK_SUCCESS)
+	if (res == Result::Success)
 	{
-		return Result::VulkanError;
+		res = submitCopy(ktxWriter.getNextLevel());
 	}
 
-	_vulkan.destroyCommandBuffer(downloadCmds);
-
-	// Image is copied to buffer
-	// Now map buffer and copy to ram
+	while (res == Result::Success && ktxWriter.getNextLevel() < ktxWriter.getLevelCount())
 	{
-		KtxImage ktxImage(cubeMapSideLength, cubeMapSideLength, cubeMapFormat, mipLevels, true);
+		const uint32_t level = ktxWriter.getNextLevel();
+		const uint32_t slot = level & 1u;
 
-		std::vector<uint8_t> imageData;
-
-		uint32_t currentSideLength = cubeMapSideLength;
+		// the other buffer was written in the previous iteration
+		if (level > 0u)
+		{
+			res = submitCopy(level - 1u);
+		}
 
-		for (uint32_t level = 0; level < mipLevels; level++)
+		if (res == Result::Success &&
+			(_vulkan.wait(copyTickets[slot]) != VK_SUCCESS ||
+			 _vulkan.invalidateBufferData(stagingBuffers[slot]) != VK_SUCCESS))
 		{
-			const size_t imageByteSize = (size_t)currentSideLength * (size_t)currentSideLength * (size_t)cubeMapFormatByteSize;
-			imageData.resize(imageByteSize);
+			res = Result::VulkanError;
+		}
 
-			Faces& faces = stagingBuffer[level];
+		if (res == Result::Success)
+		{
+			res = ktxWriter.writeLevel(level, stagingData[slot], ktxWriter.getLevelSize(level));
+		}
 
-			for (uint32_t face = 0; face < 6u; face++)
-			{
-				if (_vulkan.readBufferData(faces[face], imageData.data(), imageByteSize) != VK_SUCCESS)
-				{
-					return Result::VulkanError;
-				}
+		_vulkan.destroyCommandBuffer(copyCmds[slot]);
+		copyCmds[slot] = VK_NULL_HANDLE;
+	}
 
-				res = ktxImage.writeFace(imageData, face, level);
-
-				if (res != Result::Success)
-				{
-					return res;
-				}
-
-				_vulkan.destroyBuffer(faces[face]);
-			}
+	// a failure can leave a copy in flight
+	for (uint32_t i = 0u; i < 2u; ++i)
+	{
+		_vulkan.wait(copyTickets[i]);
+		_vulkan.destroyCommandBuffer(copyCmds[i]);
+		_vulkan.destroyBuffer(stagingBuffers[i]);
+	}
 
-			currentSideLength = currentSideLength >> 1;
-		}
+	if (res == Result::Success)
+	{
+		res = ktxWriter.close();
+	}
 
-		res = ktxImage.save(_outputPath);
-		if (res != Result::Success)
-		{
-			printf("Could not save to path %s \n", _outputPath);
-			return res;
-		}
+	if (res != Result::Success)
+	{
+		printf("Could not save to path %s \n", _outputPath);
 	}
 
-	return Result::Success;
+	return res;
 }
 
-Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _outputPath, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+// records the ownership release into _graphicsCmdBuffer and the copy of mip 0 into a staging buffer into _transferCmdBuffer, rows are tightly packed
+Result download2DImage(vkHelper& _vulkan, const VkCommandBuffer _graphicsCmdBuffer, const VkCommandBuffer _transferCmdBuffer, const VkImage _srcImage, VkBuffer& _outStagingBuffer, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
 {
 	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
 	if (pInfo == nullptr)
@@ -345,32 +995,13 @@ Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 		return Result::InvalidArgument;
 	}
 
-	Result res = Success;
-
 	const VkFormat format = pInfo->format;
 	const uint32_t formatByteSize = getFormatSize(format);
 	const uint32_t width = pInfo->extent.width;
-	const uint32_t height = pInfo->extent.width;
-	const size_t imageByteSize = width * height * formatByteSize;
-
-	VkBuffer stagingBuffer{};
-
-	if (_vulkan.createBufferAndAllocate(
-																			stagingBuffer, static_cast<uint32_t>(imageByteSize),
-																			VK_BUFFER_USAGE_TRANSFER_DST_BIT,// VkBufferUsageFlags _usage,
-																			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)//VkMemoryPropertyFlags _memoryFlags,
-			!= VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
-
-	VkCommandBuffer downloadCmds = VK_NULL_HANDLE;
-	if (_vulkan.createCommandBuffer(downloadCmds) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
+	const uint32_t height = pInfo->extent.height;
+	const size_t imageByteSize = static_cast<size_t>(width) * height * formatByteSize;
 
-	if (_vulkan.beginCommandBuffer(downloadCmds, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	if (createReadbackBuffer(_vulkan, _outStagingBuffer, imageByteSize) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
@@ -383,11 +1014,16 @@ Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 	subresourceRange.baseMipLevel = 0u;
 	subresourceRange.levelCount = 1u;
 
-	_vulkan.imageBarrier(downloadCmds, _srcImage,
-											 inputImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-											 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // src stage, access
-											 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
-											 subresourceRange);//dst stage, access
+	VkPipelineStageFlags srcStage = 0u;
+	VkAccessFlags srcAccess = 0u;
+	getLastWriteScope(inputImageLayout, srcStage, srcAccess);
+
+	_vulkan.transferImageOwnership(_graphicsCmdBuffer, _transferCmdBuffer, _srcImage,
+																 QueueType::Graphics, QueueType::Transfer,
+																 inputImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+																 srcStage, srcAccess, // src stage, access
+																 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+																 subresourceRange);//dst stage, access
 
 	// copy 2D image to buffer
 	{
@@ -399,82 +1035,234 @@ Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 		region.imageSubresource.mipLevel = 0;
 		region.imageSubresource.baseArrayLayer = 0;
 
-		_vulkan.copyImage2DToBuffer(downloadCmds, _srcImage, stagingBuffer, region);
+		_vulkan.copyImage2DToBuffer(_transferCmdBuffer, _srcImage, _outStagingBuffer, region);
 	}
 
-	if (_vulkan.endCommandBuffer(downloadCmds) != VK_SUCCESS)
+	_vulkan.transitionBufferToHostRead(_transferCmdBuffer, _outStagingBuffer);
+
+	return Result::Success;
+}
+
+// call after the download was executed
+// the LUT file type is chosen by the extension of its path
+enum class LUTOutput
+{
+	PNG = 0, // RGB8, any extension but the ones below
+	KTX2, // RGBA16F, .ktx2
+	RawFloat // RGBA32F rows without header, .raw
+};
+
+bool hasExtension(const char* _path, const char* _extension)
+{
+	const size_t pathLength = strlen(_path);
+	const size_t extensionLength = strlen(_extension);
+	return pathLength >= extensionLength && strcmp(_path + pathLength - extensionLength, _extension) == 0;
+}
+
+LUTOutput getLUTOutput(const char* _path)
+{
+	if (hasExtension(_path, ".ktx2"))
 	{
-		return Result::VulkanError;
+		return LUTOutput::KTX2;
+	}
+	if (hasExtension(_path, ".raw"))
+	{
+		return LUTOutput::RawFloat;
+	}
+	return LUTOutput::PNG;
+}
+
+// format the LUT is rendered in, it is read back without conversion
+VkFormat getLUTFormat(LUTOutput _output)
+{
+	switch (_output)
+	{
+	case LUTOutput::KTX2:
+		return VK_FORMAT_R16G16B16A16_SFLOAT;
+	case LUTOutput::RawFloat:
+		return VK_FORMAT_R32G32B32A32_SFLOAT;
+	default:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+// call after the download was executed. the staging buffer is copied into the output representation, _writer serializes and writes it
+// _outContentHash receives the hash of the pixel data as it is stored in the file, see hashLUTFile
+Result write2DImage(vkHelper& _vulkan, const VkImage _srcImage, const VkBuffer _stagingBuffer, const char* _outputPath, OutputWriter& _writer, uint64_t& _outContentHash)
+{
+	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
+	if (pInfo == nullptr)
+	{
+		return Result::InvalidArgument;
 	}
 
-	if (_vulkan.executeCommandBuffer(downloadCmds) != VK_SUCCESS)
+	const VkFormat format = pInfo->format;
+	const uint32_t formatByteSize = getFormatSize(format);
+	const uint32_t width = pInfo->extent.width;
+	const uint32_t height = pInfo->extent.height;
+	const size_t imageByteSize = static_cast<size_t>(width) * height * formatByteSize;
+
+	// rows are tightly packed in the staging buffer
+	const uint8_t* imageData = static_cast<const uint8_t*>(_vulkan.getMappedData(_stagingBuffer));
+	if (imageData == nullptr || _vulkan.invalidateBufferData(_stagingBuffer) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	_vulkan.destroyCommandBuffer(downloadCmds);
+	switch (format)
+	{
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+	{
+		std::shared_ptr<KtxImage> ktxImage = std::make_shared<KtxImage>(width, height, format, 1u, false);
+		memcpy(ktxImage->getData(), imageData, imageByteSize);
+		_outContentHash = hash64(imageData, imageByteSize);
+		_writer.enqueue(_outputPath, [ktxImage](const char* _path) { return ktxImage->save(_path); });
+		break;
+	}
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+	{
+		std::shared_ptr<std::vector<uint8_t>> data = std::make_shared<std::vector<uint8_t>>(imageData, imageData + imageByteSize);
+		_outContentHash = hash64(data->data(), data->size());
+		_writer.enqueue(_outputPath, [data](const char* _path) { return writeFile(_path, *data) ? Success : FileNotFound; });
+		break;
+	}
+	default:
+	{
+		// stb_image_write can not write PNGs with 4 components and 2-channel images are displayed as grey-alpha,
+		// so the LUT is written as RGB to stay comparable with existing LUT PNGs
+		const uint32_t channels = getChannelCount(format);
+		const size_t pixelCount = static_cast<size_t>(width) * height;
+
+		std::shared_ptr<std::vector<uint8_t>> imageDataThreeChannel = std::make_shared<std::vector<uint8_t>>(pixelCount * 3u, 0u);
+		for (size_t i = 0u; i < pixelCount; ++i)
+		{
+			for (uint32_t c = 0u; c < std::min(channels, 3u); ++c)
+			{
+				(*imageDataThreeChannel)[3u * i + c] = imageData[channels * i + c];
+			}
+		}
+		_outContentHash = hash64(imageDataThreeChannel->data(), imageDataThreeChannel->size());
+
+		// deflate is by far the slowest part, it runs on the writer while the cube map is handed off
+		_writer.enqueue(_outputPath, [imageDataThreeChannel, width, height](const char* _path)
+		{
+			STBImage stbImage;
+			return stbImage.savePng(_path, width, height, 3, imageDataThreeChannel->data());
+		});
+		break;
+	}
+	}
+
+	_vulkan.destroyBuffer(_stagingBuffer);
+
+	return Result::Success;
+}
 
-	// Image is copied to buffer
-	// Now map buffer and copy to ram
+// hash of the pixel data of the LUT file at _path as write2DImage stores it: the level of a KTX2 file, all bytes of a raw file or the RGB texels of a PNG
+bool hashLUTFile(const char* _path, uint64_t& _outHash)
+{
+	FILE* probe = fopen(_path, "rb");
+	if (probe == nullptr)
 	{
+		return false;
+	}
+	fclose(probe);
 
-		std::vector<uint8_t> imageData;
-		imageData.resize(imageByteSize);
+	switch (getLUTOutput(_path))
+	{
+	case LUTOutput::KTX2:
+	{
+		KtxImage ktxImage;
+		if (isKtx2File(_path) == false || ktxImage.loadKtx2(_path) != Success || ktxImage.getFormat() != getLUTFormat(LUTOutput::KTX2))
+		{
+			return false;
+		}
 
-		if (_vulkan.readBufferData(stagingBuffer, imageData.data(), imageByteSize) != VK_SUCCESS)
+		const uint8_t* data = ktxImage.getMappedImageData(0u, 0u);
+		if (data == nullptr)
 		{
-			return Result::VulkanError;
+			return false;
 		}
 
-		// Compute channel count by dividing the pixel byte length through each channels byte length.
-		const uint32_t channels = getChannelCount(pInfo->format);
-
-		// Copy the outputted image (format with 1, 2 or 4 channels) into a 3-channel image.
-		// This is kind of a hack (this function is currently only used to write the BRDF LUT to disk):
-		// It seems that stb_write_image is not able to write PNGs with 4 components,
-		// and 2-channel images are displayed as grey-alpha,
-		// which makes is impossible to compare the outputted LUT with already
-		// existing LUT PNGs.
-		std::vector<uint8_t> imageDataThreeChannel(imageData.size() * (4 / channels), 0);
-		for (uint32_t x = 0; x < width; x++) {
-			for (uint32_t y = 0; y < height; y++) {
-				for (uint32_t c = 0; c < std::min(channels, 3u); c++) {
-					imageDataThreeChannel[3 * (x * width + y) + c] =
-					imageData[channels * (x * width + y) + c];
-				}
-			}
+		_outHash = hash64(data, ktxImage.getImageSize(0u));
+		return true;
+	}
+	case LUTOutput::RawFloat:
+		return hashFile(_path, _outHash);
+	default:
+	{
+		STBImage pngImage;
+		if (pngImage.loadPng(_path) != Success)
+		{
+			return false;
 		}
 
-		STBImage stb_image;
-		res = stb_image.savePng(_outputPath, width, height, 3, imageDataThreeChannel.data());
-		if (res != Result::Success)
+		// loaded as RGBA
+		const size_t pixelCount = static_cast<size_t>(pngImage.getWidth()) * pngImage.getHeight();
+		std::vector<uint8_t> rgb(pixelCount * 3u);
+		for (size_t i = 0u; i < pixelCount; ++i)
 		{
-			return res;
+			memcpy(&rgb[3u * i], pngImage.getByteData() + 4u * i, 3u);
 		}
 
-		_vulkan.destroyBuffer(stagingBuffer);
+		_outHash = hash64(rgb.data(), rgb.size());
+		return true;
 	}
+	}
+}
 
-	return Result::Success;
+// true if the outputs were written by a job with the same hash.
+// the LUT depends on the distribution, sample count and resolution but not on the input, its content has to match the hash stored with the cube map
+bool isOutputUpToDate(const char* _outputPathCubeMap, const char* _outputPathLUT, uint64_t _jobHash)
+{
+	char expected[32];
+	snprintf(expected, sizeof(expected), "%016" PRIx64, _jobHash);
+
+	std::string stored;
+	if (KtxImage::readMetadata(_outputPathCubeMap, JobHashKey, stored) == false || stored != expected)
+	{
+		return false;
+	}
+
+	if (_outputPathLUT != nullptr)
+	{
+		uint64_t lutHash = 0u;
+		char lutHashString[32];
+		if (KtxImage::readMetadata(_outputPathCubeMap, LUTHashKey, stored) == false || hashLUTFile(_outputPathLUT, lutHash) == false)
+		{
+			return false;
+		}
+
+		snprintf(lutHashString, sizeof(lutHashString), "%016" PRIx64, lutHash);
+		if (stored != lutHashString)
+		{
+			return false;
+		}
+	}
+
+	return true;
 }
 
-void generateMipmapLevels(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkImage _image, uint32_t _maxMipLevels, uint32_t _sideLength, const VkImageLayout _currentImageLayout)
+// levels [0, _firstMissingLevel) have to be valid, the remaining levels are generated from the previous one
+// _srcStage and _srcAccess describe the last write of the levels in _currentImageLayout
+void generateMipmapLevels(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkImage _image, uint32_t _maxMipLevels, uint32_t _sideLength, const VkImageLayout _currentImageLayout, uint32_t _firstMissingLevel = 1u,
+													VkPipelineStageFlags _srcStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VkAccessFlags _srcAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
 {
 	{
 		VkImageSubresourceRange mipbaseRange{};
 		mipbaseRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		mipbaseRange.baseMipLevel = 0u;
-		mipbaseRange.levelCount = 1u;
+		mipbaseRange.levelCount = _firstMissingLevel;
 		mipbaseRange.layerCount = 6u;
 
 		_vulkan.imageBarrier(_commandBuffer, _image,
 												 _currentImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-												 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+												 _srcStage, _srcAccess,
 												 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,//dst stage, access
 												 mipbaseRange);
 	}
 
-	for (uint32_t i = 1; i < _maxMipLevels; i++)
+	for (uint32_t i = _firstMissingLevel; i < _maxMipLevels; i++)
 	{
 		VkImageBlit imageBlit{};
 
@@ -503,7 +1291,7 @@ void generateMipmapLevels(vkHelper& _vulkan, const VkCommandBuffer _commandBuffe
 		//  Transiton current mip level to transfer dest
 		_vulkan.imageBarrier(_commandBuffer, _image,
 												 _currentImageLayout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-												 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+												 _srcStage, _srcAccess,
 												 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
 												 mipSubRange);//dst stage, access
 
@@ -534,15 +1322,125 @@ void generateMipmapLevels(vkHelper& _vulkan, const VkCommandBuffer _commandBuffe
 		completeRange.levelCount = _maxMipLevels;
 		completeRange.layerCount = 6u;
 
+		// the blits and the barriers above are transfers
 		_vulkan.imageBarrier(_commandBuffer, _image,
 												 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-												 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+												 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
 												 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,//dst stage, access
 												 completeRange);
 	}
 }
 
-Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, /*const VkRenderPass _renderPass,*/ const VkShaderModule fullscreenVertexShader, const VkImage _panoramaImage, const VkImage _cubeMapImage)
+//Push Constants for specular and diffuse filter passes, the other passes of filter.frag use the same block
+struct PushConstant
+{
+	float roughness = 0.f;
+	uint32_t sampleCount = 1u;
+	uint32_t mipLevel = 1u;
+	uint32_t width = 1024u;
+	float lodBias = 0.f;
+	Distribution distribution = Distribution::Lambertian;
+	uint32_t lutSampleCount = 1u;
+	uint32_t lightSampleCount = 0u;
+	uint32_t lightCdfSide = 1u;
+	uint32_t lightCdfLevel = 0u;
+};
+
+// GGX levels of the hierarchical filter take at most this many samples, the source pyramid provides the prefiltering
+constexpr uint32_t HierarchicalSampleCount = 64u;
+
+// the light CDF is built from the first input level with at most this side length, texels of the CDF are sampled uniformly
+constexpr uint32_t LightCdfMaxSide = 128u;
+
+// the sun is extracted in this many passes, each one binds the target of its predecessor
+constexpr uint32_t SunPassCount = 4u;
+constexpr VkFormat LightCdfFormat = VK_FORMAT_R32_SFLOAT;
+
+// the row peaks, row sums and the light of the sun extraction
+constexpr VkFormat SunFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+
+// copies _level of _cubeMap (a color attachment) into the source pyramid and creates a descriptor set sampling it from that level on.
+// the next level is filtered from it with the residual lobe instead of filtering the input with the whole lobe.
+// _pyramid is created by the first call with a full mip chain for level 1, later calls reuse it: level n is copied into its mip n - 1 and the levels below are regenerated
+Result createHierarchicalSource(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkImage _cubeMap, uint32_t _level, const VkSampler _sampler, VkImage& _pyramid, VkDescriptorSet& _outDescriptorSet)
+{
+	const VkImageCreateInfo* cubeMapInfo = _vulkan.getCreateInfo(_cubeMap);
+	if (cubeMapInfo == nullptr || _level == 0u)
+	{
+		return Result::InvalidArgument;
+	}
+
+	const uint32_t pyramidSideLength = cubeMapInfo->extent.width >> 1u;
+	uint32_t pyramidLevels = 0u;
+	for (uint32_t m = pyramidSideLength; m > 0; m = m >> 1, ++pyramidLevels) {}
+
+	const uint32_t baseLevel = _level - 1u;
+	if (baseLevel >= pyramidLevels)
+	{
+		return Result::InvalidArgument;
+	}
+
+	if (_pyramid == VK_NULL_HANDLE &&
+		_vulkan.createImage2DAndAllocate(_pyramid, pyramidSideLength, pyramidSideLength, cubeMapInfo->format,
+																		 VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+																		 pyramidLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	VkImageView sourceView = VK_NULL_HANDLE;
+	if (_vulkan.createImageView(sourceView, _pyramid, { VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, pyramidLevels - baseLevel, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	const VkImageSubresourceRange levelRange = { VK_IMAGE_ASPECT_COLOR_BIT, _level, 1u, 0u, 6u };
+
+	_vulkan.imageBarrier(_commandBuffer, _cubeMap,
+											 VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+											 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+											 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+											 levelRange);
+
+	// the previous contents are not needed anymore, the copy waits for the filter pass that sampled them
+	_vulkan.imageBarrier(_commandBuffer, _pyramid,
+											 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+											 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0u,
+											 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+											 { VK_IMAGE_ASPECT_COLOR_BIT, 0u, pyramidLevels, 0u, 6u });
+
+	VkImageCopy region{};
+	region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, _level, 0u, 6u };
+	region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, 0u, 6u };
+	region.extent = { pyramidSideLength >> baseLevel, pyramidSideLength >> baseLevel, 1u };
+
+	vkCmdCopyImage(_commandBuffer, _cubeMap, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _pyramid, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &region);
+
+	// the level is read back with the other levels of the output
+	_vulkan.imageBarrier(_commandBuffer, _cubeMap,
+											 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+											 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+											 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+											 levelRange);
+
+	// the levels above baseLevel are outside of the view, their contents do not matter
+	generateMipmapLevels(_vulkan, _commandBuffer, _pyramid, pyramidLevels, pyramidSideLength, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, baseLevel + 1u, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	DescriptorSetInfo setLayout0;
+	setLayout0.addCombinedImageSampler(_sampler, sourceView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1u, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+	VkDescriptorSetLayout sourceSetLayout = VK_NULL_HANDLE;
+	if (setLayout0.create(_vulkan, sourceSetLayout, _outDescriptorSet) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	_vulkan.updateDescriptorSets(setLayout0.getWrites());
+
+	return Result::Success;
+}
+
+Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, /*const VkRenderPass _renderPass,*/ const VkShaderModule fullscreenVertexShader, const VkImage _panoramaImage, const PanoramaFormat _panoramaFormat, const VkImage _cubeMapImage)
 {
 	IBLLib::Result res = Result::Success;
 
@@ -557,8 +1455,12 @@ Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer
 	const uint32_t maxMipLevels = textureInfo->mipLevels;
 	const VkFormat format = textureInfo->format;
 
+	// multiview renders each face with one view of a layered attachment, otherwise every invocation writes all six faces
+	const bool multiview = _vulkan.isMultiviewEnabled();
+	const uint32_t attachmentCount = multiview ? 1u : 6u;
+
 	VkShaderModule panoramaToCubeMapFragmentShader = VK_NULL_HANDLE;
-	if ((res = compileShader(_vulkan, filterFragmentShader, "panoramaToCubeMap", panoramaToCubeMapFragmentShader, ShaderCompiler::Stage::Fragment)) != Result::Success)
+	if ((res = loadShader(_vulkan, multiview ? Shader::PanoramaToCubeMapMultiview : Shader::PanoramaToCubeMap, panoramaToCubeMapFragmentShader)) != Result::Success)
 	{
 		return res;
 	}
@@ -568,10 +1470,14 @@ Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer
 		RenderPassDesc renderPassDesc;
 
 		// add rendertargets (cubemap faces)
-		for (int face = 0; face < 6; ++face)
+		for (uint32_t face = 0; face < attachmentCount; ++face)
 		{
 			renderPassDesc.addAttachment(format);
 		}
+		if (multiview)
+		{
+			renderPassDesc.setViewMask(CubeFaceViewMask);
+		}
 		if (_vulkan.createRenderPass(renderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
@@ -620,7 +1526,11 @@ Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer
 		GraphicsPipelineDesc panormaToCubePipeline;
 
 		panormaToCubePipeline.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
-		panormaToCubePipeline.addShaderStage(panoramaToCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "panoramaToCubeMap");
+		// selects how the panorama texels are decoded
+		SpecConstantFactory panoramaSpecConstants;
+		panoramaSpecConstants.addConstant(static_cast<uint32_t>(_panoramaFormat), 0u);
+
+		panormaToCubePipeline.addShaderStage(panoramaToCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "panoramaToCubeMap", panoramaSpecConstants.getInfo());
 
 		panormaToCubePipeline.setRenderPass(renderPass);
 		panormaToCubePipeline.setPipelineLayout(panoramaPipelineLayout);
@@ -629,7 +1539,7 @@ Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer
 		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 		colorBlendAttachment.blendEnable = VK_FALSE;
 
-		panormaToCubePipeline.addColorBlendAttachment(colorBlendAttachment,6);
+		panormaToCubePipeline.addColorBlendAttachment(colorBlendAttachment, attachmentCount);
 
 		panormaToCubePipeline.setViewportExtent(VkExtent2D{ cubeMapSideLength, cubeMapSideLength });
 
@@ -640,14 +1550,24 @@ Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer
 	}
 
 	/// Render Pass
-	std::vector<VkImageView> inputCubeMapViews(6u, VK_NULL_HANDLE);
-	for (size_t i = 0; i < inputCubeMapViews.size(); i++)
+	std::vector<VkImageView> inputCubeMapViews(attachmentCount, VK_NULL_HANDLE);
+	if (multiview)
 	{
-		if (_vulkan.createImageView(inputCubeMapViews[i], _cubeMapImage, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, static_cast<uint32_t>(i), 1u }) != VK_SUCCESS)
+		if (_vulkan.createImageView(inputCubeMapViews.front(), _cubeMapImage, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D_ARRAY) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 	}
+	else
+	{
+		for (size_t i = 0; i < inputCubeMapViews.size(); i++)
+		{
+			if (_vulkan.createImageView(inputCubeMapViews[i], _cubeMapImage, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, static_cast<uint32_t>(i), 1u }) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+		}
+	}
 
 	VkFramebuffer cubeMapInputFramebuffer = VK_NULL_HANDLE;
 	if (_vulkan.createFramebuffer(cubeMapInputFramebuffer, renderPass, cubeMapSideLength, cubeMapSideLength, inputCubeMapViews, 1u) != VK_SUCCESS)
@@ -669,7 +1589,7 @@ Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer
 
 	vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, panoramaToCubeMapPipeline);
 
-	const std::vector<VkClearValue> clearValues(6u, { 0.0f, 0.0f, 1.0f, 1.0f });
+	const std::vector<VkClearValue> clearValues(attachmentCount, { 0.0f, 0.0f, 1.0f, 1.0f });
 
 	_vulkan.beginRenderPass(_commandBuffer, renderPass, cubeMapInputFramebuffer, VkRect2D{ 0u, 0u, cubeMapSideLength, cubeMapSideLength }, clearValues);
 	vkCmdDraw(_commandBuffer, 3, 1u, 0, 0);
@@ -677,134 +1597,868 @@ Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer
 
 	return res;
 }
-} // !IBLLib
-
 
-IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput)
+// finds the brightest light source in level 0 of _inputCubeMap (shader read only) and renders the input without it to level 0 of _sunlessCubeMap,
+// which is left as color attachment. the light (direction and solid angle, color and found flag, see sunLight in filter.frag) is copied to _outLightBuffer
+Result extractSun(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkShaderModule _fullscreenVertexShader, const VkImage _inputCubeMap, const VkSampler _cubeMapSampler, const VkImage _sunlessCubeMap, VkBuffer& _outLightBuffer)
 {
-	const VkFormat cubeMapFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
-	const VkFormat LUTFormat = VK_FORMAT_R8G8B8A8_UNORM;
-
 	IBLLib::Result res = Result::Success;
 
-	vkHelper vulkan;
-
-	if (vulkan.initialize(0u, 1u, _debugOutput) != VK_SUCCESS)
-	{
-		return Result::VulkanInitializationFailed;
-	}
-
-	VkImage panoramaImage;
-	if ((res = uploadImage(vulkan, _inputPath, panoramaImage)) != Result::Success)
-	{
-		return res;
-	}
-
-	VkShaderModule fullscreenVertexShader = VK_NULL_HANDLE;
-	if ((res = compileShader(vulkan, primitiveVertexShader, "main", fullscreenVertexShader, ShaderCompiler::Stage::Vertex)) != Result::Success)
-	{
-		return res;
-	}
-
-	VkShaderModule filterCubeMapFragmentShader = VK_NULL_HANDLE;
-	if ((res = compileShader(vulkan, filterFragmentShader, "filterCubeMap", filterCubeMapFragmentShader, ShaderCompiler::Stage::Fragment)) != Result::Success)
+	const VkImageCreateInfo* cubeMapInfo = _vulkan.getCreateInfo(_inputCubeMap);
+	const VkImageCreateInfo* sunlessInfo = _vulkan.getCreateInfo(_sunlessCubeMap);
+	if (cubeMapInfo == nullptr || sunlessInfo == nullptr || sunlessInfo->extent.width != cubeMapInfo->extent.width)
 	{
-		return res;
+		return Result::InvalidArgument;
 	}
 
-	VkExtent3D panoramaExtent = vulkan.getCreateInfo(panoramaImage)->extent;
-	// it is best to sample an nxn cube map from a 4nx2n equirectangular image, e.g. a 1024x512 equirectangular images becomes a 256x256 cube map.
-	_cubemapResolution = _cubemapResolution != 0 ? _cubemapResolution : panoramaExtent.height / 2;
-	_mipmapCount = _mipmapCount != 0 ? _mipmapCount : static_cast<uint32_t>(floor(log2(_cubemapResolution)));
+	const uint32_t sideLength = cubeMapInfo->extent.width;
 
-	const uint32_t cubeMapSideLength = _cubemapResolution;
-	const uint32_t outputMipLevels = _distribution == Distribution::Lambertian ? 1u : _mipmapCount;
+	const bool multiview = _vulkan.isMultiviewEnabled();
+	const uint32_t faceAttachmentCount = multiview ? 1u : 6u;
 
-	uint32_t maxMipLevels = 0u;
-	for (uint32_t m = cubeMapSideLength; m > 0; m = m >> 1, ++maxMipLevels) {}
+	// the row peaks and their peak, the row sums and the light (one texel per sum).
+	// the per row results are stored face-major, one column per face and sum and one row per row of a face
+	const uint32_t passCount = SunPassCount;
+	const VkExtent2D extents[passCount] = { { 6u, sideLength }, { 1u, 1u }, { 6u * 3u, sideLength }, { 3u, 1u } };
+	const Shader shaders[passCount] = { Shader::SunRowPeaks, Shader::SunPeak, Shader::SunRowSums, Shader::SunLight };
+	const char* entryPoints[passCount] = { "sunRowPeaks", "sunPeak", "sunRowSums", "sunLight" };
+	const uint32_t lightPass = passCount - 1u;
 
-	if ((_cubemapResolution >> (outputMipLevels - 1)) < 1)
+	const VkPhysicalDeviceLimits& limits = _vulkan.getDeviceLimits();
+	for (uint32_t pass = 0u; pass < passCount; ++pass)
 	{
-		printf("Error: CubemapResolution incompatible with MipmapCount\n");
-		return Result::InvalidArgument;
+		if (std::max(extents[pass].width, extents[pass].height) > limits.maxImageDimension2D ||
+			extents[pass].width > limits.maxFramebufferWidth || extents[pass].height > limits.maxFramebufferHeight)
+		{
+			printf("Sun extraction needs %ux%u attachments, the device supports at most %ux%u\n", extents[pass].width, extents[pass].height,
+						 std::min(limits.maxImageDimension2D, limits.maxFramebufferWidth), std::min(limits.maxImageDimension2D, limits.maxFramebufferHeight));
+			return Result::InvalidArgument;
+		}
 	}
-	
-	VkSampler cubeMipMapSampler = VK_NULL_HANDLE;
-	{
-		VkSamplerCreateInfo samplerInfo{};
-		vulkan.fillSamplerCreateInfo(samplerInfo);
-		samplerInfo.maxLod = float(maxMipLevels + 1);
 
-		if (vulkan.createSampler(cubeMipMapSampler, samplerInfo) != VK_SUCCESS)
+	VkImage images[passCount] = {};
+	VkImageView views[passCount] = {};
+	for (uint32_t pass = 0u; pass < passCount; ++pass)
+	{
+		const VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | (pass == lightPass ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0u);
+		if (_vulkan.createImage2DAndAllocate(images[pass], extents[pass].width, extents[pass].height, SunFormat, usage) != VK_SUCCESS ||
+			_vulkan.createImageView(views[pass], images[pass]) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 	}
-	
-	VkImage inputCubeMap = VK_NULL_HANDLE;
-	VkImageLayout currentInputCubeMapLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-	//VK_IMAGE_USAGE_TRANSFER_SRC_BIT needed for transfer to staging buffer
-	if (vulkan.createImage2DAndAllocate(inputCubeMap, cubeMapSideLength, cubeMapSideLength, cubeMapFormat,
-																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-																			maxMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
-	
-	VkImageView inputCubeMapCompleteView = VK_NULL_HANDLE;
-	if (vulkan.createImageView(inputCubeMapCompleteView, inputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
+	VkImageView inputView = VK_NULL_HANDLE;
+	if (_vulkan.createImageView(inputView, _inputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, cubeMapInfo->mipLevels, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
-	
-	VkImage outputCubeMap = VK_NULL_HANDLE;
-	if (vulkan.createImage2DAndAllocate(outputCubeMap, cubeMapSideLength, cubeMapSideLength, cubeMapFormat,
-																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-																			outputMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
+
+	// the intermediate results are only read with texelFetch
+	VkSamplerCreateInfo samplerInfo{};
+	_vulkan.fillSamplerCreateInfo(samplerInfo);
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+	VkSampler sunSampler = VK_NULL_HANDLE;
+	if (_vulkan.createSampler(sunSampler, samplerInfo) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	std::vector< std::vector<VkImageView> > outputCubeMapViews(outputMipLevels);
-	for (uint32_t i = 0; i < outputMipLevels; ++i)
+	// set 0 is the input like for the filter passes, set 1 the intermediate results.
+	// every pass binds all of them, each image is only sampled by the passes after the one writing it
+	VkDescriptorSetLayout inputSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout sunSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSet inputSet = VK_NULL_HANDLE;
+	VkDescriptorSet sunSet = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
 	{
-		outputCubeMapViews[i].resize(6, VK_NULL_HANDLE); //sides of the cube
+		DescriptorSetInfo setLayout0;
+		setLayout0.addCombinedImageSampler(_cubeMapSampler, inputView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1u, VK_SHADER_STAGE_FRAGMENT_BIT);
 
-		for (uint32_t j = 0; j < 6; j++)
+		DescriptorSetInfo setLayout1;
+		for (uint32_t pass = 0u; pass < passCount; ++pass)
 		{
-			VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
-			subresourceRange.baseMipLevel = i;
-			subresourceRange.baseArrayLayer = j;
-			if (vulkan.createImageView(outputCubeMapViews[i][j], outputCubeMap, subresourceRange) != VK_SUCCESS)
-			{
-				return Result::VulkanError;
-			}
+			setLayout1.addCombinedImageSampler(sunSampler, views[pass], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 2u + pass, VK_SHADER_STAGE_FRAGMENT_BIT);
 		}
-	}
 
-	VkImageView outputCubeMapCompleteView = VK_NULL_HANDLE;
-	{
-		VkImageSubresourceRange subresourceRange{};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.baseArrayLayer = 0u;
-		subresourceRange.baseMipLevel = 0u;
-		subresourceRange.layerCount = 6u;
-		subresourceRange.levelCount = outputMipLevels;
+		if (setLayout0.create(_vulkan, inputSetLayout, inputSet) != VK_SUCCESS || setLayout1.create(_vulkan, sunSetLayout, sunSet) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		_vulkan.updateDescriptorSets(setLayout0.getWrites());
+		_vulkan.updateDescriptorSets(setLayout1.getWrites());
+
+		VkPushConstantRange range{};
+		range.offset = 0u;
+		range.size = sizeof(PushConstant);
+		range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		if (vulkan.createImageView(outputCubeMapCompleteView, outputCubeMap, subresourceRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
+		if (_vulkan.createPipelineLayout(pipelineLayout, { inputSetLayout, sunSetLayout }, { range }) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 	}
 
-	VkImage outputLUT = VK_NULL_HANDLE;
-	if (vulkan.createImage2DAndAllocate(outputLUT, cubeMapSideLength, cubeMapSideLength, LUTFormat,
-																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT /*| VK_IMAGE_USAGE_SAMPLED_BIT*/,
-																			1u, 1u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE) != VK_SUCCESS)
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkRenderPass removeRenderPass = VK_NULL_HANDLE;
 	{
-		return Result::VulkanError;
-	}
+		RenderPassDesc renderPassDesc;
+		renderPassDesc.addAttachment(SunFormat);
+
+		RenderPassDesc removeRenderPassDesc;
+		for (uint32_t face = 0; face < faceAttachmentCount; ++face)
+		{
+			removeRenderPassDesc.addAttachment(sunlessInfo->format);
+		}
+		if (multiview)
+		{
+			removeRenderPassDesc.setViewMask(CubeFaceViewMask);
+		}
+
+		if (_vulkan.createRenderPass(renderPass, renderPassDesc.getInfo()) != VK_SUCCESS ||
+			_vulkan.createRenderPass(removeRenderPass, removeRenderPassDesc.getInfo()) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	VkPipeline pipelines[passCount] = {};
+	VkFramebuffer framebuffers[passCount] = {};
+	for (uint32_t pass = 0u; pass < passCount; ++pass)
+	{
+		VkShaderModule fragmentShader = VK_NULL_HANDLE;
+		if ((res = loadShader(_vulkan, shaders[pass], fragmentShader)) != Result::Success)
+		{
+			return res;
+		}
+
+		GraphicsPipelineDesc pipelineDesc;
+		pipelineDesc.addShaderStage(_fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
+		pipelineDesc.addShaderStage(fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, entryPoints[pass]);
+		pipelineDesc.setRenderPass(renderPass);
+		pipelineDesc.setPipelineLayout(pipelineLayout);
+		pipelineDesc.addColorBlendAttachment(colorBlendAttachment, 1u);
+		pipelineDesc.setViewportExtent(extents[pass]);
+
+		if (_vulkan.createPipeline(pipelines[pass], pipelineDesc.getInfo()) != VK_SUCCESS ||
+			_vulkan.createFramebuffer(framebuffers[pass], renderPass, extents[pass].width, extents[pass].height, { views[pass] }) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+
+	VkPipeline removePipeline = VK_NULL_HANDLE;
+	{
+		VkShaderModule fragmentShader = VK_NULL_HANDLE;
+		if ((res = loadShader(_vulkan, multiview ? Shader::RemoveSunMultiview : Shader::RemoveSun, fragmentShader)) != Result::Success)
+		{
+			return res;
+		}
+
+		GraphicsPipelineDesc pipelineDesc;
+		pipelineDesc.addShaderStage(_fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
+		pipelineDesc.addShaderStage(fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "removeSun");
+		pipelineDesc.setRenderPass(removeRenderPass);
+		pipelineDesc.setPipelineLayout(pipelineLayout);
+		pipelineDesc.addColorBlendAttachment(colorBlendAttachment, faceAttachmentCount);
+		pipelineDesc.setViewportExtent(VkExtent2D{ sideLength, sideLength });
+
+		if (_vulkan.createPipeline(removePipeline, pipelineDesc.getInfo()) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+
+	std::vector<VkImageView> sunlessViews(faceAttachmentCount, VK_NULL_HANDLE);
+	if (multiview)
+	{
+		if (_vulkan.createImageView(sunlessViews.front(), _sunlessCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D_ARRAY) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+	else
+	{
+		for (uint32_t face = 0u; face < faceAttachmentCount; ++face)
+		{
+			if (_vulkan.createImageView(sunlessViews[face], _sunlessCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, face, 1u }) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+		}
+	}
+
+	VkFramebuffer removeFramebuffer = VK_NULL_HANDLE;
+	if (_vulkan.createFramebuffer(removeFramebuffer, removeRenderPass, sideLength, sideLength, sunlessViews, 1u) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	// the light is read on the host after the graphics submission
+	const VkDeviceSize lightByteSize = extents[lightPass].width * 4u * sizeof(float);
+	if (createReadbackBuffer(_vulkan, _outLightBuffer, lightByteSize) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	PushConstant values{};
+	values.width = sideLength;
+
+	_vulkan.bindDescriptorSets(_commandBuffer, pipelineLayout, { inputSet, sunSet });
+	vkCmdPushConstants(_commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant), &values);
+
+	const std::vector<VkClearValue> clearValues(faceAttachmentCount, { 0.0f, 0.0f, 0.0f, 0.0f });
+
+	for (uint32_t pass = 0u; pass < passCount; ++pass)
+	{
+		_vulkan.imageBarrier(_commandBuffer, images[pass],
+												 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+												 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u,
+												 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+		vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[pass]);
+		_vulkan.beginRenderPass(_commandBuffer, renderPass, framebuffers[pass], VkRect2D{ 0u, 0u, extents[pass].width, extents[pass].height }, clearValues);
+		vkCmdDraw(_commandBuffer, 3, 1u, 0, 0);
+		_vulkan.endRenderPass(_commandBuffer);
+
+		_vulkan.imageBarrier(_commandBuffer, images[pass],
+												 VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+												 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+												 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+
+	// the mip chain is generated from level 0 afterwards
+	_vulkan.imageBarrier(_commandBuffer, _sunlessCubeMap,
+											 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+											 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u,
+											 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+											 { VK_IMAGE_ASPECT_COLOR_BIT, 0u, sunlessInfo->mipLevels, 0u, 6u });
+
+	vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, removePipeline);
+	_vulkan.beginRenderPass(_commandBuffer, removeRenderPass, removeFramebuffer, VkRect2D{ 0u, 0u, sideLength, sideLength }, clearValues);
+	vkCmdDraw(_commandBuffer, 3, 1u, 0, 0);
+	_vulkan.endRenderPass(_commandBuffer);
+
+	_vulkan.imageBarrier(_commandBuffer, images[lightPass],
+											 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+											 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+											 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+	_vulkan.copyImage2DToBuffer(_commandBuffer, images[lightPass], _outLightBuffer);
+	_vulkan.transitionBufferToHostRead(_commandBuffer, _outLightBuffer);
+
+	return res;
+}
+
+// a submitted job, its resources belong to a scope of the vkHelper it was submitted to
+struct PendingJob
+{
+	uint32_t scope = 0u;
+	const char* outputPathCubeMap = nullptr;
+	const char* outputPathLUT = nullptr;
+	bool debugOutput = false;
+	SampleOptions options;
+	double* outFilterMilliseconds = nullptr;
+	bool hierarchical = false;
+
+	VkCommandBuffer cubeMapCmd = VK_NULL_HANDLE;
+	VkCommandBuffer downloadCmd = VK_NULL_HANDLE;
+	VkSemaphore filterSemaphore = VK_NULL_HANDLE;
+	SubmissionTicket uploadTicket;
+	SubmissionTicket filterTicket;
+	SubmissionTicket downloadTicket;
+	std::vector<VkBuffer> inputStagingBuffers;
+
+	VkQueryPool timestampPool = VK_NULL_HANDLE;
+	VkBuffer sunLightBuffer = VK_NULL_HANDLE;
+	VkImage outputLUT = VK_NULL_HANDLE;
+	VkBuffer LUTStagingBuffer = VK_NULL_HANDLE;
+	VkImage convertedCubeMap = VK_NULL_HANDLE;
+	// the output is streamed level by level, the ktx image only describes its layout
+	std::unique_ptr<KtxImage> ktxImage;
+
+	// the prepared input cube map is added to the cache on a miss
+	FileCache cubeMapCache;
+	uint64_t cacheKey = 0u;
+	bool cacheMiss = false;
+	VkImage inputCubeMap = VK_NULL_HANDLE;
+	VkFormat cubeMapFormat = VK_FORMAT_UNDEFINED;
+	uint32_t inputSideLength = 0u;
+	uint32_t maxMipLevels = 0u;
+
+	std::chrono::steady_clock::time_point recordStart;
+	std::chrono::steady_clock::time_point executeStart;
+	bool uploadOverlapped = false;
+};
+
+// records a job and submits its upload and filter passes, _vulkan is initialized by the first job.
+// the resources of the job belong to a new scope, _outJob stays empty if the outputs are up to date.
+// _outFilterMilliseconds receives the GPU time of the filter passes
+Result submitJob(vkHelper& _vulkan, const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput, const SampleOptions& _options, double* _outFilterMilliseconds, std::unique_ptr<PendingJob>& _outJob);
+
+// submits the readback of _job and writes its outputs, the readback overlaps with filter passes submitted since
+Result finishJob(vkHelper& _vulkan, PendingJob& _job);
+
+// waits for the submissions of _job, also after a failure, and releases its scope
+void releaseJob(vkHelper& _vulkan, PendingJob& _job);
+
+Result sampleCubeMap(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput, const SampleOptions& _options, double* _outFilterMilliseconds);
+
+// texel _index of a mapped KTX2 image as linear RGB
+bool loadTexel(const uint8_t* _data, VkFormat _format, size_t _index, float _outRgb[3])
+{
+	switch (_format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:
+		for (uint32_t c = 0u; c < 3u; ++c)
+		{
+			_outRgb[c] = _data[_index * 4u + c] / 255.f;
+		}
+		return true;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		for (uint32_t c = 0u; c < 3u; ++c)
+		{
+			uint16_t half = 0u;
+			memcpy(&half, _data + (_index * 4u + c) * sizeof(uint16_t), sizeof(uint16_t));
+			_outRgb[c] = halfToFloat(half);
+		}
+		return true;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		memcpy(_outRgb, _data + _index * 4u * sizeof(float), 3u * sizeof(float));
+		return true;
+	default:
+		return false;
+	}
+}
+
+// prints the error of every level of _testPath relative to _referencePath, _outRmse receives the error of all levels
+Result compareCubeMaps(const char* _referencePath, const char* _testPath, double& _outRmse)
+{
+	KtxImage reference;
+	KtxImage test;
+
+	Result res = Success;
+	if ((res = reference.loadKtx2(_referencePath)) != Success || (res = test.loadKtx2(_testPath)) != Success)
+	{
+		return res;
+	}
+
+	if (reference.getWidth() != test.getWidth() || reference.getLevels() != test.getLevels() || reference.getFormat() != test.getFormat() ||
+		reference.isCubeMap() == false || test.isCubeMap() == false)
+	{
+		printf("Cube maps %s and %s differ in layout\n", _referencePath, _testPath);
+		return Result::InvalidArgument;
+	}
+
+	double totalSquaredError = 0.0;
+	double totalReference = 0.0;
+	double totalMaxError = 0.0;
+	size_t totalCount = 0u;
+
+	for (uint32_t level = 0u; level < reference.getLevels(); ++level)
+	{
+		const uint32_t side = std::max(reference.getWidth() >> level, 1u);
+		const size_t texelCount = static_cast<size_t>(side) * side;
+
+		double squaredError = 0.0;
+		double referenceSum = 0.0;
+		double maxError = 0.0;
+
+		for (uint32_t face = 0u; face < 6u; ++face)
+		{
+			const uint8_t* referenceData = reference.getMappedImageData(level, face);
+			const uint8_t* testData = test.getMappedImageData(level, face);
+			if (referenceData == nullptr || testData == nullptr)
+			{
+				return Result::KtxError;
+			}
+
+			for (size_t i = 0u; i < texelCount; ++i)
+			{
+				float referenceRgb[3];
+				float testRgb[3];
+				if (loadTexel(referenceData, reference.getFormat(), i, referenceRgb) == false || loadTexel(testData, test.getFormat(), i, testRgb) == false)
+				{
+					printf("Unsupported cube map format for comparison\n");
+					return Result::InvalidArgument;
+				}
+
+				for (uint32_t c = 0u; c < 3u; ++c)
+				{
+					const double error = fabs(static_cast<double>(testRgb[c]) - referenceRgb[c]);
+					squaredError += error * error;
+					referenceSum += referenceRgb[c];
+					maxError = std::max(maxError, error);
+				}
+			}
+		}
+
+		const size_t count = texelCount * 6u * 3u;
+		const double rmse = sqrt(squaredError / count);
+		const double mean = referenceSum / count;
+		printf("Level %u (%ux%u): RMSE %.6f (%.3f%% of mean %.6f), max error %.6f\n", level, side, side, rmse, mean > 0.0 ? 100.0 * rmse / mean : 0.0, mean, maxError);
+
+		totalSquaredError += squaredError;
+		totalReference += referenceSum;
+		totalMaxError = std::max(totalMaxError, maxError);
+		totalCount += count;
+	}
+
+	const double rmse = sqrt(totalSquaredError / totalCount);
+	const double mean = totalReference / totalCount;
+	printf("All levels: RMSE %.6f (%.3f%% of mean %.6f), max error %.6f\n", rmse, mean > 0.0 ? 100.0 * rmse / mean : 0.0, mean, totalMaxError);
+
+	_outRmse = rmse;
+	return Success;
+}
+
+// _path with _suffix inserted before the extension
+std::string getSiblingPath(const char* _path, const char* _suffix)
+{
+	std::string path(_path);
+	const size_t extension = path.find_last_of('.');
+	const size_t separator = path.find_last_of("/\\");
+	if (extension != std::string::npos && (separator == std::string::npos || extension > separator))
+	{
+		path.insert(extension, _suffix);
+	}
+	else
+	{
+		path += std::string(_suffix) + ".ktx2";
+	}
+	return path;
+}
+
+// samples brute force next to the output for reference, then with the selected fast filtering to the output and compares both.
+// with a different reference sample count brute force with the output's sample count is compared to the reference as well
+Result compareFiltering(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput, const SampleOptions& _options)
+{
+	// all runs have to filter, a skipped one has no timing
+	SampleOptions options = _options;
+	options.compareFiltering = false;
+	options.force = true;
+
+	SampleOptions bruteForceOptions = options;
+	bruteForceOptions.hierarchicalFiltering = false;
+	bruteForceOptions.multipleImportanceSampling = false;
+	// the statistics describe the output
+	bruteForceOptions.statistics = nullptr;
+
+	// hierarchical filtering is compared unless another mode is selected
+	if (options.hierarchicalFiltering == false && options.multipleImportanceSampling == false)
+	{
+		options.hierarchicalFiltering = true;
+	}
+	const char* mode = options.hierarchicalFiltering ? (options.multipleImportanceSampling ? "hierarchical with light sampling" : "hierarchical") : "light sampling";
+
+	const unsigned int referenceSampleCount = _options.referenceSampleCount != 0u ? _options.referenceSampleCount : _sampleCount;
+	const bool baseline = referenceSampleCount != _sampleCount;
+	const std::string referencePath = getSiblingPath(_outputPathCubeMap, ".reference");
+	const std::string baselinePath = getSiblingPath(_outputPathCubeMap, ".baseline");
+
+	Result res = Success;
+	double bruteForceMilliseconds = 0.0;
+	double testMilliseconds = 0.0;
+
+	if ((res = sampleCubeMap(_inputPath, referencePath.c_str(), nullptr, _distribution, _cubemapResolution, _mipmapCount, referenceSampleCount, _targetFormat, _lodBias, _debugOutput, bruteForceOptions, &bruteForceMilliseconds)) != Success)
+	{
+		return res;
+	}
+
+	if (baseline &&
+		(res = sampleCubeMap(_inputPath, baselinePath.c_str(), nullptr, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias, _debugOutput, bruteForceOptions, &bruteForceMilliseconds)) != Success)
+	{
+		return res;
+	}
+
+	if ((res = sampleCubeMap(_inputPath, _outputPathCubeMap, _outputPathLUT, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias, _debugOutput, options, &testMilliseconds)) != Success)
+	{
+		return res;
+	}
+
+	double bruteForceRmse = 0.0;
+	if (baseline)
+	{
+		printf("Comparing brute force with %u samples %s to the reference with %u samples %s\n", _sampleCount, baselinePath.c_str(), referenceSampleCount, referencePath.c_str());
+		if ((res = compareCubeMaps(referencePath.c_str(), baselinePath.c_str(), bruteForceRmse)) != Success)
+		{
+			return res;
+		}
+	}
+
+	double testRmse = 0.0;
+	printf("Comparing %s with %u samples %s to the brute force reference with %u samples %s\n", mode, _sampleCount, _outputPathCubeMap, referenceSampleCount, referencePath.c_str());
+	if ((res = compareCubeMaps(referencePath.c_str(), _outputPathCubeMap, testRmse)) != Success)
+	{
+		return res;
+	}
+
+	printf("Filtering with %u samples: brute force %.2f ms, %s %.2f ms (%.2fx faster)\n", _sampleCount, bruteForceMilliseconds, mode, testMilliseconds,
+				 testMilliseconds > 0.0 ? bruteForceMilliseconds / testMilliseconds : 0.0);
+
+	// noise falls with the square root of the sample count and the filter time grows linearly with it,
+	// so brute force needs (bruteForceRmse / testRmse)^2 times the samples for the error of the fast mode
+	if (baseline && testRmse > 0.0)
+	{
+		const double sampleFactor = (bruteForceRmse / testRmse) * (bruteForceRmse / testRmse);
+		printf("Equal quality: brute force needs about %.0f samples, %.2fx the time of %s\n", sampleFactor * _sampleCount,
+					 testMilliseconds > 0.0 ? sampleFactor * bruteForceMilliseconds / testMilliseconds : 0.0, mode);
+	}
+
+	return Success;
+}
+} // !IBLLib
+
+
+IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput)
+{
+	return sample(_inputPath, _outputPathCubeMap, _outputPathLUT, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias, _debugOutput, SampleOptions{});
+}
+
+IBLLib::Result IBLLib::flushOutputs()
+{
+	return OutputWriter::getShared().flush();
+}
+
+IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput, const SampleOptions& _options)
+{
+	if (_options.compareFiltering)
+	{
+		return compareFiltering(_inputPath, _outputPathCubeMap, _outputPathLUT, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias, _debugOutput, _options);
+	}
+
+	return sampleCubeMap(_inputPath, _outputPathCubeMap, _outputPathLUT, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias, _debugOutput, _options, nullptr);
+}
+
+IBLLib::Result IBLLib::submitJob(vkHelper& _vulkan, const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput, const SampleOptions& _options, double* _outFilterMilliseconds, std::unique_ptr<PendingJob>& _outJob)
+{
+	const VkFormat cubeMapFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+	const VkFormat LUTFormat = getLUTFormat(_outputPathLUT != nullptr ? getLUTOutput(_outputPathLUT) : LUTOutput::PNG);
+
+	IBLLib::Result res = Result::Success;
+
+	// the input is hashed once for the job check and the cube map cache
+	uint64_t inputHash = 0u;
+	const bool inputHashed = (_options.force == false || _options.cacheDirectory != nullptr) && hashFile(_inputPath, inputHash);
+
+	// the other distributions are not closed under convolution, they are always sampled from the input
+	const bool hierarchical = _options.hierarchicalFiltering && _distribution == Distribution::GGX;
+	if (_options.hierarchicalFiltering && hierarchical == false)
+	{
+		printf("Hierarchical filtering only applies to GGX, sampling every level from the input\n");
+	}
+
+	const bool lightSampling = _options.multipleImportanceSampling;
+
+	const uint64_t jobHash = computeJobHash(inputHash, _outputPathLUT != nullptr, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias, hierarchical, lightSampling, _options.extractSun);
+	if (_options.force == false && inputHashed && isOutputUpToDate(_outputPathCubeMap, _outputPathLUT, jobHash))
+	{
+		printf("%s is up to date, skipping (force sampling with -force)\n", _outputPathCubeMap);
+
+		// the extracted light is stored with the output
+		std::string storedLight;
+		if (_options.statistics != nullptr)
+		{
+			_options.statistics->light = ExtractedLight();
+			if (_options.extractSun && KtxImage::readMetadata(_outputPathCubeMap, LightKey, storedLight))
+			{
+				parseLight(storedLight, _options.statistics->light);
+			}
+		}
+
+		return Result::Success;
+	}
+
+	if (_vulkan.isInitialized() == false && _vulkan.initialize(0u, _debugOutput, _options.pipelineCacheDirectory) != VK_SUCCESS)
+	{
+		return Result::VulkanInitializationFailed;
+	}
+
+	_outJob.reset(new PendingJob());
+	PendingJob& job = *_outJob;
+	job.scope = _vulkan.createScope();
+	job.outputPathCubeMap = _outputPathCubeMap;
+	job.outputPathLUT = _outputPathLUT;
+	job.debugOutput = _debugOutput;
+	job.options = _options;
+	job.outFilterMilliseconds = _outFilterMilliseconds;
+	job.hierarchical = hierarchical;
+	job.cubeMapFormat = cubeMapFormat;
+	job.recordStart = std::chrono::steady_clock::now();
+
+	_vulkan.setScope(job.scope);
+
+	// upload and readback run on the transfer queue, filtering on the graphics queue.
+	// each stage is submitted once and chained to the previous one with a semaphore
+	if (_vulkan.createCommandBuffer(job.cubeMapCmd, VK_COMMAND_BUFFER_LEVEL_PRIMARY, QueueType::Graphics) != VK_SUCCESS ||
+		_vulkan.createCommandBuffer(job.downloadCmd, VK_COMMAND_BUFFER_LEVEL_PRIMARY, QueueType::Transfer) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+	const VkCommandBuffer cubeMapCmd = job.cubeMapCmd;
+	const VkCommandBuffer downloadCmd = job.downloadCmd;
+
+	VkSemaphore uploadSemaphore = VK_NULL_HANDLE;
+	if (_vulkan.createSemaphore(uploadSemaphore) != VK_SUCCESS || _vulkan.createSemaphore(job.filterSemaphore) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (_vulkan.beginCommandBuffers({ cubeMapCmd, downloadCmd }, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	// KTX2 cube maps are uploaded as they are and skip the panorama conversion, only missing mip levels are generated
+	const bool inputIsCubeMap = isKtx2File(_inputPath);
+
+	// panoramas that were converted before with the same resolution are loaded from the cache as mipmapped cube maps
+	FileCache& cubeMapCache = job.cubeMapCache;
+	uint64_t& cacheKey = job.cacheKey;
+	bool& cacheMiss = job.cacheMiss;
+	std::string cachedCubeMapPath;
+
+	if (inputIsCubeMap == false && inputHashed && _options.cacheDirectory != nullptr && cubeMapCache.open(_options.cacheDirectory, _options.cacheSizeLimit))
+	{
+		// bump the version whenever the conversion or the mip generation changes
+		const uint64_t cacheVersion = 1u;
+
+		cacheKey = hashCombine(inputHash, _cubemapResolution);
+		cacheKey = hashCombine(cacheKey, cubeMapFormat);
+		cacheKey = hashCombine(cacheKey, cacheVersion);
+
+		cacheMiss = cubeMapCache.lookup(cacheKey, cachedCubeMapPath) == false;
+		printf("Cube map cache %s\n", cacheMiss ? "miss" : "hit");
+	}
+
+	const bool loadCubeMap = inputIsCubeMap || cachedCubeMapPath.empty() == false;
+
+	// the copies of the last strips overlap with shader compilation and recording of the filter passes
+	VkImage panoramaImage = VK_NULL_HANDLE;
+	PanoramaFormat panoramaFormat = PanoramaFormat::Float32;
+	VkImage inputCubeMap = VK_NULL_HANDLE;
+	uint32_t inputCubeMapLoadedLevels = 0u;
+	std::vector<VkBuffer>& inputStagingBuffers = job.inputStagingBuffers;
+	SubmissionTicket& uploadTicket = job.uploadTicket;
+
+	if (loadCubeMap)
+	{
+		KtxImage inputKtxImage;
+		if ((res = inputKtxImage.loadKtx2(inputIsCubeMap ? _inputPath : cachedCubeMapPath.c_str())) != Result::Success ||
+			(res = uploadCubeMap(_vulkan, cubeMapCmd, inputKtxImage, uploadSemaphore, inputCubeMap, inputCubeMapLoadedLevels, inputStagingBuffers, uploadTicket)) != Result::Success)
+		{
+			return res;
+		}
+	}
+	else if ((res = uploadImage(_vulkan, cubeMapCmd, _inputPath, uploadSemaphore, panoramaImage, panoramaFormat, inputStagingBuffers, uploadTicket)) != Result::Success)
+	{
+		return res;
+	}
+
+#if defined(IBLSAMPLER_RUNTIME_SHADER_COMPILER)
+	// compiled SPIR-V is kept next to the cube maps, warm runs skip glslang
+	if (_options.cacheDirectory != nullptr && createDirectory(_options.cacheDirectory))
+	{
+		ShaderCompiler::instance().setCacheDirectory((std::string(_options.cacheDirectory) + "/shaders").c_str());
+	}
+#endif
+
+	VkShaderModule fullscreenVertexShader = VK_NULL_HANDLE;
+	if ((res = loadShader(_vulkan, Shader::FullscreenVertex, fullscreenVertexShader)) != Result::Success)
+	{
+		return res;
+	}
+
+	// with multiview each filter invocation computes one face and the LUT is rendered in a pass of its own
+	const bool multiview = _vulkan.isMultiviewEnabled();
+	const uint32_t faceAttachmentCount = multiview ? 1u : 6u;
+
+	if (_debugOutput)
+	{
+		printf("Rendering cube map faces with %s\n", multiview ? "multiview" : "six color attachments");
+	}
+
+	const Shader filterShader = lightSampling ?
+		(multiview ? Shader::FilterCubeMapLightSampledMultiview : Shader::FilterCubeMapLightSampled) :
+		(multiview ? Shader::FilterCubeMapMultiview : Shader::FilterCubeMap);
+
+	VkShaderModule filterCubeMapFragmentShader = VK_NULL_HANDLE;
+	if ((res = loadShader(_vulkan, filterShader, filterCubeMapFragmentShader)) != Result::Success)
+	{
+		return res;
+	}
+
+	const VkExtent3D inputExtent = _vulkan.getCreateInfo(loadCubeMap ? inputCubeMap : panoramaImage)->extent;
+	// it is best to sample an nxn cube map from a 4nx2n equirectangular image, e.g. a 1024x512 equirectangular images becomes a 256x256 cube map.
+	// cube map inputs are filtered to their own resolution by default
+	_cubemapResolution = _cubemapResolution != 0 ? _cubemapResolution : (loadCubeMap ? inputExtent.width : inputExtent.height / 2);
+	_mipmapCount = _mipmapCount != 0 ? _mipmapCount : static_cast<uint32_t>(floor(log2(_cubemapResolution)));
+
+	const uint32_t cubeMapSideLength = _cubemapResolution;
+	const uint32_t outputMipLevels = _distribution == Distribution::Lambertian ? 1u : _mipmapCount;
+
+	// resolution of the cube map that is filtered, the sample lod depends on it
+	const uint32_t inputSideLength = loadCubeMap ? inputExtent.width : cubeMapSideLength;
+
+	uint32_t maxMipLevels = 0u;
+	for (uint32_t m = inputSideLength; m > 0; m = m >> 1, ++maxMipLevels) {}
+
+	if ((_cubemapResolution >> (outputMipLevels - 1)) < 1)
+	{
+		printf("Error: CubemapResolution incompatible with MipmapCount\n");
+		return Result::InvalidArgument;
+	}
+
+	// every pass allocates its descriptor sets from the pool, all of them bind combined image samplers only
+	{
+		// the filter input
+		uint32_t setCount = 1u;
+		uint32_t samplerCount = 1u;
+
+		// the panorama
+		if (loadCubeMap == false)
+		{
+			setCount += 1u;
+			samplerCount += 1u;
+		}
+
+		// the input cube map and the targets of the sun passes
+		if (_options.extractSun)
+		{
+			setCount += 2u;
+			samplerCount += 1u + SunPassCount;
+		}
+
+		// the CDF and its marginal
+		if (lightSampling)
+		{
+			setCount += 1u;
+			samplerCount += 2u;
+		}
+
+		// the levels filtered from their predecessor share one source pyramid, each one samples it through a view of its own
+		if (hierarchical && outputMipLevels > 2u)
+		{
+			setCount += outputMipLevels - 2u;
+			samplerCount += outputMipLevels - 2u;
+		}
+
+		if (_vulkan.createDescriptorPool(setCount, samplerCount) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+	
+	VkSampler cubeMipMapSampler = VK_NULL_HANDLE;
+	{
+		VkSamplerCreateInfo samplerInfo{};
+		_vulkan.fillSamplerCreateInfo(samplerInfo);
+		samplerInfo.maxLod = float(maxMipLevels + 1);
+
+		if (_vulkan.createSampler(cubeMipMapSampler, samplerInfo) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+	
+	VkImageLayout currentInputCubeMapLayout = loadCubeMap ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+
+	//VK_IMAGE_USAGE_TRANSFER_SRC_BIT needed for transfer to staging buffer
+	if (loadCubeMap == false &&
+		_vulkan.createImage2DAndAllocate(inputCubeMap, cubeMapSideLength, cubeMapSideLength, cubeMapFormat,
+																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+																			maxMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+	
+	VkImageView inputCubeMapCompleteView = VK_NULL_HANDLE;
+	if (_vulkan.createImageView(inputCubeMapCompleteView, inputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	// with sun extraction the filter passes sample a copy of the input without the sun, the input itself is cached unchanged
+	VkImage sunlessCubeMap = VK_NULL_HANDLE;
+	VkImageView filterSourceView = inputCubeMapCompleteView;
+	if (_options.extractSun)
+	{
+		if (_vulkan.createImage2DAndAllocate(sunlessCubeMap, inputSideLength, inputSideLength, cubeMapFormat,
+																				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+																				maxMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS ||
+			_vulkan.createImageView(filterSourceView, sunlessCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+	
+	VkImage outputCubeMap = VK_NULL_HANDLE;
+	if (_vulkan.createImage2DAndAllocate(outputCubeMap, cubeMapSideLength, cubeMapSideLength, cubeMapFormat,
+																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+																			outputMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	std::vector< std::vector<VkImageView> > outputCubeMapViews(outputMipLevels);
+	for (uint32_t i = 0; i < outputMipLevels; ++i)
+	{
+		outputCubeMapViews[i].resize(faceAttachmentCount, VK_NULL_HANDLE); //sides of the cube, or all sides as layers for multiview
+
+		if (multiview)
+		{
+			if (_vulkan.createImageView(outputCubeMapViews[i].front(), outputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, i, 1u, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D_ARRAY) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+			continue;
+		}
+
+		for (uint32_t j = 0; j < 6; j++)
+		{
+			VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
+			subresourceRange.baseMipLevel = i;
+			subresourceRange.baseArrayLayer = j;
+			if (_vulkan.createImageView(outputCubeMapViews[i][j], outputCubeMap, subresourceRange) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+		}
+	}
+
+	VkImageView outputCubeMapCompleteView = VK_NULL_HANDLE;
+	{
+		VkImageSubresourceRange subresourceRange{};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.baseArrayLayer = 0u;
+		subresourceRange.baseMipLevel = 0u;
+		subresourceRange.layerCount = 6u;
+		subresourceRange.levelCount = outputMipLevels;
+
+		if (_vulkan.createImageView(outputCubeMapCompleteView, outputCubeMap, subresourceRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+
+	VkImage outputLUT = VK_NULL_HANDLE;
+	if (_vulkan.createImage2DAndAllocate(outputLUT, cubeMapSideLength, cubeMapSideLength, LUTFormat,
+																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT /*| VK_IMAGE_USAGE_SAMPLED_BIT*/,
+																			1u, 1u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
 
 	VkImageView outputLUTView = VK_NULL_HANDLE;
 	{
@@ -813,7 +2467,7 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 		subresourceRange.layerCount = 1u;
 		subresourceRange.levelCount = 1u;
 
-		if (vulkan.createImageView(outputLUTView, outputLUT, subresourceRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D) != VK_SUCCESS)
+		if (_vulkan.createImageView(outputLUTView, outputLUT, subresourceRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
@@ -824,29 +2478,103 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 		RenderPassDesc renderPassDesc;
 
 		// add rendertargets (cubemap faces)
-		for (int face = 0; face < 6; ++face)
+		for (uint32_t face = 0; face < faceAttachmentCount; ++face)
 		{
 			renderPassDesc.addAttachment(cubeMapFormat);
 		}
 
-		renderPassDesc.addAttachment(LUTFormat);		
+		if (multiview)
+		{
+			renderPassDesc.setViewMask(CubeFaceViewMask);
+		}
+		else
+		{
+			renderPassDesc.addAttachment(LUTFormat);
+		}
 
-		if (vulkan.createRenderPass(renderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
+		if (_vulkan.createRenderPass(renderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 	}
 
-	//Push Constants for specular and diffuse filter passes
-	struct PushConstant
+	// all attachments of a multiview pass are layered, the LUT is rendered separately
+	VkRenderPass lutRenderPass = VK_NULL_HANDLE;
+	if (multiview)
 	{
-		float roughness = 0.f;
-		uint32_t sampleCount = 1u;
-		uint32_t mipLevel = 1u;
-		uint32_t width = 1024u;
-		float lodBias = 0.f;
-		Distribution distribution = Distribution::Lambertian;
-	};
+		RenderPassDesc renderPassDesc;
+		renderPassDesc.addAttachment(LUTFormat);
+
+		if (_vulkan.createRenderPass(lutRenderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////
+	// Light CDF
+	// prefix sums of luminance times solid angle of an input level, light samples are drawn from it
+	uint32_t lightCdfLevel = 0u;
+	while ((inputSideLength >> lightCdfLevel) > LightCdfMaxSide)
+	{
+		++lightCdfLevel;
+	}
+	const uint32_t lightCdfSide = inputSideLength >> lightCdfLevel;
+
+	VkImage lightCdf = VK_NULL_HANDLE;
+	VkImage lightMarginal = VK_NULL_HANDLE;
+	VkImageView lightCdfView = VK_NULL_HANDLE;
+	VkImageView lightMarginalView = VK_NULL_HANDLE;
+	VkDescriptorSetLayout lightSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSet lightDescriptorSet = VK_NULL_HANDLE;
+	if (lightSampling)
+	{
+		// faces are stacked vertically, the marginal is a single column
+		if (_vulkan.createImage2DAndAllocate(lightCdf, lightCdfSide, 6u * lightCdfSide, LightCdfFormat,
+																				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT) != VK_SUCCESS ||
+			_vulkan.createImage2DAndAllocate(lightMarginal, 1u, 6u * lightCdfSide, LightCdfFormat,
+																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		if (_vulkan.createImageView(lightCdfView, lightCdf) != VK_SUCCESS || _vulkan.createImageView(lightMarginalView, lightMarginal) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		// the CDF is only read with texelFetch
+		VkSamplerCreateInfo samplerInfo{};
+		_vulkan.fillSamplerCreateInfo(samplerInfo);
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+		VkSampler lightCdfSampler = VK_NULL_HANDLE;
+		if (_vulkan.createSampler(lightCdfSampler, samplerInfo) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		DescriptorSetInfo setLayout1;
+		setLayout1.addCombinedImageSampler(lightCdfSampler, lightCdfView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0u, VK_SHADER_STAGE_FRAGMENT_BIT);
+		setLayout1.addCombinedImageSampler(lightCdfSampler, lightMarginalView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1u, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+		if (setLayout1.create(_vulkan, lightSetLayout, lightDescriptorSet) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		_vulkan.updateDescriptorSets(setLayout1.getWrites());
+
+		if (_debugOutput)
+		{
+			printf("Light CDF of %ux%u per face from input level %u\n", lightCdfSide, lightCdfSide, lightCdfLevel);
+		}
+	}
 
 	std::vector<VkPushConstantRange> ranges(1u);
 	VkPushConstantRange& range = ranges.front();
@@ -863,41 +2591,140 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 	{
 		DescriptorSetInfo setLayout0;
 		uint32_t binding = 1u;
-		setLayout0.addCombinedImageSampler(cubeMipMapSampler, inputCubeMapCompleteView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, binding, VK_SHADER_STAGE_FRAGMENT_BIT); // change sampler ?
+		setLayout0.addCombinedImageSampler(cubeMipMapSampler, filterSourceView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, binding, VK_SHADER_STAGE_FRAGMENT_BIT); // change sampler ?
+
+		VkDescriptorSetLayout filterSetLayout = VK_NULL_HANDLE;
+		if (setLayout0.create(_vulkan, filterSetLayout, filterDescriptorSet) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		_vulkan.updateDescriptorSets(setLayout0.getWrites());
+
+		// the light CDF is set 1
+		std::vector<VkDescriptorSetLayout> setLayouts = { filterSetLayout };
+		if (lightSampling)
+		{
+			setLayouts.push_back(lightSetLayout);
+		}
+
+		if (_vulkan.createPipelineLayout(filterPipelineLayout, setLayouts, ranges) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		GraphicsPipelineDesc filterCubeMapPipelineDesc;
+
+		filterCubeMapPipelineDesc.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
+		filterCubeMapPipelineDesc.addShaderStage(filterCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, lightSampling ? "filterCubeMapLightSampled" : "filterCubeMap");
+
+		filterCubeMapPipelineDesc.setRenderPass(renderPass);
+		filterCubeMapPipelineDesc.setPipelineLayout(filterPipelineLayout);
+
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT; // TODO: rgb only
+		colorBlendAttachment.blendEnable = VK_FALSE;
+
+		filterCubeMapPipelineDesc.addColorBlendAttachment(colorBlendAttachment, faceAttachmentCount);
+
+		if (multiview == false)
+		{
+			//colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT;
+			filterCubeMapPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 1u);
+		}
+
+		filterCubeMapPipelineDesc.setViewportExtent(VkExtent2D{ cubeMapSideLength, cubeMapSideLength });
+
+		if (_vulkan.createPipeline(filterPipeline, filterCubeMapPipelineDesc.getInfo()) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+
+	// same layout and push constants as the filter pipeline
+	VkPipeline lutPipeline = VK_NULL_HANDLE;
+	if (multiview)
+	{
+		VkShaderModule lutFragmentShader = VK_NULL_HANDLE;
+		if ((res = loadShader(_vulkan, Shader::LUTMultiview, lutFragmentShader)) != Result::Success)
+		{
+			return res;
+		}
+
+		GraphicsPipelineDesc lutPipelineDesc;
+
+		lutPipelineDesc.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
+		lutPipelineDesc.addShaderStage(lutFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "computeLUT");
+
+		lutPipelineDesc.setRenderPass(lutRenderPass);
+		lutPipelineDesc.setPipelineLayout(filterPipelineLayout);
+
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		colorBlendAttachment.blendEnable = VK_FALSE;
+
+		lutPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 1u);
+
+		lutPipelineDesc.setViewportExtent(VkExtent2D{ cubeMapSideLength, cubeMapSideLength });
 
-		VkDescriptorSetLayout filterSetLayout = VK_NULL_HANDLE;
-		if (setLayout0.create(vulkan, filterSetLayout, filterDescriptorSet) != VK_SUCCESS)
+		if (_vulkan.createPipeline(lutPipeline, lutPipelineDesc.getInfo()) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
+	}
 
-		vulkan.updateDescriptorSets(setLayout0.getWrites());
+	// the row and marginal scans of the light CDF, same layout and push constants as the filter pipeline
+	VkRenderPass lightCdfRenderPass = VK_NULL_HANDLE;
+	VkPipeline lightCdfPipeline = VK_NULL_HANDLE;
+	VkPipeline lightMarginalPipeline = VK_NULL_HANDLE;
+	VkFramebuffer lightCdfFramebuffer = VK_NULL_HANDLE;
+	VkFramebuffer lightMarginalFramebuffer = VK_NULL_HANDLE;
+	if (lightSampling)
+	{
+		RenderPassDesc renderPassDesc;
+		renderPassDesc.addAttachment(LightCdfFormat);
 
-		if (vulkan.createPipelineLayout(filterPipelineLayout, filterSetLayout, ranges) != VK_SUCCESS)
+		if (_vulkan.createRenderPass(lightCdfRenderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 
-		GraphicsPipelineDesc filterCubeMapPipelineDesc;
-
-		filterCubeMapPipelineDesc.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
-		filterCubeMapPipelineDesc.addShaderStage(filterCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "filterCubeMap");
-
-		filterCubeMapPipelineDesc.setRenderPass(renderPass);
-		filterCubeMapPipelineDesc.setPipelineLayout(filterPipelineLayout);
+		VkShaderModule lightCdfFragmentShader = VK_NULL_HANDLE;
+		VkShaderModule lightMarginalFragmentShader = VK_NULL_HANDLE;
+		if ((res = loadShader(_vulkan, Shader::LightRowCdf, lightCdfFragmentShader)) != Result::Success ||
+			(res = loadShader(_vulkan, Shader::LightMarginalCdf, lightMarginalFragmentShader)) != Result::Success)
+		{
+			return res;
+		}
 
 		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT; // TODO: rgb only
+		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT;
 		colorBlendAttachment.blendEnable = VK_FALSE;
 
-		filterCubeMapPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 6u);
-
-		//colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT;
-		filterCubeMapPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 1u);
-
-		filterCubeMapPipelineDesc.setViewportExtent(VkExtent2D{ cubeMapSideLength, cubeMapSideLength });
+		GraphicsPipelineDesc lightCdfPipelineDesc;
+		lightCdfPipelineDesc.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
+		lightCdfPipelineDesc.addShaderStage(lightCdfFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "lightRowCdf");
+		lightCdfPipelineDesc.setRenderPass(lightCdfRenderPass);
+		lightCdfPipelineDesc.setPipelineLayout(filterPipelineLayout);
+		lightCdfPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 1u);
+		lightCdfPipelineDesc.setViewportExtent(VkExtent2D{ lightCdfSide, 6u * lightCdfSide });
+
+		GraphicsPipelineDesc lightMarginalPipelineDesc;
+		lightMarginalPipelineDesc.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
+		lightMarginalPipelineDesc.addShaderStage(lightMarginalFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "lightMarginalCdf");
+		lightMarginalPipelineDesc.setRenderPass(lightCdfRenderPass);
+		lightMarginalPipelineDesc.setPipelineLayout(filterPipelineLayout);
+		lightMarginalPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 1u);
+		lightMarginalPipelineDesc.setViewportExtent(VkExtent2D{ 1u, 6u * lightCdfSide });
+
+		if (_vulkan.createPipeline(lightCdfPipeline, lightCdfPipelineDesc.getInfo()) != VK_SUCCESS ||
+			_vulkan.createPipeline(lightMarginalPipeline, lightMarginalPipelineDesc.getInfo()) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
 
-		if (vulkan.createPipeline(filterPipeline, filterCubeMapPipelineDesc.getInfo()) != VK_SUCCESS)
+		if (_vulkan.createFramebuffer(lightCdfFramebuffer, lightCdfRenderPass, lightCdfSide, 6u * lightCdfSide, { lightCdfView }) != VK_SUCCESS ||
+			_vulkan.createFramebuffer(lightMarginalFramebuffer, lightCdfRenderPass, 1u, 6u * lightCdfSide, { lightMarginalView }) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
@@ -905,36 +2732,48 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 
 	const std::vector<VkClearValue> clearValues(6u, { 0.0f, 0.0f, 1.0f, 1.0f });
 
-	VkCommandBuffer cubeMapCmd;
-	if (vulkan.createCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	////////////////////////////////////////////////////////////////////////////////////////
+	// Transform panorama image to cube map
+
+	if (loadCubeMap == false)
 	{
-		return Result::VulkanError;
+		printf("Transform panorama image to cube map\n");
+
+		res = panoramaToCubemap(_vulkan, cubeMapCmd, fullscreenVertexShader, panoramaImage, panoramaFormat, inputCubeMap);
+		if (res != VK_SUCCESS)
+		{
+			printf("Failed to transform panorama image to cube map\n");
+			return res;
+		}
+
+		currentInputCubeMapLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		inputCubeMapLoadedLevels = 1u;
 	}
 
-	if (vulkan.beginCommandBuffer(cubeMapCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	////////////////////////////////////////////////////////////////////////////////////////
+	//Generate MipLevels
+	if (inputCubeMapLoadedLevels < maxMipLevels || currentInputCubeMapLayout != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
 	{
-		return Result::VulkanError;
+		printf("Generating mipmap levels\n");
+		generateMipmapLevels(_vulkan, cubeMapCmd, inputCubeMap, maxMipLevels, inputSideLength, currentInputCubeMapLayout, inputCubeMapLoadedLevels);
+		currentInputCubeMapLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	}
 
 	////////////////////////////////////////////////////////////////////////////////////////
-	// Transform panorama image to cube map
-
-	printf("Transform panorama image to cube map\n");
-
-	res = panoramaToCubemap(vulkan, cubeMapCmd, fullscreenVertexShader, panoramaImage, inputCubeMap);
-	if (res != VK_SUCCESS)
+	// Extract sun
+	VkBuffer sunLightBuffer = VK_NULL_HANDLE;
+	if (_options.extractSun)
 	{
-		printf("Failed to transform panorama image to cube map\n");
-		return res;
-	}
+		printf("Extracting sun\n");
 
-	currentInputCubeMapLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		if ((res = extractSun(_vulkan, cubeMapCmd, fullscreenVertexShader, inputCubeMap, cubeMipMapSampler, sunlessCubeMap, sunLightBuffer)) != Result::Success)
+		{
+			printf("Failed to extract sun\n");
+			return res;
+		}
 
-	////////////////////////////////////////////////////////////////////////////////////////
-	//Generate MipLevels
-	printf("Generating mipmap levels\n");
-	generateMipmapLevels(vulkan, cubeMapCmd, inputCubeMap, maxMipLevels, cubeMapSideLength, currentInputCubeMapLayout);
-	currentInputCubeMapLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		generateMipmapLevels(_vulkan, cubeMapCmd, sunlessCubeMap, maxMipLevels, inputSideLength, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1u);
+	}
 
 	// Filter
 
@@ -953,7 +2792,57 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 			break;
 	}
 
-	vulkan.bindDescriptorSet(cubeMapCmd, filterPipelineLayout, filterDescriptorSet);
+	// GPU time of the filter passes, including the light CDF
+	VkQueryPool timestampPool = VK_NULL_HANDLE;
+	if ((_debugOutput || _outFilterMilliseconds != nullptr) && _vulkan.createTimestampQueryPool(timestampPool, 2u) == VK_SUCCESS)
+	{
+		vkCmdResetQueryPool(cubeMapCmd, timestampPool, 0u, 2u);
+		vkCmdWriteTimestamp(cubeMapCmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, 0u);
+	}
+
+	if (lightSampling)
+	{
+		const VkImageSubresourceRange cdfRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
+
+		for (const VkImage image : { lightCdf, lightMarginal })
+		{
+			_vulkan.imageBarrier(cubeMapCmd, image,
+													VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+													VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u,
+													VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+													cdfRange);
+		}
+
+		PushConstant values{};
+		values.lightCdfSide = lightCdfSide;
+		values.lightCdfLevel = lightCdfLevel;
+
+		// the filter passes keep the light set bound
+		_vulkan.bindDescriptorSets(cubeMapCmd, filterPipelineLayout, { filterDescriptorSet, lightDescriptorSet });
+		vkCmdPushConstants(cubeMapCmd, filterPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant), &values);
+
+		vkCmdBindPipeline(cubeMapCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, lightCdfPipeline);
+		_vulkan.beginRenderPass(cubeMapCmd, lightCdfRenderPass, lightCdfFramebuffer, VkRect2D{ 0u, 0u, lightCdfSide, 6u * lightCdfSide }, clearValues);
+		vkCmdDraw(cubeMapCmd, 3, 1u, 0, 0);
+		_vulkan.endRenderPass(cubeMapCmd);
+
+		_vulkan.imageBarrier(cubeMapCmd, lightCdf,
+												VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+												VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+												VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+												cdfRange);
+
+		vkCmdBindPipeline(cubeMapCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, lightMarginalPipeline);
+		_vulkan.beginRenderPass(cubeMapCmd, lightCdfRenderPass, lightMarginalFramebuffer, VkRect2D{ 0u, 0u, 1u, 6u * lightCdfSide }, clearValues);
+		vkCmdDraw(cubeMapCmd, 3, 1u, 0, 0);
+		_vulkan.endRenderPass(cubeMapCmd);
+
+		_vulkan.imageBarrier(cubeMapCmd, lightMarginal,
+												VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+												VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+												VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+												cdfRange);
+	}
 
 	vkCmdBindPipeline(cubeMapCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, filterPipeline);
 
@@ -963,23 +2852,41 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 	// This has the desirable side effect that the framebuffer size of the last filter pass
 	// matches with the LUT size, allowing the LUT to only be written in the last pass
 	// without worrying to preserve the LUT's image contents between the previous render passes.
+	// Hierarchical filtering needs the narrower lobes first: level 1 is filtered from the input, every further level from the previous one.
+	// Level 0 still comes last, its roughness 0 lobe is a single direction
+	std::vector<uint32_t> filterOrder;
 	for (uint32_t currentMipLevel = outputMipLevels - 1; currentMipLevel != -1; currentMipLevel--)
+	{
+		filterOrder.push_back(currentMipLevel);
+	}
+	if (hierarchical)
+	{
+		std::reverse(filterOrder.begin(), filterOrder.end() - 1);
+	}
+
+	// created for the first level filtered from its predecessor, reused by the following ones
+	VkImage hierarchicalPyramid = VK_NULL_HANDLE;
+
+	for (const uint32_t currentMipLevel : filterOrder)
 	{
 		unsigned int currentFramebufferSideLength = cubeMapSideLength >> currentMipLevel;
 		std::vector<VkImageView> renderTargetViews(outputCubeMapViews[currentMipLevel]);
 
-		renderTargetViews.emplace_back(outputLUTView);
+		if (multiview == false)
+		{
+			renderTargetViews.emplace_back(outputLUTView);
+		}
 
 		//Framebuffer will be destroyed automatically at shutdown
 		VkFramebuffer filterOutputFramebuffer = VK_NULL_HANDLE;
-		if (vulkan.createFramebuffer(filterOutputFramebuffer, renderPass, currentFramebufferSideLength, currentFramebufferSideLength, renderTargetViews, 1u) != VK_SUCCESS)
+		if (_vulkan.createFramebuffer(filterOutputFramebuffer, renderPass, currentFramebufferSideLength, currentFramebufferSideLength, renderTargetViews, 1u) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 
 		VkImageSubresourceRange  subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, currentMipLevel, 1u, 0u, 6u };
 
-		vulkan.imageBarrier(cubeMapCmd, outputCubeMap,
+		_vulkan.imageBarrier(cubeMapCmd, outputCubeMap,
 												VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
 												VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,//src stage, access
 												VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // dst stage, access
@@ -989,15 +2896,83 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 		values.roughness = static_cast<float>(currentMipLevel) / static_cast<float>(outputMipLevels - 1);
 		values.sampleCount = _sampleCount;
 		values.mipLevel = currentMipLevel;
-		values.width = cubeMapSideLength;
+		values.width = inputSideLength;
+		values.lodBias = _lodBias;
+		values.distribution = _distribution;
+		values.lutSampleCount = _sampleCount;
+
+		VkDescriptorSet sourceDescriptorSet = filterDescriptorSet;
+
+		if (hierarchical && currentMipLevel == 0u)
+		{
+			// every GGX sample of roughness 0 is the normal, one is exact
+			values.sampleCount = 1u;
+		}
+		else if (hierarchical)
+		{
+			values.sampleCount = std::min(_sampleCount, HierarchicalSampleCount);
+
+			if (currentMipLevel > 1u)
+			{
+				// convolving GGX lobes approximately adds their squared alpha (alpha = roughness^2),
+				// the previous level already contains all but the residual
+				const float previousRoughness = static_cast<float>(currentMipLevel - 1u) / static_cast<float>(outputMipLevels - 1);
+				const float residualAlphaSquared = std::max(0.f, powf(values.roughness, 4.f) - powf(previousRoughness, 4.f));
+				values.roughness = powf(residualAlphaSquared, 0.25f);
+				values.width = cubeMapSideLength >> (currentMipLevel - 1u);
+
+				if ((res = createHierarchicalSource(_vulkan, cubeMapCmd, outputCubeMap, currentMipLevel - 1u, cubeMipMapSampler, hierarchicalPyramid, sourceDescriptorSet)) != Success)
+				{
+					return res;
+				}
+			}
+		}
+
+		// half of the samples are drawn from the light CDF, except for the single direction of roughness 0
+		if (lightSampling && (currentMipLevel > 0u || _distribution == Distribution::Lambertian))
+		{
+			values.lightSampleCount = values.sampleCount / 2u;
+			values.sampleCount -= values.lightSampleCount;
+		}
+		values.lightCdfSide = lightCdfSide;
+		values.lightCdfLevel = lightCdfLevel;
+
+		_vulkan.bindDescriptorSet(cubeMapCmd, filterPipelineLayout, sourceDescriptorSet);
+		vkCmdPushConstants(cubeMapCmd, filterPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant), &values);
+
+		_vulkan.beginRenderPass(cubeMapCmd, renderPass, filterOutputFramebuffer, VkRect2D{ 0u, 0u, currentFramebufferSideLength, currentFramebufferSideLength }, clearValues);
+		vkCmdDraw(cubeMapCmd, 3, 1u, 0, 0);
+		_vulkan.endRenderPass(cubeMapCmd);
+	}
+
+	if (timestampPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(cubeMapCmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, 1u);
+	}
+
+	// the LUT does not depend on the input, without multiview it is written by the level 0 filter pass
+	if (multiview && _outputPathLUT != nullptr)
+	{
+		VkFramebuffer lutFramebuffer = VK_NULL_HANDLE;
+		if (_vulkan.createFramebuffer(lutFramebuffer, lutRenderPass, cubeMapSideLength, cubeMapSideLength, { outputLUTView }, 1u) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		PushConstant values{};
+		values.sampleCount = _sampleCount;
+		values.mipLevel = 0u;
+		values.width = inputSideLength;
 		values.lodBias = _lodBias;
 		values.distribution = _distribution;
+		values.lutSampleCount = _sampleCount;
 
+		vkCmdBindPipeline(cubeMapCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, lutPipeline);
 		vkCmdPushConstants(cubeMapCmd, filterPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant), &values);
 
-		vulkan.beginRenderPass(cubeMapCmd, renderPass, filterOutputFramebuffer, VkRect2D{ 0u, 0u, currentFramebufferSideLength, currentFramebufferSideLength }, clearValues);
+		_vulkan.beginRenderPass(cubeMapCmd, lutRenderPass, lutFramebuffer, VkRect2D{ 0u, 0u, cubeMapSideLength, cubeMapSideLength }, clearValues);
 		vkCmdDraw(cubeMapCmd, 3, 1u, 0, 0);
-		vulkan.endRenderPass(cubeMapCmd);
+		_vulkan.endRenderPass(cubeMapCmd);
 	}
 
 	////////////////////////////////////////////////////////////////////////////////////////
@@ -1009,7 +2984,7 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 
 	if(targetFormat != cubeMapFormat)
 	{
-		if ((res = convertVkFormat(vulkan, cubeMapCmd, outputCubeMap, convertedCubeMap, targetFormat, currentCubeMapImageLayout)) != Success)
+		if ((res = convertVkFormat(_vulkan, cubeMapCmd, outputCubeMap, convertedCubeMap, targetFormat, currentCubeMapImageLayout)) != Success)
 		{
 			printf("Failed to convert Image \n");
 			return res;
@@ -1021,30 +2996,323 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 		convertedCubeMap = outputCubeMap;
 	}
 
-	if (vulkan.endCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	job.ktxImage.reset(new KtxImage(cubeMapSideLength, cubeMapSideLength, targetFormat, outputMipLevels, true, false));
+
+	// lets the next run with the same input and parameters skip sampling
+	if (inputHashed)
+	{
+		char jobHashString[32];
+		snprintf(jobHashString, sizeof(jobHashString), "%016" PRIx64, jobHash);
+		if ((res = job.ktxImage->setMetadata(JobHashKey, jobHashString)) != Success)
+		{
+			return res;
+		}
+	}
+
+	if ((res = releaseCubemapForReadback(_vulkan, cubeMapCmd, downloadCmd, convertedCubeMap, currentCubeMapImageLayout)) != Success)
+	{
+		printf("Failed to download Image \n");
+		return res;
+	}
+
+	// the prepared source cube map is read back after filtering, it is not needed by anything else
+	if (cacheMiss)
+	{
+		if ((res = releaseCubemapForReadback(_vulkan, cubeMapCmd, downloadCmd, inputCubeMap, currentInputCubeMapLayout)) != Success)
+		{
+			printf("Failed to download Image \n");
+			return res;
+		}
+	}
+
+	VkBuffer LUTStagingBuffer = VK_NULL_HANDLE;
+	if (_outputPathLUT != nullptr)
+	{
+		if ((res = download2DImage(_vulkan, cubeMapCmd, downloadCmd, outputLUT, LUTStagingBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)) != Success)
+		{
+			printf("Failed to download Image \n");
+			return res;
+		}
+	}
+
+	if (_vulkan.endCommandBuffers({ cubeMapCmd, downloadCmd }) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	job.executeStart = std::chrono::steady_clock::now();
+	job.uploadOverlapped = _vulkan.isComplete(uploadTicket);
+
+	// the readback waits for filterSemaphore, it is submitted by finishJob so that the uploads of later jobs are not queued behind it
+	if (_vulkan.submit({ cubeMapCmd }, job.filterTicket, QueueType::Graphics, { uploadSemaphore }, { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT }, { job.filterSemaphore }) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	if (vulkan.executeCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	job.timestampPool = timestampPool;
+	job.sunLightBuffer = sunLightBuffer;
+	job.outputLUT = outputLUT;
+	job.LUTStagingBuffer = LUTStagingBuffer;
+	job.convertedCubeMap = convertedCubeMap;
+	job.inputCubeMap = inputCubeMap;
+	job.inputSideLength = inputSideLength;
+	job.maxMipLevels = maxMipLevels;
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::finishJob(vkHelper& _vulkan, PendingJob& _job)
+{
+	IBLLib::Result res = Result::Success;
+
+	_vulkan.setScope(_job.scope);
+
+	if (_vulkan.submit({ _job.downloadCmd }, _job.downloadTicket, QueueType::Transfer, { _job.filterSemaphore }, { VK_PIPELINE_STAGE_TRANSFER_BIT }) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	if (downloadCubemap(vulkan, convertedCubeMap, _outputPathCubeMap, currentCubeMapImageLayout) != VK_SUCCESS)
+	if (_vulkan.wait(_job.filterTicket) != VK_SUCCESS)
 	{
-		printf("Failed to download Image \n");
 		return Result::VulkanError;
 	}
 
-	if (_outputPathLUT != nullptr)
+	const auto filterEnd = std::chrono::steady_clock::now();
+
+	// falls back to the time from the submission to the end of filtering, which includes earlier jobs in a batch
+	double filterMilliseconds = std::chrono::duration<double, std::milli>(filterEnd - _job.executeStart).count();
+	const bool filterTimed = _job.timestampPool != VK_NULL_HANDLE && _vulkan.getTimestampMilliseconds(_job.timestampPool, 0u, 1u, filterMilliseconds) == VK_SUCCESS;
+	if (_job.outFilterMilliseconds != nullptr)
+	{
+		*_job.outFilterMilliseconds = filterMilliseconds;
+	}
+
+	// direction and solid angle, color and found flag, see sunLight in filter.frag
+	ExtractedLight light;
+	if (_job.sunLightBuffer != VK_NULL_HANDLE)
 	{
-		if (download2DImage(vulkan, outputLUT, _outputPathLUT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) != VK_SUCCESS)
+		float lightTexels[8] = {};
+		if (_vulkan.readBufferData(_job.sunLightBuffer, lightTexels, sizeof(lightTexels)) != VK_SUCCESS)
 		{
-			printf("Failed to download Image \n");
 			return Result::VulkanError;
 		}
+		_vulkan.destroyBuffer(_job.sunLightBuffer);
+		_job.sunLightBuffer = VK_NULL_HANDLE;
+
+		light.found = lightTexels[7] > 0.f;
+		if (light.found)
+		{
+			memcpy(light.direction, &lightTexels[0], sizeof(light.direction));
+			memcpy(light.color, &lightTexels[4], sizeof(light.color));
+			light.solidAngle = lightTexels[3];
+
+			printf("Extracted light towards (%.4f, %.4f, %.4f), color (%g, %g, %g), solid angle %g sr\n",
+						 light.direction[0], light.direction[1], light.direction[2], light.color[0], light.color[1], light.color[2], light.solidAngle);
+
+			if ((res = _job.ktxImage->setMetadata(LightKey, formatLight(light).c_str())) != Success)
+			{
+				return res;
+			}
+		}
+		else
+		{
+			printf("No light source is much brighter than the environment, filtering the input unchanged\n");
+		}
+	}
+
+	if (_job.options.statistics != nullptr)
+	{
+		_job.options.statistics->light = light;
+	}
+
+	if (_vulkan.wait(_job.uploadTicket) != VK_SUCCESS || _vulkan.wait(_job.downloadTicket) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	const auto writeStart = std::chrono::steady_clock::now();
+
+	_vulkan.destroyCommandBuffer(_job.cubeMapCmd);
+	_vulkan.destroyCommandBuffer(_job.downloadCmd);
+	_job.cubeMapCmd = VK_NULL_HANDLE;
+	_job.downloadCmd = VK_NULL_HANDLE;
+	for (const VkBuffer& stagingBuffer : _job.inputStagingBuffers)
+	{
+		_vulkan.destroyBuffer(stagingBuffer);
+	}
+	_job.inputStagingBuffers.clear();
+
+	if (_job.debugOutput)
+	{
+		_vulkan.printMemoryStatistics();
+		_vulkan.printPipelineStatistics();
+#if defined(IBLSAMPLER_RUNTIME_SHADER_COMPILER)
+		ShaderCompiler::instance().printStatistics();
+#endif
+	}
+
+	// outputs are written on background threads, synchronous calls wait for a local writer before returning
+	std::unique_ptr<OutputWriter> localWriter;
+	if (_job.options.asyncOutput == false)
+	{
+		localWriter.reset(new OutputWriter());
+	}
+	OutputWriter& writer = _job.options.asyncOutput ? OutputWriter::getShared() : *localWriter;
+
+	// the LUT is handed off first so PNG encoding runs while the cube map is streamed
+	if (_job.outputPathLUT != nullptr)
+	{
+		uint64_t lutHash = 0u;
+		if ((res = write2DImage(_vulkan, _job.outputLUT, _job.LUTStagingBuffer, _job.outputPathLUT, writer, lutHash)) != Success)
+		{
+			return res;
+		}
+
+		// lets the next run check that the LUT was not replaced since
+		char lutHashString[32];
+		snprintf(lutHashString, sizeof(lutHashString), "%016" PRIx64, lutHash);
+		if ((res = _job.ktxImage->setMetadata(LUTHashKey, lutHashString)) != Success)
+		{
+			return res;
+		}
+	}
+
+	if ((res = streamCubemap(_vulkan, _job.convertedCubeMap, *_job.ktxImage, _job.outputPathCubeMap)) != Success)
+	{
+		return res;
+	}
+
+	if (_job.cacheMiss)
+	{
+		// a failed cache write does not fail sampling
+		KtxImage sourceKtxImage(_job.inputSideLength, _job.inputSideLength, _job.cubeMapFormat, _job.maxMipLevels, true, false);
+		if (streamCubemap(_vulkan, _job.inputCubeMap, sourceKtxImage, _job.cubeMapCache.getTemporaryPath(_job.cacheKey).c_str()) != Success ||
+			_job.cubeMapCache.insert(_job.cacheKey) == false)
+		{
+			printf("Failed to add cube map to cache %s\n", _job.options.cacheDirectory);
+		}
+	}
+
+	if (localWriter != nullptr && (res = localWriter->flush()) != Success)
+	{
+		return res;
+	}
+
+	if (_job.debugOutput)
+	{
+		using ms = std::chrono::duration<double, std::milli>;
+		const auto writeEnd = std::chrono::steady_clock::now();
+		printf("Recording %.2f ms (upload %s), filtering %.2f ms, readback after filtering %.2f ms, writing %s %.2f ms\n",
+					 ms(_job.executeStart - _job.recordStart).count(), _job.uploadOverlapped ? "overlapped" : "pending",
+					 ms(filterEnd - _job.executeStart).count(), ms(writeStart - filterEnd).count(), _job.options.asyncOutput ? "(handoff)" : "", ms(writeEnd - writeStart).count());
+		if (filterTimed)
+		{
+			printf("Filter passes %.2f ms on the GPU (%s)\n", filterMilliseconds, _job.hierarchical ? "hierarchical" : "brute force");
+		}
 	}
 
 	return Result::Success;
 }
+
+void IBLLib::releaseJob(vkHelper& _vulkan, PendingJob& _job)
+{
+	// a job that failed before its readback may still be uploading or filtering
+	_vulkan.wait(_job.uploadTicket);
+	_vulkan.wait(_job.filterTicket);
+	_vulkan.wait(_job.downloadTicket);
+
+	_vulkan.destroyCommandBuffer(_job.cubeMapCmd);
+	_vulkan.destroyCommandBuffer(_job.downloadCmd);
+	_job.cubeMapCmd = VK_NULL_HANDLE;
+	_job.downloadCmd = VK_NULL_HANDLE;
+
+	_vulkan.releaseScope(_job.scope);
+}
+
+IBLLib::Result IBLLib::sampleCubeMap(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput, const SampleOptions& _options, double* _outFilterMilliseconds)
+{
+	vkHelper vulkan;
+	std::unique_ptr<PendingJob> job;
+
+	Result res = submitJob(vulkan, _inputPath, _outputPathCubeMap, _outputPathLUT, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias, _debugOutput, _options, _outFilterMilliseconds, job);
+	if (res == Result::Success && job != nullptr)
+	{
+		res = finishJob(vulkan, *job);
+	}
+
+	return res;
+}
+
+IBLLib::Result IBLLib::sampleBatch(const SampleJob* _jobs, unsigned int _jobCount, bool _debugOutput)
+{
+	vkHelper vulkan;
+
+	// the first failure in job order, later jobs are still sampled
+	Result batchRes = Result::Success;
+	unsigned int overlappedCount = 0u;
+
+	const auto batchStart = std::chrono::steady_clock::now();
+
+	std::unique_ptr<PendingJob> pending;
+	for (unsigned int i = 0u; i <= _jobCount; ++i)
+	{
+		std::unique_ptr<PendingJob> submitted;
+		Result res = Result::Success;
+
+		if (i < _jobCount)
+		{
+			const SampleJob& job = _jobs[i];
+			if (job.options.compareFiltering)
+			{
+				// the comparison samples several times with options of its own
+				res = sample(job.inputPath, job.outputPathCubeMap, job.outputPathLUT, job.distribution, job.cubemapResolution, job.mipmapCount, job.sampleCount, job.targetFormat, job.lodBias, _debugOutput, job.options);
+			}
+			else
+			{
+				res = submitJob(vulkan, job.inputPath, job.outputPathCubeMap, job.outputPathLUT, job.distribution, job.cubemapResolution, job.mipmapCount, job.sampleCount, job.targetFormat, job.lodBias, _debugOutput, job.options, nullptr, submitted);
+			}
+
+			if (res != Result::Success && submitted != nullptr)
+			{
+				releaseJob(vulkan, *submitted);
+				submitted.reset();
+			}
+		}
+
+		// the previous job is read back and written while the filter passes of this one run
+		if (pending != nullptr)
+		{
+			const Result finishRes = finishJob(vulkan, *pending);
+			releaseJob(vulkan, *pending);
+
+			if (submitted != nullptr && vulkan.isComplete(submitted->filterTicket) == false)
+			{
+				++overlappedCount;
+			}
+
+			if (finishRes != Result::Success && batchRes == Result::Success)
+			{
+				printf("Failed to write %s\n", pending->outputPathCubeMap);
+				batchRes = finishRes;
+			}
+		}
+
+		if (res != Result::Success)
+		{
+			printf("Failed to sample %s\n", _jobs[i].inputPath);
+			if (batchRes == Result::Success)
+			{
+				batchRes = res;
+			}
+		}
+
+		pending = std::move(submitted);
+	}
+
+	using ms = std::chrono::duration<double, std::milli>;
+	printf("Sampled %u jobs in %.2f ms, the readback of %u jobs overlapped with the filter passes of the next one\n",
+				 _jobCount, ms(std::chrono::steady_clock::now() - batchStart).count(), overlappedCount);
+
+	return batchRes;
+}
+
@@ -2,17 +2,46 @@ R""(
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// MULTIVIEW is defined for devices with Vulkan 1.1 multiview: each view renders one cube face
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : require
+#endif
+
 #define UX3D_MATH_PI 3.1415926535897932384626433832795
 #define UX3D_MATH_INV_PI (1.0 / UX3D_MATH_PI)
 
 layout(set = 0, binding = 0) uniform sampler2D uPanorama;
 layout(set = 0, binding = 1) uniform samplerCube uCubeMap;
 
+// luminance CDF of the input for light sampling, only used by the light sampled entry points
+// row face * side + y holds the prefix sums of the texel weights along x
+layout(set = 1, binding = 0) uniform sampler2D uLightCdf;
+// prefix sums of the row totals, 1 x 6 * side
+layout(set = 1, binding = 1) uniform sampler2D uLightMarginal;
+
+// sun extraction, only used by the sun entry points
+// brightest texel of each row of level 0 of the input: luminance and x, 6 x side with one column per face
+layout(set = 1, binding = 2) uniform sampler2D uSunRowPeaks;
+// brightest texel of the input: luminance, x, face * side + y and the mean luminance of the input
+layout(set = 1, binding = 3) uniform sampler2D uSunPeak;
+// per row: the sun texels (rgb times solid angle, solid angle), their luminance weighted directions and the other texels in the sun cone,
+// 3 * 6 x side with the three sums of a face in consecutive columns
+layout(set = 1, binding = 4) uniform sampler2D uSunRowSums;
+// the extracted light: direction and solid angle, color and found flag, background color and luminance threshold
+layout(set = 1, binding = 5) uniform sampler2D uSunLight;
+
 // enum
 const uint cLambertian = 0;
 const uint cGGX = 1;
 const uint cCharlie = 2;
 
+// panorama upload formats, see PanoramaFormat in lib.cpp
+const uint cPanoramaFloat = 0;
+const uint cPanoramaHalf = 1;
+const uint cPanoramaRGBE = 2; // raw radiance bytes in a R8G8B8A8_UNORM image
+
+layout(constant_id = 0) const uint cPanoramaFormat = cPanoramaFloat;
+
 layout(push_constant) uniform FilterParameters {
   float roughness;
   uint sampleCount;
@@ -20,10 +49,18 @@ layout(push_constant) uniform FilterParameters {
   uint width;
   float lodBias;
   uint distribution; // enum
+  uint lutSampleCount; // the cube map filter may use fewer samples than the LUT
+  uint lightSampleCount; // light samples in addition to the sampleCount distribution samples
+  uint lightCdfSide;
+  uint lightCdfLevel; // input mip level the light CDF is built from
 } pFilterParameters;
 
 layout (location = 0) in vec2 inUV;
 
+#ifdef MULTIVIEW
+// face gl_ViewIndex of the layered cube map view, or the LUT
+layout(location = 0) out vec4 outColor;
+#else
 // output cubemap faces
 layout(location = 0) out vec4 outFace0;
 layout(location = 1) out vec4 outFace1;
@@ -33,11 +70,15 @@ layout(location = 4) out vec4 outFace4;
 layout(location = 5) out vec4 outFace5;
 
 layout(location = 6) out vec3 outLUT;
+#endif
 
 void writeFace(int face, vec3 colorIn)
 {
 	vec4 color = vec4(colorIn.rgb, 1.0f);
-	
+
+#ifdef MULTIVIEW
+	outColor = color;
+#else
 	if(face == 0)
 		outFace0 = color;
 	else if(face == 1)
@@ -50,6 +91,7 @@ void writeFace(int face, vec3 colorIn)
 		outFace4 = color;
 	else //if(face == 5)
 		outFace5 = color;
+#endif
 }
 
 vec3 uvToXYZ(int face, vec2 uv)
@@ -73,6 +115,45 @@ vec3 uvToXYZ(int face, vec2 uv)
         return vec3(    -uv.x,  +uv.y,     -1.f);}
 }
 
+// direction of st in [-1, 1]^2 on a face, with the face order and orientation of the cube map sampler
+vec3 cubeFaceToDirection(int face, vec2 st)
+{
+    if(face == 0)
+        return vec3(  1.0, -st.y, -st.x);
+    else if(face == 1)
+        return vec3( -1.0, -st.y,  st.x);
+    else if(face == 2)
+        return vec3( st.x,   1.0,  st.y);
+    else if(face == 3)
+        return vec3( st.x,  -1.0, -st.y);
+    else if(face == 4)
+        return vec3( st.x, -st.y,   1.0);
+    else //if(face == 5)
+        return vec3(-st.x, -st.y,  -1.0);
+}
+
+// inverse of cubeFaceToDirection, st in .xy and the face in .z
+vec3 directionToCubeFace(vec3 dir)
+{
+    vec3 a = abs(dir);
+    if(a.x >= a.y && a.x >= a.z)
+        return dir.x > 0.0 ? vec3(-dir.z / a.x, -dir.y / a.x, 0.0) : vec3(dir.z / a.x, -dir.y / a.x, 1.0);
+    if(a.y >= a.z)
+        return dir.y > 0.0 ? vec3(dir.x / a.y, dir.z / a.y, 2.0) : vec3(dir.x / a.y, -dir.z / a.y, 3.0);
+    return dir.z > 0.0 ? vec3(dir.x / a.z, -dir.y / a.z, 4.0) : vec3(-dir.x / a.z, -dir.y / a.z, 5.0);
+}
+
+// ratio of the solid angle to the area of a small patch at st on a face
+float cubeFaceSolidAngleFactor(vec2 st)
+{
+    return pow(1.0 + dot(st, st), -1.5);
+}
+
+float luminance(vec3 color)
+{
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
 vec2 dirToUV(vec3 dir)
 {
     return vec2(
@@ -235,10 +316,10 @@ MicrofacetDistributionSample Lambertian(vec2 xi, float roughness)
 
 
 // getImportanceSample returns an importance sample direction with pdf in the .w component
-vec4 getImportanceSample(int sampleIndex, vec3 N, float roughness)
+vec4 getImportanceSample(int sampleIndex, int sampleCount, vec3 N, float roughness)
 {
     // generate a quasi monte carlo point in the unit square [0.1)^2
-    vec2 xi = hammersley2d(sampleIndex, int(pFilterParameters.sampleCount));
+    vec2 xi = hammersley2d(sampleIndex, sampleCount);
 
     MicrofacetDistributionSample importanceSample;
 
@@ -309,7 +390,7 @@ vec3 filterColor(vec3 N)
 
     for(int i = 0; i < int(pFilterParameters.sampleCount); ++i)
     {
-        vec4 importanceSample = getImportanceSample(i, N, pFilterParameters.roughness);
+        vec4 importanceSample = getImportanceSample(i, int(pFilterParameters.sampleCount), N, pFilterParameters.roughness);
 
         vec3 H = vec3(importanceSample.xyz);
         float pdf = importanceSample.w;
@@ -365,6 +446,164 @@ vec3 filterColor(vec3 N)
     return color.rgb ;
 }
 
+// Light sampling
+// Samples are drawn from the texels of the light CDF with probability proportional to luminance times solid angle,
+// uniformly in st inside the texel, and combined with the distribution samples by the balance heuristic (Veach 1997)
+
+float lightCdfTotal()
+{
+    return texelFetch(uLightMarginal, ivec2(0, 6 * int(pFilterParameters.lightCdfSide) - 1), 0).x;
+}
+
+// weight of texel (x, row face * side + y) of the light CDF
+float lightTexelWeight(int x, int row)
+{
+    float prefix = texelFetch(uLightCdf, ivec2(x, row), 0).x;
+    return x > 0 ? prefix - texelFetch(uLightCdf, ivec2(x - 1, row), 0).x : prefix;
+}
+
+// solid angle density of the light samples of a texel with the given weight at st
+float lightTexelPdf(float texelWeight, vec2 st)
+{
+    float side = float(pFilterParameters.lightCdfSide);
+    float texelArea = 4.0 / (side * side);
+    return texelWeight / (lightCdfTotal() * texelArea * cubeFaceSolidAngleFactor(st));
+}
+
+float getLightPdf(vec3 L)
+{
+    vec3 st = directionToCubeFace(L);
+    int side = int(pFilterParameters.lightCdfSide);
+    ivec2 texel = clamp(ivec2((st.xy * 0.5 + 0.5) * float(side)), ivec2(0), ivec2(side - 1));
+
+    return lightTexelPdf(lightTexelWeight(texel.x, int(st.z) * side + texel.y), st.xy);
+}
+
+// light sample direction with its pdf in the .w component.
+// xi.y selects the row, xi.x the texel in the row, what is left of both places the sample inside the texel
+vec4 getLightSample(vec2 xi)
+{
+    int side = int(pFilterParameters.lightCdfSide);
+
+    // first row whose prefix sum exceeds the target
+    float target = xi.y * lightCdfTotal();
+    int first = 0;
+    int last = 6 * side - 1;
+    while(first < last)
+    {
+        int middle = (first + last) / 2;
+        if(texelFetch(uLightMarginal, ivec2(0, middle), 0).x > target)
+            last = middle;
+        else
+            first = middle + 1;
+    }
+    int row = first;
+    float rowStart = row > 0 ? texelFetch(uLightMarginal, ivec2(0, row - 1), 0).x : 0.0;
+    float rowWeight = texelFetch(uLightMarginal, ivec2(0, row), 0).x - rowStart;
+    float offsetY = saturate((target - rowStart) / rowWeight);
+
+    target = xi.x * texelFetch(uLightCdf, ivec2(side - 1, row), 0).x;
+    first = 0;
+    last = side - 1;
+    while(first < last)
+    {
+        int middle = (first + last) / 2;
+        if(texelFetch(uLightCdf, ivec2(middle, row), 0).x > target)
+            last = middle;
+        else
+            first = middle + 1;
+    }
+    float texelWeight = lightTexelWeight(first, row);
+    float texelStart = texelFetch(uLightCdf, ivec2(first, row), 0).x - texelWeight;
+    float offsetX = saturate((target - texelStart) / texelWeight);
+
+    int face = row / side;
+    vec2 st = (vec2(first, row - face * side) + vec2(offsetX, offsetY)) / float(side) * 2.0 - 1.0;
+
+    return vec4(normalize(cubeFaceToDirection(face, st)), lightTexelPdf(texelWeight, st));
+}
+
+// density of getImportanceSample in direction L
+float getDistributionPdf(vec3 N, vec3 L, float roughness)
+{
+    float NdotL = dot(N, L);
+    if(pFilterParameters.distribution == cLambertian)
+    {
+        return max(NdotL, 0.0) * UX3D_MATH_INV_PI;
+    }
+
+    // V = N, the half vector pdf D * NdotH is divided by 4 * VdotH = 4 * NdotH
+    float NdotH = saturate(dot(N, normalize(N + L)));
+    float alpha = roughness * roughness;
+    if(pFilterParameters.distribution == cGGX)
+    {
+        return D_GGX(NdotH, alpha) / 4.0;
+    }
+    return D_Charlie(alpha, NdotH) / 4.0;
+}
+
+// filterColor with lightSampleCount light samples besides the distribution samples.
+// both are weighted by the kernel filterColor integrates (the distribution pdf times NdotL, NdotL / pi for lambertian)
+// over the combined sample density, which also selects the lod of each sample
+vec3 filterColorLightSampled(vec3 N)
+{
+    float roughness = pFilterParameters.roughness;
+
+    // the roughness 0 lobe is a single direction
+    bool singleDirection = roughness == 0.0 && pFilterParameters.distribution != cLambertian;
+    if(pFilterParameters.lightSampleCount == 0u || singleDirection || lightCdfTotal() <= 0.0)
+    {
+        return filterColor(N);
+    }
+
+    int distributionSampleCount = int(pFilterParameters.sampleCount);
+    int lightSampleCount = int(pFilterParameters.lightSampleCount);
+
+    vec3 color = vec3(0.0);
+    float weight = 0.0;
+
+    for(int i = 0; i < distributionSampleCount + lightSampleCount; ++i)
+    {
+        vec3 L;
+        float distributionPdf;
+        float lightPdf;
+
+        if(i < distributionSampleCount)
+        {
+            vec4 importanceSample = getImportanceSample(i, distributionSampleCount, N, roughness);
+            distributionPdf = importanceSample.w;
+
+            // lambertian samples the direction itself, the microfacet distributions the half vector
+            L = pFilterParameters.distribution == cLambertian ? importanceSample.xyz : normalize(reflect(-N, importanceSample.xyz));
+            lightPdf = getLightPdf(L);
+        }
+        else
+        {
+            vec4 lightSample = getLightSample(hammersley2d(i - distributionSampleCount, lightSampleCount));
+            L = lightSample.xyz;
+            lightPdf = lightSample.w;
+            distributionPdf = getDistributionPdf(N, L, roughness);
+        }
+
+        float NdotL = dot(N, L);
+        if(NdotL <= 0.0)
+        {
+            continue;
+        }
+
+        float density = float(distributionSampleCount) * distributionPdf + float(lightSampleCount) * lightPdf;
+        float kernel = pFilterParameters.distribution == cLambertian ? NdotL * UX3D_MATH_INV_PI : distributionPdf * NdotL;
+
+        // mipmap filtered samples (GPU Gems 3, 20.4) with the density of all samples
+        float lod = 0.5 * log2(6.0 * float(pFilterParameters.width) * float(pFilterParameters.width) / density) + pFilterParameters.lodBias;
+
+        color += textureLod(uCubeMap, L, lod).rgb * (kernel / density);
+        weight += kernel / density;
+    }
+
+    return weight > 0.0 ? color / weight : vec3(0.0);
+}
+
 // From the filament docs. Geometric Shadowing function
 // https://google.github.io/filament/Filament.html#toc4.4.2
 float V_SmithGGXCorrelated(float NoV, float NoL, float roughness) {
@@ -399,10 +638,10 @@ vec3 LUT(float NdotV, float roughness)
     float B = 0.0;
     float C = 0.0;
 
-    for(int i = 0; i < int(pFilterParameters.sampleCount); ++i)
+    for(int i = 0; i < int(pFilterParameters.lutSampleCount); ++i)
     {
         // Importance sampling, depending on the distribution.
-        vec4 importanceSample = getImportanceSample(i, N, roughness);
+        vec4 importanceSample = getImportanceSample(i, int(pFilterParameters.lutSampleCount), N, roughness);
         vec3 H = importanceSample.xyz;
         // float pdf = importanceSample.w;
         vec3 L = normalize(reflect(-V, H));
@@ -442,23 +681,92 @@ vec3 LUT(float NdotV, float roughness)
     // The PDF is simply pdf(v, h) -> NDF * <nh>.
     // To parametrize the PDF over l, use the Jacobian transform, yielding to: pdf(v, l) -> NDF * <nh> / 4<vh>
     // Since the BRDF divide through the PDF to be normalized, the 4 can be pulled out of the integral.
-    return vec3(4.0 * A, 4.0 * B, 4.0 * 2.0 * UX3D_MATH_PI * C) / float(pFilterParameters.sampleCount);
+    return vec3(4.0 * A, 4.0 * B, 4.0 * 2.0 * UX3D_MATH_PI * C) / float(pFilterParameters.lutSampleCount);
 }
 
 
 // entry point
+vec3 decodeRGBE(vec4 rgbe)
+{
+	// the texels are fetched as unorm, restore the bytes
+	vec4 bytes = floor(rgbe * 255.0 + 0.5);
+	return bytes.a > 0.0 ? bytes.rgb * exp2(bytes.a - 136.0) : vec3(0.0);
+}
+
+// VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT on texel coordinates, texel is in [-1, size] for uv in [0, 1]
+int mirrorTexel(int texel, int size)
+{
+	if(texel < 0)
+		return -1 - texel;
+	if(texel >= size)
+		return 2 * size - 1 - texel;
+	return texel;
+}
+
+// RGBE can not be interpolated by the sampler, decode the four texels and filter afterwards
+vec3 samplePanoramaRGBE(vec2 uv)
+{
+	ivec2 size = textureSize(uPanorama, 0);
+	vec2 texel = uv * vec2(size) - 0.5;
+	ivec2 i0 = ivec2(floor(texel));
+	vec2 f = texel - vec2(i0);
+
+	int x0 = mirrorTexel(i0.x, size.x);
+	int x1 = mirrorTexel(i0.x + 1, size.x);
+	int y0 = mirrorTexel(i0.y, size.y);
+	int y1 = mirrorTexel(i0.y + 1, size.y);
+
+	vec3 c00 = decodeRGBE(texelFetch(uPanorama, ivec2(x0, y0), 0));
+	vec3 c10 = decodeRGBE(texelFetch(uPanorama, ivec2(x1, y0), 0));
+	vec3 c01 = decodeRGBE(texelFetch(uPanorama, ivec2(x0, y1), 0));
+	vec3 c11 = decodeRGBE(texelFetch(uPanorama, ivec2(x1, y1), 0));
+
+	return mix(mix(c00, c10, f.x), mix(c01, c11, f.x), f.y);
+}
+
+vec3 samplePanorama(vec2 uv)
+{
+	if(cPanoramaFormat == cPanoramaRGBE)
+		return samplePanoramaRGBE(uv);
+
+	return texture(uPanorama, uv).rgb;
+}
+
+vec3 panoramaToCubeMapFace(int face)
+{
+	vec3 scan = uvToXYZ(face, inUV*2.0-1.0);		
+		
+	vec3 direction = normalize(scan);		
+
+	vec2 src = dirToUV(direction);		
+		
+	return samplePanorama(src);
+}
+
 void panoramaToCubeMap() 
 {
+#ifdef MULTIVIEW
+	writeFace(gl_ViewIndex, panoramaToCubeMapFace(gl_ViewIndex));
+#else
 	for(int face = 0; face < 6; ++face)
 	{		
-		vec3 scan = uvToXYZ(face, inUV*2.0-1.0);		
-			
-		vec3 direction = normalize(scan);		
-	
-		vec2 src = dirToUV(direction);		
-			
-		writeFace(face, texture(uPanorama, src).rgb);
+		writeFace(face, panoramaToCubeMapFace(face));
 	}
+#endif
+}
+
+vec3 filterCubeMapFace(int face, vec2 uv)
+{
+	vec3 scan = uvToXYZ(face, uv);		
+		
+	vec3 direction = normalize(scan);	
+	direction.y = -direction.y;
+
+	return filterColor(direction);
+
+	//Debug output:
+	//return texture(uCubeMap, direction).rgb;
+	//return direction;
 }
 
 // entry point
@@ -467,19 +775,13 @@ void filterCubeMap()
 	vec2 newUV = inUV * float(1 << (pFilterParameters.currentMipLevel));
 	 
 	newUV = newUV*2.0-1.0;
-	
+
+#ifdef MULTIVIEW
+	writeFace(gl_ViewIndex, filterCubeMapFace(gl_ViewIndex, newUV));
+#else
 	for(int face = 0; face < 6; ++face)
 	{
-		vec3 scan = uvToXYZ(face, newUV);		
-			
-		vec3 direction = normalize(scan);	
-		direction.y = -direction.y;
-
-		writeFace(face, filterColor(direction));
-		
-		//Debug output:
-		//writeFace(face,  texture(uCubeMap, direction).rgb);
-		//writeFace(face,   direction);
+		writeFace(face, filterCubeMapFace(face, newUV));
 	}
 
 	// Write LUT:
@@ -491,5 +793,276 @@ void filterCubeMap()
 		outLUT = LUT(inUV.x, inUV.y);
 	
 	}
+#endif
+}
+
+// filterCubeMap with light samples, binds the light CDF as set 1
+vec3 filterCubeMapFaceLightSampled(int face, vec2 uv)
+{
+	vec3 direction = normalize(uvToXYZ(face, uv));
+	direction.y = -direction.y;
+
+	return filterColorLightSampled(direction);
+}
+
+// entry point
+void filterCubeMapLightSampled()
+{
+	vec2 newUV = inUV * float(1 << (pFilterParameters.currentMipLevel));
+
+	newUV = newUV*2.0-1.0;
+
+#ifdef MULTIVIEW
+	writeFace(gl_ViewIndex, filterCubeMapFaceLightSampled(gl_ViewIndex, newUV));
+#else
+	for(int face = 0; face < 6; ++face)
+	{
+		writeFace(face, filterCubeMapFaceLightSampled(face, newUV));
+	}
+
+	if (pFilterParameters.currentMipLevel == 0)
+	{
+		outLUT = LUT(inUV.x, inUV.y);
+	}
+#endif
+}
+
+#ifndef MULTIVIEW
+// The light CDF is built with two scans in fragment passes: lightRowCdf sums the texel weights along each row,
+// lightMarginalCdf the row totals. Each fragment sums its own prefix, the rows are at most a few hundred texels long
+
+// entry point, renders the side x 6 * side row CDF to the first attachment
+void lightRowCdf()
+{
+	int side = int(pFilterParameters.lightCdfSide);
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	int face = pixel.y / side;
+	int y = pixel.y - face * side;
+
+	float prefix = 0.0;
+	for(int x = 0; x <= pixel.x; ++x)
+	{
+		vec2 st = (vec2(x, y) + 0.5) / float(side) * 2.0 - 1.0;
+		vec3 color = textureLod(uCubeMap, cubeFaceToDirection(face, st), float(pFilterParameters.lightCdfLevel)).rgb;
+
+		// luminance times solid angle, the samples follow the radiant intensity of the environment
+		prefix += max(luminance(color), 0.0) * cubeFaceSolidAngleFactor(st);
+	}
+
+	outFace0 = vec4(prefix);
+}
+
+// entry point, renders the 1 x 6 * side marginal CDF to the first attachment
+void lightMarginalCdf()
+{
+	int row = int(gl_FragCoord.y);
+	int last = int(pFilterParameters.lightCdfSide) - 1;
+
+	float prefix = 0.0;
+	for(int r = 0; r <= row; ++r)
+	{
+		prefix += texelFetch(uLightCdf, ivec2(last, r), 0).x;
+	}
+
+	outFace0 = vec4(prefix);
+}
+#endif
+
+// Sun extraction
+// The sun is every texel within cSunConeCos of the brightest texel of level 0 that is cSunContrast times brighter than the mean
+// of the environment. The brightest texel is found by reducing each row in parallel and then the row results,
+// the sums over the sun are reduced the same way
+
+const float cSunContrast = 50.0;
+const float cSunConeCos = 0.9975641; // cos(4 degrees)
+
+// st of the center of texel (x, y) of level 0 of the input
+vec2 sunTexelST(int x, int y)
+{
+	return (vec2(x, y) + 0.5) / float(pFilterParameters.width) * 2.0 - 1.0;
+}
+
+// solid angle of a level 0 texel of the input at st
+float sunTexelSolidAngle(vec2 st)
+{
+	float side = float(pFilterParameters.width);
+	return 4.0 / (side * side) * cubeFaceSolidAngleFactor(st);
+}
+
+vec3 sunPeakDirection()
+{
+	vec4 peak = texelFetch(uSunPeak, ivec2(0), 0);
+	int side = int(pFilterParameters.width);
+	int face = int(peak.z) / side;
+
+	return normalize(cubeFaceToDirection(face, sunTexelST(int(peak.y), int(peak.z) - face * side)));
+}
+
+#ifndef MULTIVIEW
+// entry point, renders the brightest texel of each row to the 6 x side first attachment
+void sunRowPeaks()
+{
+	int side = int(pFilterParameters.width);
+	int face = int(gl_FragCoord.x);
+	int y = int(gl_FragCoord.y);
+
+	float peak = -1.0;
+	int peakX = 0;
+	for(int x = 0; x < side; ++x)
+	{
+		float texelLuminance = luminance(textureLod(uCubeMap, cubeFaceToDirection(face, sunTexelST(x, y)), 0.0).rgb);
+		if(texelLuminance > peak)
+		{
+			peak = texelLuminance;
+			peakX = x;
+		}
+	}
+
+	outFace0 = vec4(peak, float(peakX), 0.0, 0.0);
+}
+
+// entry point, renders the brightest texel of the row peaks and the mean luminance to the 1 x 1 first attachment
+void sunPeak()
+{
+	int side = int(pFilterParameters.width);
+
+	vec2 peak = vec2(-1.0, 0.0);
+	int peakRow = 0;
+	for(int face = 0; face < 6; ++face)
+	{
+		for(int y = 0; y < side; ++y)
+		{
+			vec2 rowPeak = texelFetch(uSunRowPeaks, ivec2(face, y), 0).xy;
+			if(rowPeak.x > peak.x)
+			{
+				peak = rowPeak;
+				peakRow = face * side + y;
+			}
+		}
+	}
+
+	// the last level has a single texel per face
+	float mean = 0.0;
+	for(int face = 0; face < 6; ++face)
+	{
+		mean += luminance(textureLod(uCubeMap, cubeFaceToDirection(face, vec2(0.0)), floor(log2(float(side)))).rgb) / 6.0;
+	}
+
+	outFace0 = vec4(peak.x, peak.y, float(peakRow), mean);
+}
+
+// entry point, renders the sums over the sun cone of each row to the 3 * 6 x side first attachment, one sum per column
+void sunRowSums()
+{
+	int side = int(pFilterParameters.width);
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	int face = pixel.x / 3;
+	int sum = pixel.x - face * 3;
+	int y = pixel.y;
+
+	vec3 peakDirection = sunPeakDirection();
+	float threshold = cSunContrast * texelFetch(uSunPeak, ivec2(0), 0).w;
+
+	vec4 sun = vec4(0.0);
+	vec4 sunDirection = vec4(0.0);
+	vec4 surroundings = vec4(0.0);
+	for(int x = 0; x < side; ++x)
+	{
+		vec2 st = sunTexelST(x, y);
+		vec3 direction = normalize(cubeFaceToDirection(face, st));
+		if(dot(direction, peakDirection) < cSunConeCos)
+		{
+			continue;
+		}
+
+		vec3 color = textureLod(uCubeMap, direction, 0.0).rgb;
+		float solidAngle = sunTexelSolidAngle(st);
+		float texelLuminance = luminance(color);
+
+		if(texelLuminance >= threshold)
+		{
+			sun += vec4(color * solidAngle, solidAngle);
+			sunDirection += vec4(direction, 1.0) * texelLuminance * solidAngle;
+		}
+		else
+		{
+			surroundings += vec4(color * solidAngle, solidAngle);
+		}
+	}
+
+	outFace0 = sum == 0 ? sun : (sum == 1 ? sunDirection : surroundings);
+}
+
+// entry point, renders the extracted light to the 3 x 1 first attachment
+void sunLight()
+{
+	int side = int(pFilterParameters.width);
+
+	vec4 sun = vec4(0.0);
+	vec4 sunDirection = vec4(0.0);
+	vec4 surroundings = vec4(0.0);
+	for(int face = 0; face < 6; ++face)
+	{
+		for(int y = 0; y < side; ++y)
+		{
+			sun += texelFetch(uSunRowSums, ivec2(face * 3, y), 0);
+			sunDirection += texelFetch(uSunRowSums, ivec2(face * 3 + 1, y), 0);
+			surroundings += texelFetch(uSunRowSums, ivec2(face * 3 + 2, y), 0);
+		}
+	}
+
+	vec4 peak = texelFetch(uSunPeak, ivec2(0), 0);
+	float threshold = cSunContrast * peak.w;
+	bool found = peak.x >= threshold && sunDirection.w > 0.0;
+
+	// the sun texels are replaced by the mean of the rest of the cone
+	vec3 background = surroundings.w > 0.0 ? surroundings.rgb / surroundings.w : vec3(0.0);
+	vec3 direction = found ? normalize(sunDirection.xyz) : vec3(0.0);
+	// radiance above the background integrated over the sun
+	vec3 color = found ? max(sun.rgb - background * sun.w, vec3(0.0)) : vec3(0.0);
+
+	int column = int(gl_FragCoord.x);
+	outFace0 = column == 0 ? vec4(direction, found ? sun.w : 0.0) : (column == 1 ? vec4(color, found ? 1.0 : 0.0) : vec4(background, threshold));
+}
+#endif
+
+// level 0 texel of the input at the fragment with the sun replaced by its background
+vec3 removeSunFace(int face)
+{
+	vec2 st = gl_FragCoord.xy / float(pFilterParameters.width) * 2.0 - 1.0;
+	vec3 direction = normalize(cubeFaceToDirection(face, st));
+	vec3 color = textureLod(uCubeMap, direction, 0.0).rgb;
+
+	vec4 background = texelFetch(uSunLight, ivec2(2, 0), 0);
+	bool found = texelFetch(uSunLight, ivec2(1, 0), 0).w > 0.0;
+
+	if(found && dot(direction, sunPeakDirection()) >= cSunConeCos && luminance(color) >= background.w)
+	{
+		return background.rgb;
+	}
+	return color;
+}
+
+// entry point
+void removeSun()
+{
+#ifdef MULTIVIEW
+	writeFace(gl_ViewIndex, removeSunFace(gl_ViewIndex));
+#else
+	for(int face = 0; face < 6; ++face)
+	{
+		writeFace(face, removeSunFace(face));
+	}
+#endif
+}
+
+#ifdef MULTIVIEW
+// entry point, all attachments of a multiview pass are layered so the LUT gets a pass of its own
+void computeLUT()
+{
+	// x-coordinate: NdotV
+	// y-coordinate: roughness
+	outColor = vec4(LUT(inUV.x, inUV.y), 1.0);
 }
+#endif
 )""
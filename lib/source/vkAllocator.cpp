@@ -0,0 +1,429 @@
+#include "vkAllocator.h"
+#include <algorithm>
+#include <iterator>
+#include "stdio.h"
+
+namespace
+{
+	inline VkDeviceSize alignUp(VkDeviceSize _value, VkDeviceSize _alignment)
+	{
+		return _alignment > 1u ? ((_value + _alignment - 1u) / _alignment) * _alignment : _value;
+	}
+
+	inline VkDeviceSize alignDown(VkDeviceSize _value, VkDeviceSize _alignment)
+	{
+		return _alignment > 1u ? (_value / _alignment) * _alignment : _value;
+	}
+}
+
+IBLLib::vkAllocator::vkAllocator()
+{
+}
+
+IBLLib::vkAllocator::~vkAllocator()
+{
+	shutdown();
+}
+
+void IBLLib::vkAllocator::initialize(VkDevice _device, const VkPhysicalDeviceMemoryProperties& _memoryProperties, const VkPhysicalDeviceLimits& _limits, VkDeviceSize _blockSize)
+{
+	m_device = _device;
+	m_memoryProperties = _memoryProperties;
+	m_blockSize = _blockSize;
+	m_bufferImageGranularity = std::max<VkDeviceSize>(_limits.bufferImageGranularity, 1u);
+	m_nonCoherentAtomSize = std::max<VkDeviceSize>(_limits.nonCoherentAtomSize, 1u);
+	m_peakBytesAllocated = 0u;
+}
+
+void IBLLib::vkAllocator::shutdown()
+{
+	if (m_device != VK_NULL_HANDLE)
+	{
+		for (const std::unique_ptr<Block>& block : m_blocks)
+		{
+			if (block->allocationCount != 0u)
+			{
+				printf("Memory block still holds %u allocations at shutdown\n", block->allocationCount);
+			}
+
+			vkFreeMemory(m_device, block->memory, nullptr);
+		}
+	}
+
+	m_blocks.clear();
+	m_device = VK_NULL_HANDLE;
+}
+
+bool IBLLib::vkAllocator::Block::tryAllocate(const VkMemoryRequirements& _requirements, VkDeviceSize& _outOffset)
+{
+	if (scope == AllocationScope::Transient)
+	{
+		const VkDeviceSize offset = alignUp(head, _requirements.alignment);
+		if (offset + _requirements.size > size)
+		{
+			return false;
+		}
+
+		head = offset + _requirements.size;
+		_outOffset = offset;
+		return true;
+	}
+
+	// best fit: smallest free range the aligned request fits into
+	auto best = freeRanges.end();
+	VkDeviceSize bestSize = VK_WHOLE_SIZE;
+
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+	{
+		const VkDeviceSize offset = alignUp(it->first, _requirements.alignment);
+		const VkDeviceSize end = it->first + it->second;
+
+		if (offset + _requirements.size <= end && it->second < bestSize)
+		{
+			best = it;
+			bestSize = it->second;
+		}
+	}
+
+	if (best == freeRanges.end())
+	{
+		return false;
+	}
+
+	const VkDeviceSize rangeOffset = best->first;
+	const VkDeviceSize rangeEnd = best->first + best->second;
+	const VkDeviceSize offset = alignUp(rangeOffset, _requirements.alignment);
+	const VkDeviceSize end = offset + _requirements.size;
+
+	freeRanges.erase(best);
+
+	// return the alignment padding in front and the remainder behind to the free list
+	if (offset > rangeOffset)
+	{
+		freeRanges[rangeOffset] = offset - rangeOffset;
+	}
+	if (rangeEnd > end)
+	{
+		freeRanges[end] = rangeEnd - end;
+	}
+
+	_outOffset = offset;
+	return true;
+}
+
+void IBLLib::vkAllocator::Block::release(VkDeviceSize _offset, VkDeviceSize _size)
+{
+	if (scope == AllocationScope::Transient)
+	{
+		// arena blocks are rewound as a whole once empty
+		if (allocationCount == 0u)
+		{
+			head = 0u;
+		}
+		return;
+	}
+
+	auto it = freeRanges.emplace(_offset, _size).first;
+
+	// merge with the following range
+	auto next = std::next(it);
+	if (next != freeRanges.end() && it->first + it->second == next->first)
+	{
+		it->second += next->second;
+		freeRanges.erase(next);
+	}
+
+	// merge with the preceding range
+	if (it != freeRanges.begin())
+	{
+		auto prev = std::prev(it);
+		if (prev->first + prev->second == it->first)
+		{
+			prev->second += it->second;
+			freeRanges.erase(it);
+		}
+	}
+}
+
+VkResult IBLLib::vkAllocator::allocateBlock(VkDeviceSize _size, uint32_t _memoryTypeIndex, bool _linearResource, AllocationScope _scope, bool _dedicated, Block*& _outBlock)
+{
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext = nullptr;
+	allocInfo.allocationSize = _size;
+	allocInfo.memoryTypeIndex = _memoryTypeIndex;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkResult res = vkAllocateMemory(m_device, &allocInfo, nullptr, &memory);
+	if (res != VK_SUCCESS)
+	{
+		printf("Failed to allocate memory block of %llu bytes [%u]\n", static_cast<unsigned long long>(_size), res);
+		return res;
+	}
+
+	const VkMemoryPropertyFlags properties = m_memoryProperties.memoryTypes[_memoryTypeIndex].propertyFlags;
+
+	void* mapped = nullptr;
+	if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		// map once for the lifetime of the block, sub-allocations hand out offsets into this mapping
+		if ((res = vkMapMemory(m_device, memory, 0u, VK_WHOLE_SIZE, 0u, &mapped)) != VK_SUCCESS)
+		{
+			printf("Failed to map memory block [%u]\n", res);
+			vkFreeMemory(m_device, memory, nullptr);
+			return res;
+		}
+	}
+
+	std::unique_ptr<Block> block(new Block());
+	block->memory = memory;
+	block->size = _size;
+	block->mapped = mapped;
+	block->coherent = (properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0u;
+	block->memoryTypeIndex = _memoryTypeIndex;
+	block->linearResources = _linearResource;
+	block->dedicated = _dedicated;
+	block->scope = _scope;
+
+	if (_scope == AllocationScope::Persistent)
+	{
+		block->freeRanges.emplace(0u, _size);
+	}
+
+	_outBlock = block.get();
+	m_blocks.emplace_back(std::move(block));
+
+	VkDeviceSize bytesAllocated = 0u;
+	for (const std::unique_ptr<Block>& b : m_blocks)
+	{
+		bytesAllocated += b->size;
+	}
+	m_peakBytesAllocated = std::max(m_peakBytesAllocated, bytesAllocated);
+
+	return res;
+}
+
+void IBLLib::vkAllocator::freeBlock(Block* _block)
+{
+	for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it)
+	{
+		if (it->get() == _block)
+		{
+			vkFreeMemory(m_device, _block->memory, nullptr);
+			m_blocks.erase(it);
+			return;
+		}
+	}
+}
+
+VkResult IBLLib::vkAllocator::allocate(const VkMemoryRequirements& _requirements, uint32_t _memoryTypeIndex, bool _linearResource, AllocationScope _scope, MemoryAllocation& _outAllocation)
+{
+	if (m_device == VK_NULL_HANDLE || _memoryTypeIndex >= m_memoryProperties.memoryTypeCount)
+	{
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	// don't let a single block take more than an eighth of a small heap (integrated GPUs)
+	const VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[_memoryTypeIndex].heapIndex].size;
+	const VkDeviceSize blockSize = std::max<VkDeviceSize>(std::min(m_blockSize, heapSize / 8u), m_bufferImageGranularity);
+
+	VkMemoryRequirements requirements = _requirements;
+
+	// keep non-coherent allocations on separate atoms so that flushing / invalidating one never touches a neighbour
+	const VkMemoryPropertyFlags properties = m_memoryProperties.memoryTypes[_memoryTypeIndex].propertyFlags;
+	if ((properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && (properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0u)
+	{
+		requirements.alignment = std::max(requirements.alignment, m_nonCoherentAtomSize);
+		requirements.size = alignUp(requirements.size, m_nonCoherentAtomSize);
+	}
+
+	Block* block = nullptr;
+	VkDeviceSize offset = 0u;
+	VkResult res = VK_SUCCESS;
+
+	if (requirements.size > blockSize / 2u)
+	{
+		// large resources (panorama, output cube maps) get a block of their own
+		if ((res = allocateBlock(requirements.size, _memoryTypeIndex, _linearResource, _scope, true, block)) != VK_SUCCESS)
+		{
+			return res;
+		}
+
+		block->freeRanges.clear();
+		block->head = requirements.size;
+	}
+	else
+	{
+		for (const std::unique_ptr<Block>& b : m_blocks)
+		{
+			if (b->dedicated == false &&
+				b->memoryTypeIndex == _memoryTypeIndex &&
+				b->linearResources == _linearResource &&
+				b->scope == _scope &&
+				b->tryAllocate(requirements, offset))
+			{
+				block = b.get();
+				break;
+			}
+		}
+
+		if (block == nullptr)
+		{
+			if ((res = allocateBlock(blockSize, _memoryTypeIndex, _linearResource, _scope, false, block)) != VK_SUCCESS)
+			{
+				return res;
+			}
+
+			if (block->tryAllocate(requirements, offset) == false)
+			{
+				return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+			}
+		}
+	}
+
+	block->allocationCount++;
+	block->usedBytes += requirements.size;
+
+	_outAllocation.memory = block->memory;
+	_outAllocation.offset = offset;
+	_outAllocation.size = requirements.size;
+	_outAllocation.mapped = block->mapped != nullptr ? static_cast<uint8_t*>(block->mapped) + offset : nullptr;
+	_outAllocation.block = block;
+
+	return res;
+}
+
+void IBLLib::vkAllocator::free(MemoryAllocation& _allocation)
+{
+	Block* block = static_cast<Block*>(_allocation.block);
+	if (block == nullptr)
+	{
+		return;
+	}
+
+	block->allocationCount--;
+	block->usedBytes -= _allocation.size;
+
+	if (block->dedicated == false)
+	{
+		block->release(_allocation.offset, _allocation.size);
+	}
+
+	if (block->allocationCount == 0u)
+	{
+		// keep one empty block per memory type / resource kind / scope around for the next job
+		bool hasSpare = block->dedicated;
+		for (const std::unique_ptr<Block>& b : m_blocks)
+		{
+			if (hasSpare)
+			{
+				break;
+			}
+
+			hasSpare = b.get() != block && b->dedicated == false && b->allocationCount == 0u &&
+				b->memoryTypeIndex == block->memoryTypeIndex &&
+				b->linearResources == block->linearResources &&
+				b->scope == block->scope;
+		}
+
+		if (hasSpare)
+		{
+			freeBlock(block);
+		}
+	}
+
+	_allocation = MemoryAllocation();
+}
+
+bool IBLLib::vkAllocator::getMappedRange(const MemoryAllocation& _allocation, VkDeviceSize _offset, VkDeviceSize _size, VkMappedMemoryRange& _outRange) const
+{
+	const Block* block = static_cast<const Block*>(_allocation.block);
+	if (block == nullptr || block->mapped == nullptr || block->coherent)
+	{
+		return false;
+	}
+
+	const VkDeviceSize begin = _allocation.offset + std::min(_offset, _allocation.size);
+	const VkDeviceSize end = _size == VK_WHOLE_SIZE ? _allocation.offset + _allocation.size : std::min(begin + _size, _allocation.offset + _allocation.size);
+
+	_outRange = {};
+	_outRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	_outRange.memory = block->memory;
+	_outRange.offset = alignDown(begin, m_nonCoherentAtomSize);
+	// ranges have to be a multiple of nonCoherentAtomSize or end at the end of the memory object
+	_outRange.size = std::min(alignUp(end, m_nonCoherentAtomSize), block->size) - _outRange.offset;
+
+	return true;
+}
+
+VkResult IBLLib::vkAllocator::flush(const MemoryAllocation& _allocation, VkDeviceSize _offset, VkDeviceSize _size) const
+{
+	VkMappedMemoryRange range{};
+	if (getMappedRange(_allocation, _offset, _size, range) == false)
+	{
+		return VK_SUCCESS;
+	}
+
+	return vkFlushMappedMemoryRanges(m_device, 1u, &range);
+}
+
+VkResult IBLLib::vkAllocator::invalidate(const MemoryAllocation& _allocation, VkDeviceSize _offset, VkDeviceSize _size) const
+{
+	VkMappedMemoryRange range{};
+	if (getMappedRange(_allocation, _offset, _size, range) == false)
+	{
+		return VK_SUCCESS;
+	}
+
+	return vkInvalidateMappedMemoryRanges(m_device, 1u, &range);
+}
+
+IBLLib::MemoryStatistics IBLLib::vkAllocator::getStatistics() const
+{
+	MemoryStatistics stats{};
+	VkDeviceSize freeBytes = 0u;
+	VkDeviceSize contiguousFreeBytes = 0u; // sum of the largest free range of each block
+
+	for (const std::unique_ptr<Block>& block : m_blocks)
+	{
+		stats.blockCount++;
+		stats.dedicatedBlockCount += block->dedicated ? 1u : 0u;
+		stats.allocationCount += block->allocationCount;
+		stats.bytesAllocated += block->size;
+		stats.bytesUsed += block->usedBytes;
+
+		VkDeviceSize largestFreeRange = 0u;
+
+		if (block->scope == AllocationScope::Persistent)
+		{
+			for (const auto& range : block->freeRanges)
+			{
+				freeBytes += range.second;
+				largestFreeRange = std::max(largestFreeRange, range.second);
+			}
+		}
+		else if (block->dedicated == false)
+		{
+			largestFreeRange = block->size - block->head;
+			freeBytes += largestFreeRange;
+		}
+
+		contiguousFreeBytes += largestFreeRange;
+		stats.largestFreeRange = std::max(stats.largestFreeRange, largestFreeRange);
+	}
+
+	stats.peakBytesAllocated = m_peakBytesAllocated;
+	stats.fragmentation = freeBytes > 0u ? 1.f - static_cast<float>(contiguousFreeBytes) / static_cast<float>(freeBytes) : 0.f;
+
+	return stats;
+}
+
+void IBLLib::vkAllocator::printStatistics() const
+{
+	const MemoryStatistics stats = getStatistics();
+
+	printf("Device memory: %u blocks (%u dedicated), %u allocations, %.2f MiB used of %.2f MiB allocated (peak %.2f MiB), largest free range %.2f MiB, fragmentation %.2f\n",
+		stats.blockCount, stats.dedicatedBlockCount, stats.allocationCount,
+		stats.bytesUsed / (1024.0 * 1024.0), stats.bytesAllocated / (1024.0 * 1024.0), stats.peakBytesAllocated / (1024.0 * 1024.0),
+		stats.largestFreeRange / (1024.0 * 1024.0), stats.fragmentation);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <map>
+#include <memory>
+
+namespace IBLLib
+{
+	// Transient allocations are placed in linear arena blocks that are rewound once every allocation in the block was freed (per-job staging, intermediate targets).
+	// Persistent allocations are placed in free-list blocks that coalesce neighbouring free ranges.
+	enum class AllocationScope
+	{
+		Persistent = 0,
+		Transient
+	};
+
+	struct MemoryAllocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0u;
+		VkDeviceSize size = 0u;
+		void* mapped = nullptr; // persistently mapped host address of offset, nullptr if the memory is not host visible
+		void* block = nullptr; // owning block, opaque to the user
+	};
+
+	struct MemoryStatistics
+	{
+		uint32_t blockCount = 0u; // number of VkDeviceMemory objects currently allocated
+		uint32_t dedicatedBlockCount = 0u; // blocks that hold a single oversized resource
+		uint32_t allocationCount = 0u; // live sub-allocations
+		VkDeviceSize bytesAllocated = 0u; // sum of all block sizes
+		VkDeviceSize bytesUsed = 0u; // sum of all live sub-allocation sizes
+		VkDeviceSize peakBytesAllocated = 0u;
+		VkDeviceSize largestFreeRange = 0u; // largest contiguous free range over all free-list blocks
+		float fragmentation = 0.f; // 0 = free memory of each block is contiguous, towards 1 = free memory is scattered in small ranges
+	};
+
+	class vkAllocator
+	{
+	public:
+		static constexpr VkDeviceSize DefaultBlockSize = 256ull * 1024ull * 1024ull;
+
+		vkAllocator();
+		~vkAllocator();
+
+		void initialize(VkDevice _device, const VkPhysicalDeviceMemoryProperties& _memoryProperties, const VkPhysicalDeviceLimits& _limits, VkDeviceSize _blockSize = DefaultBlockSize);
+
+		// frees all blocks, resources bound to them must have been destroyed before
+		void shutdown();
+
+		// _linearResource: buffers and linear tiled images are kept in different blocks than optimal tiled images so that bufferImageGranularity never has to be considered between neighbours
+		VkResult allocate(const VkMemoryRequirements& _requirements, uint32_t _memoryTypeIndex, bool _linearResource, AllocationScope _scope, MemoryAllocation& _outAllocation);
+
+		void free(MemoryAllocation& _allocation);
+
+		// make host writes visible to the device / device writes visible to the host, no-op for host coherent memory.
+		// _offset and _size are relative to the allocation and get expanded to nonCoherentAtomSize
+		VkResult flush(const MemoryAllocation& _allocation, VkDeviceSize _offset = 0u, VkDeviceSize _size = VK_WHOLE_SIZE) const;
+		VkResult invalidate(const MemoryAllocation& _allocation, VkDeviceSize _offset = 0u, VkDeviceSize _size = VK_WHOLE_SIZE) const;
+
+		MemoryStatistics getStatistics() const;
+
+		void printStatistics() const;
+
+	private:
+		struct Block
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0u;
+			void* mapped = nullptr; // host visible blocks stay mapped until they are freed
+			bool coherent = true;
+			uint32_t memoryTypeIndex = 0u;
+			bool linearResources = true;
+			bool dedicated = false;
+			AllocationScope scope = AllocationScope::Persistent;
+
+			uint32_t allocationCount = 0u;
+			VkDeviceSize usedBytes = 0u;
+
+			// Persistent: offset -> size of free ranges
+			std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+
+			// Transient: bump pointer
+			VkDeviceSize head = 0u;
+
+			bool tryAllocate(const VkMemoryRequirements& _requirements, VkDeviceSize& _outOffset);
+			void release(VkDeviceSize _offset, VkDeviceSize _size);
+		};
+
+		VkResult allocateBlock(VkDeviceSize _size, uint32_t _memoryTypeIndex, bool _linearResource, AllocationScope _scope, bool _dedicated, Block*& _outBlock);
+		void freeBlock(Block* _block);
+		bool getMappedRange(const MemoryAllocation& _allocation, VkDeviceSize _offset, VkDeviceSize _size, VkMappedMemoryRange& _outRange) const;
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+		VkDeviceSize m_blockSize = DefaultBlockSize;
+		VkDeviceSize m_bufferImageGranularity = 1u;
+		VkDeviceSize m_nonCoherentAtomSize = 1u;
+
+		std::vector<std::unique_ptr<Block>> m_blocks;
+		VkDeviceSize m_peakBytesAllocated = 0u;
+	};
+} // IBLLib
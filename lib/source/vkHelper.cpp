@@ -1,9 +1,70 @@
 #include "vkHelper.h"
 #include "FileHelper.h"
 #include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cstdlib>
 #include "stdio.h"
 
-constexpr auto g_PipelineCachePath = "pipeline.cache";
+namespace
+{
+	constexpr auto g_PipelineCacheDirectoryVariable = "IBLSAMPLER_PIPELINE_CACHE_DIR";
+
+	std::string getPipelineCachePath(const char* _directory, const VkPhysicalDeviceProperties& _properties)
+	{
+		if (_directory == nullptr)
+		{
+			_directory = getenv(g_PipelineCacheDirectoryVariable);
+		}
+
+		std::string path;
+		if (_directory != nullptr && _directory[0] != '\0')
+		{
+			IBLLib::createDirectory(_directory);
+
+			path = _directory;
+			if (path.back() != '/' && path.back() != '\\')
+			{
+				path += '/';
+			}
+		}
+
+		// caches of other devices or drivers are rejected by the driver anyway, keep them apart instead of overwriting each other
+		char name[64];
+		snprintf(name, sizeof(name), "pipeline_%04x_%04x_%08x_", _properties.vendorID, _properties.deviceID, _properties.driverVersion);
+		path += name;
+
+		for (uint32_t i = 0u; i < VK_UUID_SIZE; ++i)
+		{
+			snprintf(name, sizeof(name), "%02x", _properties.pipelineCacheUUID[i]);
+			path += name;
+		}
+
+		return path + ".cache";
+	}
+
+	// checks the VkPipelineCacheHeaderVersionOne header (size, version, vendor, device and cache UUID),
+	// drivers are not required to reject foreign or truncated data gracefully
+	bool isPipelineCacheCompatible(const uint8_t* _data, size_t _size, const VkPhysicalDeviceProperties& _properties)
+	{
+		uint32_t header[4];
+		constexpr size_t HeaderSize = sizeof(header) + VK_UUID_SIZE;
+
+		if (_data == nullptr || _size < HeaderSize)
+		{
+			return false;
+		}
+
+		memcpy(header, _data, sizeof(header));
+
+		return header[0] >= HeaderSize && header[0] <= _size &&
+			header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			header[2] == _properties.vendorID &&
+			header[3] == _properties.deviceID &&
+			memcmp(_data + sizeof(header), _properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+} // !anonymous
 
 IBLLib::vkHelper::vkHelper()
 {
@@ -14,7 +75,7 @@ IBLLib::vkHelper::~vkHelper()
 	shutdown();
 }
 
-VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descriptorPoolSizeFactor, bool _debugOutput)
+VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, bool _debugOutput, const char* _pipelineCacheDirectory)
 {
 	VkResult res = VK_RESULT_MAX_ENUM;
 	m_debugOutputEnabled = _debugOutput;
@@ -29,7 +90,16 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "IBLLib";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+
+		// 1.1 is requested for multiview and 1.2 for timeline semaphores, 1.0 loaders don't export vkEnumerateInstanceVersion
+		m_instanceApiVersion = VK_API_VERSION_1_0;
+		PFN_vkEnumerateInstanceVersion enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion"));
+		if (enumerateInstanceVersion != nullptr && enumerateInstanceVersion(&m_instanceApiVersion) != VK_SUCCESS)
+		{
+			m_instanceApiVersion = VK_API_VERSION_1_0;
+		}
+
+		appInfo.apiVersion = m_instanceApiVersion >= VK_API_VERSION_1_2 ? VK_API_VERSION_1_2 : (m_instanceApiVersion >= VK_API_VERSION_1_1 ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0);
 
 		std::vector<const char*> layers;
 		if (_debugOutput)
@@ -90,6 +160,9 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 	// Select physical device
 	//
 
+	// 1.1 devices without 1.2 provide timeline semaphores through the extension
+	bool timelineSemaphoreExtension = false;
+
 	{
 		uint32_t deviceCount = 0;
 		if ((res = vkEnumeratePhysicalDevices(m_instance, &deviceCount, nullptr)) != VK_SUCCESS)
@@ -113,14 +186,68 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 
 		m_physicalDevice = devices[_phyDeviceIndex];
 
-		VkPhysicalDeviceProperties deviceProperties;
-		vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+		vkGetPhysicalDeviceProperties(m_physicalDevice, &m_deviceProperties);
+
+		printf("Physical Device created: %s\n", m_deviceProperties.deviceName);
+		printf("APIVersion: %u.%u.%u\n", VK_VERSION_MAJOR(m_deviceProperties.apiVersion), VK_VERSION_MINOR(m_deviceProperties.apiVersion), VK_VERSION_PATCH(m_deviceProperties.apiVersion));
+		printf("DriverVersion: %u\n", m_deviceProperties.driverVersion);
 
-		printf("Physical Device created: %s\n", deviceProperties.deviceName);
-		printf("APIVersion: %u.%u.%u\n", VK_VERSION_MAJOR(deviceProperties.apiVersion), VK_VERSION_MINOR(deviceProperties.apiVersion), VK_VERSION_PATCH(deviceProperties.apiVersion));
-		printf("DriverVersion: %u\n", deviceProperties.driverVersion);
+		m_deviceLimits = m_deviceProperties.limits;
 
 		vkGetPhysicalDeviceFeatures(m_physicalDevice, &m_deviceFeatures); // TODO: check needed features
+
+		// multiview is core in 1.1, devices supporting it render at least 6 views.
+		// timeline semaphores are core in 1.2, without them submissions are tracked with recycled fences
+		m_multiviewEnabled = false;
+		m_timelineSemaphoresEnabled = false;
+		if (m_instanceApiVersion >= VK_API_VERSION_1_1 && m_deviceProperties.apiVersion >= VK_API_VERSION_1_1)
+		{
+			const bool timelineSemaphoreCore = m_instanceApiVersion >= VK_API_VERSION_1_2 && m_deviceProperties.apiVersion >= VK_API_VERSION_1_2;
+			if (timelineSemaphoreCore == false)
+			{
+				uint32_t extensionCount = 0u;
+				vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, nullptr);
+
+				std::vector<VkExtensionProperties> extensions(extensionCount);
+				vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, extensions.data());
+
+				for (const VkExtensionProperties& extension : extensions)
+				{
+					if (strcmp(extension.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0)
+					{
+						timelineSemaphoreExtension = true;
+						break;
+					}
+				}
+			}
+
+			PFN_vkGetPhysicalDeviceFeatures2 getPhysicalDeviceFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2>(vkGetInstanceProcAddr(m_instance, "vkGetPhysicalDeviceFeatures2"));
+			if (getPhysicalDeviceFeatures2 != nullptr)
+			{
+				VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures{};
+				timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+
+				VkPhysicalDeviceMultiviewFeatures multiviewFeatures{};
+				multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+				multiviewFeatures.pNext = timelineSemaphoreCore || timelineSemaphoreExtension ? &timelineSemaphoreFeatures : nullptr;
+
+				VkPhysicalDeviceFeatures2 features{};
+				features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+				features.pNext = &multiviewFeatures;
+
+				getPhysicalDeviceFeatures2(m_physicalDevice, &features);
+				m_multiviewEnabled = multiviewFeatures.multiview == VK_TRUE;
+				m_timelineSemaphoresEnabled = timelineSemaphoreFeatures.timelineSemaphore == VK_TRUE;
+			}
+
+			timelineSemaphoreExtension = timelineSemaphoreExtension && m_timelineSemaphoresEnabled;
+		}
+
+		if (m_debugOutputEnabled)
+		{
+			printf("Multiview: %s\n", m_multiviewEnabled ? "enabled" : "not supported");
+			printf("Timeline semaphores: %s\n", m_timelineSemaphoresEnabled ? (timelineSemaphoreExtension ? "enabled (VK_KHR_timeline_semaphore)" : "enabled") : "not supported, using fences");
+		}
 		vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);		
 	}
 
@@ -128,7 +255,10 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 	// Select queue & logical device
 	//
 
-	m_queueFamilyIndex = UINT32_MAX;
+	Queue& graphicsQueue = getQueue(QueueType::Graphics);
+	Queue& transferQueue = getQueue(QueueType::Transfer);
+	graphicsQueue.familyIndex = UINT32_MAX;
+	transferQueue.familyIndex = UINT32_MAX;
 
 	{
 		uint32_t queueFamilyCount = 0;
@@ -137,7 +267,7 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 		vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
 
-		for (uint32_t i = 0; i < queueFamilyCount && m_queueFamilyIndex == UINT32_MAX; ++i)
+		for (uint32_t i = 0; i < queueFamilyCount && graphicsQueue.familyIndex == UINT32_MAX; ++i)
 		{
 			const VkQueueFamilyProperties& family = queueFamilies[i];
 
@@ -146,36 +276,94 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 				&& (family.queueFlags & VK_QUEUE_TRANSFER_BIT)
 				)
 			{
-				m_queueFamilyIndex = i;
+				graphicsQueue.familyIndex = i;
 			}
 		}
 
-		if (m_queueFamilyIndex == UINT32_MAX)
+		if (graphicsQueue.familyIndex == UINT32_MAX)
 		{
 			printf("Failed to find matching queue family\n");
 			return VK_RESULT_MAX_ENUM;
 		}
 
+		// prefer a transfer only family (DMA engine), its minImageTransferGranularity may be coarser than a texel, see getMinImageTransferGranularity
+		for (uint32_t i = 0; i < queueFamilyCount && transferQueue.familyIndex == UINT32_MAX; ++i)
+		{
+			const VkQueueFamilyProperties& family = queueFamilies[i];
+
+			if (family.queueCount > 0u
+				&& (family.queueFlags & VK_QUEUE_TRANSFER_BIT)
+				&& (family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0u
+				)
+			{
+				transferQueue.familyIndex = i;
+			}
+		}
+
+		// otherwise a second queue of the graphics family, or timeslice the graphics queue
+		uint32_t transferQueueIndex = 0u;
+		if (transferQueue.familyIndex == UINT32_MAX)
+		{
+			transferQueue.familyIndex = graphicsQueue.familyIndex;
+			transferQueueIndex = queueFamilies[graphicsQueue.familyIndex].queueCount > 1u ? 1u : 0u;
+		}
+
+		graphicsQueue.timestampValidBits = queueFamilies[graphicsQueue.familyIndex].timestampValidBits;
+		transferQueue.timestampValidBits = queueFamilies[transferQueue.familyIndex].timestampValidBits;
+		graphicsQueue.minImageTransferGranularity = queueFamilies[graphicsQueue.familyIndex].minImageTransferGranularity;
+		transferQueue.minImageTransferGranularity = queueFamilies[transferQueue.familyIndex].minImageTransferGranularity;
+
 		if (m_debugOutputEnabled)
 		{
-			printf("Selected queue index %u\n", m_queueFamilyIndex);
+			printf("Selected queue index %u\n", graphicsQueue.familyIndex);
+			printf("Selected transfer queue index %u (queue %u)\n", transferQueue.familyIndex, transferQueueIndex);
+		}
+
+		const float queuePriorities[2] = { 1.0f, 1.0f };
+		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos(1u);
+		{
+			VkDeviceQueueCreateInfo& queueCreateInfo = queueCreateInfos.front();
+			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueCreateInfo.queueFamilyIndex = graphicsQueue.familyIndex;
+			queueCreateInfo.queueCount = transferQueue.familyIndex == graphicsQueue.familyIndex ? transferQueueIndex + 1u : 1u;
+			queueCreateInfo.pQueuePriorities = queuePriorities;
 		}
 
-		float queuePriority = 1.0f;
-		VkDeviceQueueCreateInfo queueCreateInfo{};
-		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queueCreateInfo.queueFamilyIndex = m_queueFamilyIndex;
-		queueCreateInfo.queueCount = 1u;
-		queueCreateInfo.pQueuePriorities = &queuePriority;
+		if (transferQueue.familyIndex != graphicsQueue.familyIndex)
+		{
+			queueCreateInfos.emplace_back();
+			VkDeviceQueueCreateInfo& queueCreateInfo = queueCreateInfos.back();
+			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueCreateInfo.queueFamilyIndex = transferQueue.familyIndex;
+			queueCreateInfo.queueCount = 1u;
+			queueCreateInfo.pQueuePriorities = queuePriorities;
+		}
 
 		VkPhysicalDeviceFeatures deviceFeatures{}; // TODO: fill required device features
 
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures{};
+		timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+
+		VkPhysicalDeviceMultiviewFeatures multiviewFeatures{};
+		multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+		multiviewFeatures.pNext = m_timelineSemaphoresEnabled ? &timelineSemaphoreFeatures : nullptr;
+		multiviewFeatures.multiview = m_multiviewEnabled ? VK_TRUE : VK_FALSE;
+
+		std::vector<const char*> extensions;
+		if (timelineSemaphoreExtension)
+		{
+			extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		}
+
 		VkDeviceCreateInfo deviceCreateInfo{};
 		deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-		deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-		deviceCreateInfo.queueCreateInfoCount = 1u;
+		deviceCreateInfo.pNext = m_multiviewEnabled || m_timelineSemaphoresEnabled ? &multiviewFeatures : nullptr;
+		deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
+		deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
-		deviceCreateInfo.enabledExtensionCount = 0u;
+		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
 
 		if ((res = vkCreateDevice(m_physicalDevice, &deviceCreateInfo, nullptr, &m_logicalDevice)) != VK_SUCCESS)
 		{
@@ -187,21 +375,34 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		{
 			printf("Logical device created\n");
 		}
-		vkGetDeviceQueue(m_logicalDevice, m_queueFamilyIndex, 0, &m_queue);
+		vkGetDeviceQueue(m_logicalDevice, graphicsQueue.familyIndex, 0, &graphicsQueue.queue);
+		vkGetDeviceQueue(m_logicalDevice, transferQueue.familyIndex, transferQueueIndex, &transferQueue.queue);
+
+		if (m_timelineSemaphoresEnabled)
+		{
+			const char* waitSemaphores = timelineSemaphoreExtension ? "vkWaitSemaphoresKHR" : "vkWaitSemaphores";
+			const char* getSemaphoreCounterValue = timelineSemaphoreExtension ? "vkGetSemaphoreCounterValueKHR" : "vkGetSemaphoreCounterValue";
+			m_waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphores>(vkGetDeviceProcAddr(m_logicalDevice, waitSemaphores));
+			m_getSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValue>(vkGetDeviceProcAddr(m_logicalDevice, getSemaphoreCounterValue));
+			m_timelineSemaphoresEnabled = m_waitSemaphores != nullptr && m_getSemaphoreCounterValue != nullptr;
+		}
+
+		m_allocator.initialize(m_logicalDevice, m_memoryProperties, m_deviceLimits);
 	}
 
 	//
 	// Create command pool
 	//
 
+	for (Queue& queue : m_queues)
 	{
 		VkCommandPoolCreateInfo cmdPoolCreateInfo{};
 		cmdPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		cmdPoolCreateInfo.pNext = nullptr;
 		cmdPoolCreateInfo.flags = /*VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | */VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		cmdPoolCreateInfo.queueFamilyIndex = m_queueFamilyIndex;
+		cmdPoolCreateInfo.queueFamilyIndex = queue.familyIndex;
 
-		if ((res = vkCreateCommandPool(m_logicalDevice, &cmdPoolCreateInfo, nullptr, &m_commandPool)) != VK_SUCCESS)
+		if ((res = vkCreateCommandPool(m_logicalDevice, &cmdPoolCreateInfo, nullptr, &queue.commandPool)) != VK_SUCCESS)
 		{
 			printf("Failed to create command pool [%u]\n", res);
 			return res;
@@ -210,46 +411,24 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		{
 			printf("Command pool created\n");
 		}
-	}
 
-	//
-	// Create descriptor pool
-	//
+		// the counter of a queue's timeline is the ticket of its last completed submission
+		if (m_timelineSemaphoresEnabled)
+		{
+			VkSemaphoreTypeCreateInfo typeInfo{};
+			typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			typeInfo.initialValue = queue.lastSubmittedTicket;
 
-	{
-		constexpr uint32_t descCount = 8u;
-		constexpr uint32_t setCount = 8u;
-
-		// TODO: remove unneeded descriptor types
-		VkDescriptorPoolSize sizes[] = {
-			{VK_DESCRIPTOR_TYPE_SAMPLER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, descCount * _descriptorPoolSizeFactor}
-		};
-
-		VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{};
-		descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		descriptorPoolCreateInfo.pNext = nullptr;
-		descriptorPoolCreateInfo.pPoolSizes = sizes;
-		descriptorPoolCreateInfo.poolSizeCount = sizeof(sizes) / sizeof(VkDescriptorPoolSize);
-		descriptorPoolCreateInfo.maxSets = setCount * _descriptorPoolSizeFactor;
-
-		if ((res = vkCreateDescriptorPool(m_logicalDevice, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool)) != VK_SUCCESS)
-		{
-			printf("Failed to create descriptor pool [%u]\n", res);
-			return res;
-		}
+			VkSemaphoreCreateInfo semaphoreInfo{};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			semaphoreInfo.pNext = &typeInfo;
 
-		if (m_debugOutputEnabled)
-		{
-			printf("Descriptor pool created\n");
+			if ((res = vkCreateSemaphore(m_logicalDevice, &semaphoreInfo, nullptr, &queue.timeline)) != VK_SUCCESS)
+			{
+				printf("Failed to create timeline semaphore [%u]\n", res);
+				return res;
+			}
 		}
 	}
 
@@ -261,13 +440,27 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
 		pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
 
-		std::vector<char> cache;
-		if (readFile(g_PipelineCachePath, cache))
+		m_pipelineCachePath = getPipelineCachePath(_pipelineCacheDirectory, m_deviceProperties);
+		m_pipelineCacheLoadedSize = 0u;
+		m_pipelineCount = 0u;
+		m_pipelineMilliseconds = 0.0;
+
+		// the driver copies the initial data, the mapping is only needed during creation
+		MappedFile cache;
+		if (cache.open(m_pipelineCachePath.c_str(), MappedFile::Access::Random))
 		{
-			printf("Vulkan pipeline cache loaded\n");
-			
-			pipelineCacheCreateInfo.initialDataSize = static_cast<uint32_t>(cache.size());
-			pipelineCacheCreateInfo.pInitialData = cache.data();
+			if (isPipelineCacheCompatible(cache.getData(), cache.getSize(), m_deviceProperties))
+			{
+				printf("Vulkan pipeline cache loaded from %s\n", m_pipelineCachePath.c_str());
+
+				pipelineCacheCreateInfo.initialDataSize = cache.getSize();
+				pipelineCacheCreateInfo.pInitialData = cache.getData();
+				m_pipelineCacheLoadedSize = cache.getSize();
+			}
+			else
+			{
+				printf("Ignoring incompatible pipeline cache %s\n", m_pipelineCachePath.c_str());
+			}
 		}
 
 		if ((res = vkCreatePipelineCache(m_logicalDevice, &pipelineCacheCreateInfo, nullptr, &m_pipelineCache)) != VK_SUCCESS)
@@ -284,321 +477,686 @@ void IBLLib::vkHelper::shutdown()
 {
 	if (m_logicalDevice != VK_NULL_HANDLE)
 	{
-		// clear framebuffer
-		for (const VkFramebuffer& framebuf : m_frameBuffers)
-		{
-			vkDestroyFramebuffer(m_logicalDevice, framebuf, nullptr);
-		}
-		m_frameBuffers.clear();
-
-		for (const VkSampler& sampler : m_samplers)
-		{
-			vkDestroySampler(m_logicalDevice, sampler, nullptr);
-		}
-		m_samplers.clear();
-
-		// clear images
-		for (Image& img : m_images)
-		{
-			img.destroy(m_logicalDevice);
-		}
-		m_images.clear();
+		// resources might still be referenced by pending submissions
+		waitIdle();
 
-		// clear buffers
-		for (Buffer& buf : m_buffers)
+		for (const VkFence& fence : m_freeFences)
 		{
-			buf.destroy(m_logicalDevice);
+			vkDestroyFence(m_logicalDevice, fence, nullptr);
 		}
-		m_buffers.clear();
+		m_freeFences.clear();
 
-		// clear pipelines
-		for (const VkPipeline& pipeline : m_pipelines)
-		{
-			vkDestroyPipeline(m_logicalDevice, pipeline, nullptr);
-		}
-		m_pipelines.clear();
+		destroyResources(AllScopes);
 
-		// clear pipeline layouts
-		for (const VkPipelineLayout& layout : m_pipelineLayouts)
+		if (m_debugOutputEnabled)
 		{
-			vkDestroyPipelineLayout(m_logicalDevice, layout, nullptr);
+			m_allocator.printStatistics();
 		}
-		m_pipelineLayouts.clear();
+		m_allocator.shutdown();
 
-		// clear set layouts
-		for (const VkDescriptorSetLayout& layout : m_descriptorSetLayouts)
+		if (m_pipelineCache != VK_NULL_HANDLE)
 		{
-			vkDestroyDescriptorSetLayout(m_logicalDevice, layout, nullptr);
-		}
-		m_descriptorSetLayouts.clear();
+			storePipelineCache();
 
-		if (m_descriptorPool != VK_NULL_HANDLE)
-		{
-			vkDestroyDescriptorPool(m_logicalDevice, m_descriptorPool, nullptr);
+			vkDestroyPipelineCache(m_logicalDevice, m_pipelineCache, nullptr);
 			if (m_debugOutputEnabled)
 			{
-				printf("Vulkan descriptor pool destroyed\n");
+				printf("Vulkan pipeline cache destroyed\n");
 			}
-			m_descriptorPool = VK_NULL_HANDLE;
+			m_pipelineCache = VK_NULL_HANDLE;
 		}
 
-		if (m_pipelineCache != VK_NULL_HANDLE)
+		for (Queue& queue : m_queues)
 		{
-			// store the pipeline cache
-			size_t bytes = 0u;
-			if (vkGetPipelineCacheData(m_logicalDevice, m_pipelineCache, &bytes, nullptr) == VK_SUCCESS)
+			if (queue.commandPool != VK_NULL_HANDLE)
 			{
-				std::vector<char> cache;
-				cache.resize(bytes);
-
-				if (vkGetPipelineCacheData(m_logicalDevice, m_pipelineCache, &bytes, cache.data()) == VK_SUCCESS)
+				// frees all command buffers allocated from it
+				vkDestroyCommandPool(m_logicalDevice, queue.commandPool, nullptr);
+				queue.freeCommandBuffers.clear();
+				if (m_debugOutputEnabled)
 				{
-					if (writeFile(g_PipelineCachePath, cache))
-					{
-						printf("Stored %s [%zukb]\n", g_PipelineCachePath, cache.size() / 1000u);
-					}
-				}				
+					printf("Vulkan command pool destroyed\n");
+				}
+				queue.commandPool = VK_NULL_HANDLE;
 			}
 
-			vkDestroyPipelineCache(m_logicalDevice, m_pipelineCache, nullptr);
-			if (m_debugOutputEnabled)
+			if (queue.timeline != VK_NULL_HANDLE)
 			{
-				printf("Vulkan pipeline cache destroyed\n");
+				vkDestroySemaphore(m_logicalDevice, queue.timeline, nullptr);
+				queue.timeline = VK_NULL_HANDLE;
 			}
-			m_pipelineCache = VK_NULL_HANDLE;
 		}
+		m_commandBufferQueues.clear();
+		m_currentScope = 0u;
 
-		for (const VkRenderPass& renderpass : m_renderPasses)
+		vkDestroyDevice(m_logicalDevice, nullptr);
+		if (m_debugOutputEnabled)
 		{
-			vkDestroyRenderPass(m_logicalDevice, renderpass, nullptr);
+			printf("Vulkan logical device destroyed\n");
 		}
-		m_renderPasses.clear();
+		m_logicalDevice = VK_NULL_HANDLE;
+	}
 
-		for (const VkShaderModule& shader : m_shaderModules)
+	if (m_instance != VK_NULL_HANDLE)
+	{
+		vkDestroyInstance(m_instance, nullptr);
+		if (m_debugOutputEnabled)
 		{
-			vkDestroyShaderModule(m_logicalDevice, shader, nullptr);
+			printf("Vulkan instance destroyed\n");
 		}
-		m_shaderModules.clear();
+		m_instance = VK_NULL_HANDLE;
+	}
+}
+
+void IBLLib::vkHelper::storePipelineCache()
+{
+	size_t bytes = 0u;
+	if (vkGetPipelineCacheData(m_logicalDevice, m_pipelineCache, &bytes, nullptr) != VK_SUCCESS)
+	{
+		return;
+	}
+
+	// nothing was added to the loaded cache
+	if (m_pipelineCacheLoadedSize != 0u && bytes == m_pipelineCacheLoadedSize)
+	{
+		return;
+	}
 
-		if (m_commandPool != VK_NULL_HANDLE)
+	// parallel workers share the file, keep what they stored since this process loaded it
+	{
+		MappedFile current;
+		if (current.open(m_pipelineCachePath.c_str(), MappedFile::Access::Random) && isPipelineCacheCompatible(current.getData(), current.getSize(), m_deviceProperties))
 		{
-			vkDestroyCommandPool(m_logicalDevice, m_commandPool, nullptr);
-			if (m_debugOutputEnabled)
+			VkPipelineCacheCreateInfo createInfo{};
+			createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+			createInfo.initialDataSize = current.getSize();
+			createInfo.pInitialData = current.getData();
+
+			VkPipelineCache other = VK_NULL_HANDLE;
+			if (vkCreatePipelineCache(m_logicalDevice, &createInfo, nullptr, &other) == VK_SUCCESS)
 			{
-				printf("Vulkan command pool destroyed\n");
+				if (vkMergePipelineCaches(m_logicalDevice, m_pipelineCache, 1u, &other) != VK_SUCCESS)
+				{
+					printf("Failed to merge pipeline cache %s\n", m_pipelineCachePath.c_str());
+				}
+				vkDestroyPipelineCache(m_logicalDevice, other, nullptr);
 			}
-			m_commandPool = VK_NULL_HANDLE;
 		}
+	}
 
-		vkDestroyDevice(m_logicalDevice, nullptr);
-		if (m_debugOutputEnabled)
+	std::vector<char> cache;
+	if (vkGetPipelineCacheData(m_logicalDevice, m_pipelineCache, &bytes, nullptr) != VK_SUCCESS)
+	{
+		return;
+	}
+	cache.resize(bytes);
+	if (vkGetPipelineCacheData(m_logicalDevice, m_pipelineCache, &bytes, cache.data()) != VK_SUCCESS)
+	{
+		return;
+	}
+	cache.resize(bytes);
+
+	// every process writes its own temporary file, readers only ever see a complete cache
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%08x.tmp", std::random_device{}());
+	const std::string temporaryPath = m_pipelineCachePath + suffix;
+
+	if (writeFile(temporaryPath.c_str(), cache) && replaceFile(temporaryPath.c_str(), m_pipelineCachePath.c_str()))
+	{
+		printf("Stored %s [%zukb]\n", m_pipelineCachePath.c_str(), cache.size() / 1000u);
+	}
+	else
+	{
+		printf("Failed to store pipeline cache %s\n", m_pipelineCachePath.c_str());
+		remove(temporaryPath.c_str());
+	}
+}
+
+VkResult IBLLib::vkHelper::createTimestampQueryPool(VkQueryPool& _outPool, uint32_t _count)
+{
+	if (m_logicalDevice == VK_NULL_HANDLE || getQueue(QueueType::Graphics).timestampValidBits == 0u)
+	{
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	VkQueryPoolCreateInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	info.queryCount = _count;
+
+	VkResult res = VK_SUCCESS;
+	if ((res = vkCreateQueryPool(m_logicalDevice, &info, nullptr, &_outPool)) != VK_SUCCESS)
+	{
+		_outPool = VK_NULL_HANDLE;
+		printf("Failed to create query pool [%u]\n", res);
+		return res;
+	}
+
+	m_queryPools.push_back({ _outPool, m_currentScope });
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::getTimestampMilliseconds(VkQueryPool _pool, uint32_t _begin, uint32_t _end, double& _outMilliseconds) const
+{
+	uint64_t begin = 0u;
+	uint64_t end = 0u;
+
+	VkResult res = VK_SUCCESS;
+	if ((res = vkGetQueryPoolResults(m_logicalDevice, _pool, _begin, 1u, sizeof(begin), &begin, sizeof(begin), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)) != VK_SUCCESS ||
+		(res = vkGetQueryPoolResults(m_logicalDevice, _pool, _end, 1u, sizeof(end), &end, sizeof(end), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)) != VK_SUCCESS)
+	{
+		return res;
+	}
+
+	// only the valid bits of a timestamp are written, the difference wraps around like them
+	const uint32_t validBits = m_queues[static_cast<uint32_t>(QueueType::Graphics)].timestampValidBits;
+	const uint64_t mask = validBits >= 64u ? ~0ull : (1ull << validBits) - 1ull;
+
+	_outMilliseconds = static_cast<double>((end - begin) & mask) * static_cast<double>(m_deviceLimits.timestampPeriod) * 1e-6;
+
+	return res;
+}
+
+void IBLLib::vkHelper::printPipelineStatistics() const
+{
+	printf("Created %u pipelines in %.2f ms (%s pipeline cache)\n", m_pipelineCount, m_pipelineMilliseconds, m_pipelineCacheLoadedSize != 0u ? "warm" : "cold");
+}
+
+void IBLLib::vkHelper::releaseScope(uint32_t _scope)
+{
+	if (m_logicalDevice == VK_NULL_HANDLE || _scope == 0u)
+	{
+		return;
+	}
+
+	destroyResources(_scope);
+
+	if (m_currentScope == _scope)
+	{
+		m_currentScope = 0u;
+	}
+}
+
+template <class T, class Destroy>
+void IBLLib::vkHelper::destroyScoped(std::vector<Scoped<T>>& _handles, uint32_t _scope, Destroy _destroy)
+{
+	auto end = std::remove_if(_handles.begin(), _handles.end(), [&](const Scoped<T>& _handle)
+	{
+		if (_scope != AllScopes && _handle.scope != _scope)
 		{
-			printf("Vulkan logical device destroyed\n");
+			return false;
+		}
+		_destroy(_handle.handle);
+		return true;
+	});
+	_handles.erase(end, _handles.end());
+}
+
+void IBLLib::vkHelper::destroyResources(uint32_t _scope)
+{
+	const VkDevice device = m_logicalDevice;
+
+	destroyScoped(m_semaphores, _scope, [device](VkSemaphore _semaphore) { vkDestroySemaphore(device, _semaphore, nullptr); });
+	destroyScoped(m_frameBuffers, _scope, [device](VkFramebuffer _framebuffer) { vkDestroyFramebuffer(device, _framebuffer, nullptr); });
+	destroyScoped(m_samplers, _scope, [device](VkSampler _sampler) { vkDestroySampler(device, _sampler, nullptr); });
+
+	for (auto it = m_images.begin(); it != m_images.end();)
+	{
+		if (_scope == AllScopes || it->second.scope == _scope)
+		{
+			it->second.destroy(device, m_allocator);
+			it = m_images.erase(it);
+		}
+		else
+		{
+			++it;
 		}
-		m_logicalDevice = VK_NULL_HANDLE;
 	}
 
-	if (m_instance != VK_NULL_HANDLE)
+	for (auto it = m_buffers.begin(); it != m_buffers.end();)
 	{
-		vkDestroyInstance(m_instance, nullptr);
-		if (m_debugOutputEnabled)
+		if (_scope == AllScopes || it->second.scope == _scope)
 		{
-			printf("Vulkan instance destroyed\n");
+			it->second.destroy(device, m_allocator);
+			it = m_buffers.erase(it);
+		}
+		else
+		{
+			++it;
 		}
-		m_instance = VK_NULL_HANDLE;
 	}
+
+	destroyScoped(m_pipelines, _scope, [device](VkPipeline _pipeline) { vkDestroyPipeline(device, _pipeline, nullptr); });
+	destroyScoped(m_pipelineLayouts, _scope, [device](VkPipelineLayout _layout) { vkDestroyPipelineLayout(device, _layout, nullptr); });
+	destroyScoped(m_descriptorSetLayouts, _scope, [device](VkDescriptorSetLayout _layout) { vkDestroyDescriptorSetLayout(device, _layout, nullptr); });
+
+	// frees the descriptor sets allocated from it
+	const bool debugOutput = m_debugOutputEnabled;
+	destroyScoped(m_descriptorPools, _scope, [device, debugOutput](VkDescriptorPool _pool)
+	{
+		vkDestroyDescriptorPool(device, _pool, nullptr);
+		if (debugOutput)
+		{
+			printf("Vulkan descriptor pool destroyed\n");
+		}
+	});
+
+	destroyScoped(m_queryPools, _scope, [device](VkQueryPool _pool) { vkDestroyQueryPool(device, _pool, nullptr); });
+	destroyScoped(m_renderPasses, _scope, [device](VkRenderPass _renderPass) { vkDestroyRenderPass(device, _renderPass, nullptr); });
+	destroyScoped(m_shaderModules, _scope, [device](VkShaderModule _shader) { vkDestroyShaderModule(device, _shader, nullptr); });
 }
 
-VkResult IBLLib::vkHelper::createCommandBuffer(VkCommandBuffer& _outCmdBuffer, VkCommandBufferLevel _level) const
+VkResult IBLLib::vkHelper::createCommandBuffer(VkCommandBuffer& _outCmdBuffer, VkCommandBufferLevel _level, QueueType _queue)
 {
-	if (m_commandPool == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
+	Queue& queue = getQueue(_queue);
+
+	if (queue.commandPool == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
 
+	VkResult res = VK_SUCCESS;
+
+	// recycled command buffers are all primary
+	if (_level == VK_COMMAND_BUFFER_LEVEL_PRIMARY && queue.freeCommandBuffers.empty() == false)
+	{
+		_outCmdBuffer = queue.freeCommandBuffers.back();
+		queue.freeCommandBuffers.pop_back();
+
+		if ((res = vkResetCommandBuffer(_outCmdBuffer, 0u)) != VK_SUCCESS)
+		{
+			printf("Failed to reset command buffer [%u]\n", res);
+		}
+
+		return res;
+	}
+
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = m_commandPool;
+	allocInfo.commandPool = queue.commandPool;
 	allocInfo.level = _level;
 	allocInfo.commandBufferCount = 1u;
 
-	VkResult res = vkAllocateCommandBuffers(m_logicalDevice, &allocInfo, &_outCmdBuffer);
+	res = vkAllocateCommandBuffers(m_logicalDevice, &allocInfo, &_outCmdBuffer);
 
 	if (res != VK_SUCCESS)
 	{
 		printf("Failed to allocate command buffers [%u]\n", res);
+		return res;
 	}
 
+	m_commandBufferQueues[_outCmdBuffer] = _queue;
+
 	return res;
 }
 
-VkResult IBLLib::vkHelper::createCommandBuffers(std::vector<VkCommandBuffer>& _outCmdBuffers, uint32_t _count, VkCommandBufferLevel _level) const
+VkResult IBLLib::vkHelper::createCommandBuffers(std::vector<VkCommandBuffer>& _outCmdBuffers, uint32_t _count, VkCommandBufferLevel _level, QueueType _queue)
 {
-	if (m_commandPool == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
+	_outCmdBuffers.resize(_count, VK_NULL_HANDLE);
+
+	VkResult res = VK_SUCCESS;
+	for (VkCommandBuffer& cmdBuffer : _outCmdBuffers)
 	{
-		return VK_RESULT_MAX_ENUM;
+		if ((res = createCommandBuffer(cmdBuffer, _level, _queue)) != VK_SUCCESS)
+		{
+			return res;
+		}
 	}
 
-	_outCmdBuffers.resize(_count, VK_NULL_HANDLE);
+	return res;
+}
 
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = m_commandPool;
-	allocInfo.level = _level;
-	allocInfo.commandBufferCount = _count;
+void IBLLib::vkHelper::destroyCommandBuffer(VkCommandBuffer _cmdBuffer)
+{
+	auto cmdIt = m_commandBufferQueues.find(_cmdBuffer);
+	if (m_logicalDevice == VK_NULL_HANDLE || cmdIt == m_commandBufferQueues.end())
+	{
+		return;
+	}
+
+	Queue& queue = getQueue(cmdIt->second);
+
+	// defer to the latest submission that still references it
+	for (auto it = queue.pendingSubmissions.rbegin(); it != queue.pendingSubmissions.rend(); ++it)
+	{
+		if (std::find(it->cmdBuffers.begin(), it->cmdBuffers.end(), _cmdBuffer) != it->cmdBuffers.end())
+		{
+			it->recycleOnCompletion.push_back(_cmdBuffer);
+			return;
+		}
+	}
+
+	queue.freeCommandBuffers.push_back(_cmdBuffer);
+}
+
+VkResult IBLLib::vkHelper::beginCommandBuffer(VkCommandBuffer _cmdBuffer, VkCommandBufferUsageFlags _flags) const
+{
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = _flags;
+	beginInfo.pInheritanceInfo = nullptr;
+
+	VkResult res = VK_SUCCESS;
 
-	VkResult res = vkAllocateCommandBuffers(m_logicalDevice, &allocInfo, _outCmdBuffers.data());
+	if ((res = vkBeginCommandBuffer(_cmdBuffer, &beginInfo)) != VK_SUCCESS)
+	{
+		printf("Failed to start recording command buffers [%u]\n", res);
+	}
+	
+	return res;
+}
 
+VkResult IBLLib::vkHelper::beginCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers, VkCommandBufferUsageFlags _flags) const
+{
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = _flags;
+	beginInfo.pInheritanceInfo = nullptr;
+
+	VkResult res = VK_SUCCESS;
+
+	for (const VkCommandBuffer& buffer : _cmdBuffers)
+	{
+		if ((res = vkBeginCommandBuffer(buffer, &beginInfo)) != VK_SUCCESS)
+		{
+			printf("Failed to start recording command buffers [%u]\n", res);
+			return res;
+		}
+	}
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::endCommandBuffer(VkCommandBuffer _cmdBuffers) const
+{
+	VkResult res = VK_SUCCESS;
+
+	if ((res = vkEndCommandBuffer(_cmdBuffers)) != VK_SUCCESS)
+	{
+		printf("Failed to end recording command buffers [%u]\n", res);
+	}
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::endCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers) const
+{
+	VkResult res = VK_SUCCESS;
+
+	for (const VkCommandBuffer& buffer : _cmdBuffers)
+	{
+		if ((res = vkEndCommandBuffer(buffer)) != VK_SUCCESS)
+		{
+			printf("Failed to end recording command buffers [%u]\n", res);
+			return res;
+		}
+	}
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::executeCommandBuffer(VkCommandBuffer _cmdBuffer)
+{
+	return executeCommandBuffers({ _cmdBuffer });
+}
+
+VkResult IBLLib::vkHelper::executeCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers)
+{
+	if (_cmdBuffers.empty())
+	{
+		return VK_SUCCESS;
+	}
+
+	auto cmdIt = m_commandBufferQueues.find(_cmdBuffers.front());
+	const QueueType queue = cmdIt != m_commandBufferQueues.end() ? cmdIt->second : QueueType::Graphics;
+
+	SubmissionTicket ticket;
+
+	VkResult res = submit(_cmdBuffers, ticket, queue);
 	if (res != VK_SUCCESS)
 	{
-		printf("Failed to allocate command buffers [%u]\n", res);
+		return res;
+	}
+
+	return wait(ticket);
+}
+
+VkResult IBLLib::vkHelper::acquireFence(VkFence& _outFence)
+{
+	if (m_freeFences.empty() == false)
+	{
+		_outFence = m_freeFences.back();
+		m_freeFences.pop_back();
+		return VK_SUCCESS;
+	}
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.pNext = nullptr;
+	fenceInfo.flags = 0u;
+
+	VkResult res = vkCreateFence(m_logicalDevice, &fenceInfo, nullptr, &_outFence);
+	if (res != VK_SUCCESS)
+	{
+		printf("Failed to create fence [%u]\n", res);
 	}
 
 	return res;
 }
 
-void IBLLib::vkHelper::destroyCommandBuffer(VkCommandBuffer _cmdBuffer) const
-{
-	if (m_commandPool != VK_NULL_HANDLE && m_logicalDevice != VK_NULL_HANDLE)
+VkResult IBLLib::vkHelper::submit(const std::vector<VkCommandBuffer>& _cmdBuffers, SubmissionTicket& _outTicket, QueueType _queue,
+	const std::vector<VkSemaphore>& _waitSemaphores, const std::vector<VkPipelineStageFlags>& _waitStages, const std::vector<VkSemaphore>& _signalSemaphores)
+{
+	Queue& queue = getQueue(_queue);
+
+	if (queue.queue == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE || _waitSemaphores.size() != _waitStages.size())
+	{
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	VkResult res = VK_SUCCESS;
+	VkFence fence = VK_NULL_HANDLE;
+	const uint64_t ticket = queue.lastSubmittedTicket + 1u;
+
+	// the submission signals the queue's timeline with its ticket, the values of the binary semaphores are ignored
+	std::vector<VkSemaphore> signalSemaphores(_signalSemaphores);
+	std::vector<uint64_t> signalValues;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+
+	if (m_timelineSemaphoresEnabled)
+	{
+		signalSemaphores.push_back(queue.timeline);
+		signalValues.resize(signalSemaphores.size(), 0u);
+		signalValues.back() = ticket;
+
+		timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+		timelineInfo.pSignalSemaphoreValues = signalValues.data();
+	}
+	else if ((res = acquireFence(fence)) != VK_SUCCESS)
+	{
+		return res;
+	}
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = m_timelineSemaphoresEnabled ? &timelineInfo : nullptr;
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(_waitSemaphores.size());
+	submitInfo.pWaitSemaphores = _waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = _waitStages.data();
+	submitInfo.commandBufferCount = static_cast<uint32_t>(_cmdBuffers.size());
+	submitInfo.pCommandBuffers = _cmdBuffers.data();
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+	submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+	if ((res = vkQueueSubmit(queue.queue, 1u, &submitInfo, fence)) != VK_SUCCESS)
+	{
+		if (res == VK_ERROR_DEVICE_LOST)
+		{
+			printf("Failed to submit queue [VK_ERROR_DEVICE_LOST]. Prefiltering likely exceeded the TDRDelay. Consider reducing the quality of sample, outputResolution, or mipLevels.\n");
+		}
+		else
+		{
+			printf("Failed to submit queue [%d].\n", res);
+		}
+		// the fence was not used by the failed submission
+		if (fence != VK_NULL_HANDLE)
+		{
+			m_freeFences.push_back(fence);
+		}
+		return res;
+	}
+
+	if (m_debugOutputEnabled)
 	{
-		vkFreeCommandBuffers(m_logicalDevice, m_commandPool, 1u, &_cmdBuffer);
+		printf("Executing %u command buffers\n", submitInfo.commandBufferCount);
 	}
-}
 
-VkResult IBLLib::vkHelper::beginCommandBuffer(VkCommandBuffer _cmdBuffer, VkCommandBufferUsageFlags _flags) const
-{
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = _flags;
-	beginInfo.pInheritanceInfo = nullptr;
+	queue.pendingSubmissions.emplace_back();
+	Submission& submission = queue.pendingSubmissions.back();
+	submission.ticket = ticket;
+	queue.lastSubmittedTicket = ticket;
+	submission.fence = fence;
+	submission.cmdBuffers = _cmdBuffers;
 
-	VkResult res = VK_SUCCESS;
+	_outTicket.value = submission.ticket;
+	_outTicket.queue = _queue;
 
-	if ((res = vkBeginCommandBuffer(_cmdBuffer, &beginInfo)) != VK_SUCCESS)
-	{
-		printf("Failed to start recording command buffers [%u]\n", res);
-	}
-	
 	return res;
 }
 
-VkResult IBLLib::vkHelper::beginCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers, VkCommandBufferUsageFlags _flags) const
+VkResult IBLLib::vkHelper::wait(SubmissionTicket _ticket, uint64_t _timeout)
 {
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = _flags;
-	beginInfo.pInheritanceInfo = nullptr;
+	Queue& queue = getQueue(_ticket.queue);
 
-	VkResult res = VK_SUCCESS;
-
-	for (const VkCommandBuffer& buffer : _cmdBuffers)
+	if (_ticket.value <= queue.completedTicket)
 	{
-		if ((res = vkBeginCommandBuffer(buffer, &beginInfo)) != VK_SUCCESS)
-		{
-			printf("Failed to start recording command buffers [%u]\n", res);
-			return res;
-		}
+		return VK_SUCCESS;
 	}
 
-	return res;
-}
+	// fences signal in submission order on a single queue, waiting for the submission of _ticket covers all earlier ones
+	auto it = std::find_if(queue.pendingSubmissions.begin(), queue.pendingSubmissions.end(), [&_ticket](const Submission& _submission) { return _submission.ticket >= _ticket.value; });
+	if (it == queue.pendingSubmissions.end())
+	{
+		return VK_RESULT_MAX_ENUM;
+	}
 
-VkResult IBLLib::vkHelper::endCommandBuffer(VkCommandBuffer _cmdBuffers) const
-{
 	VkResult res = VK_SUCCESS;
+	if (m_timelineSemaphoresEnabled)
+	{
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1u;
+		waitInfo.pSemaphores = &queue.timeline;
+		waitInfo.pValues = &it->ticket;
 
-	if ((res = vkEndCommandBuffer(_cmdBuffers)) != VK_SUCCESS)
+		res = m_waitSemaphores(m_logicalDevice, &waitInfo, _timeout);
+	}
+	else
 	{
-		printf("Failed to end recording command buffers [%u]\n", res);
+		res = vkWaitForFences(m_logicalDevice, 1u, &it->fence, VK_TRUE, _timeout);
+	}
+
+	if (res == VK_SUCCESS)
+	{
+		retireSubmissions(queue, it->ticket);
+	}
+	else if (res != VK_TIMEOUT)
+	{
+		printf("Failed to wait for submission [%u]\n", res);
 	}
 
 	return res;
 }
 
-VkResult IBLLib::vkHelper::endCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers) const
+VkResult IBLLib::vkHelper::waitIdle()
 {
 	VkResult res = VK_SUCCESS;
 
-	for (const VkCommandBuffer& buffer : _cmdBuffers)
+	for (uint32_t i = 0u; i < static_cast<uint32_t>(QueueType::Count); ++i)
 	{
-		if ((res = vkEndCommandBuffer(buffer)) != VK_SUCCESS)
+		SubmissionTicket ticket;
+		ticket.value = m_queues[i].lastSubmittedTicket;
+		ticket.queue = static_cast<QueueType>(i);
+
+		VkResult queueRes = wait(ticket);
+		if (queueRes != VK_SUCCESS)
 		{
-			printf("Failed to end recording command buffers [%u]\n", res);
-			return res;
+			res = queueRes;
 		}
 	}
 
 	return res;
 }
 
-VkResult IBLLib::vkHelper::executeCommandBuffer(VkCommandBuffer _cmdBuffer) const
-{
-	return executeCommandBuffers({ _cmdBuffer });
-}
-
-VkResult IBLLib::vkHelper::executeCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers) const
+bool IBLLib::vkHelper::isComplete(SubmissionTicket _ticket)
 {
-	if (m_queue == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
-	{
-		return VK_RESULT_MAX_ENUM;
-	}
-
-	VkResult res = VK_SUCCESS;
-	VkFence fence = VK_NULL_HANDLE;
+	Queue& queue = getQueue(_ticket.queue);
 
-	// create fence
+	uint64_t signaled = queue.completedTicket;
+	if (m_timelineSemaphoresEnabled)
 	{
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.pNext = nullptr;
-		fenceInfo.flags = 0u;
-
-		if ((res = vkCreateFence(m_logicalDevice, &fenceInfo, nullptr, &fence)) != VK_SUCCESS)
+		if (m_getSemaphoreCounterValue(m_logicalDevice, queue.timeline, &signaled) != VK_SUCCESS)
 		{
-			printf("Failed to end create fence [%u]\n", res);
-			return res;
+			signaled = queue.completedTicket;
 		}
 	}
-
-	// submit
+	else
 	{
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.pNext = nullptr;
-		submitInfo.commandBufferCount = static_cast<uint32_t>(_cmdBuffers.size());
-		submitInfo.pCommandBuffers = _cmdBuffers.data();
-
-		if ((res = vkQueueSubmit(m_queue, 1u, &submitInfo, fence)) != VK_SUCCESS)
+		for (const Submission& submission : queue.pendingSubmissions)
 		{
-			if (res == VK_ERROR_DEVICE_LOST)
-			{
-				printf("Failed to submit queue [VK_ERROR_DEVICE_LOST]. Prefiltering likely exceeded the TDRDelay. Consider reducing the quality of sample, outputResolution, or mipLevels.\n");
-			}
-			else
+			if (submission.ticket > _ticket.value || vkGetFenceStatus(m_logicalDevice, submission.fence) != VK_SUCCESS)
 			{
-				printf("Failed to submit queue [%d].\n", res);
+				break;
 			}
-			vkDestroyFence(m_logicalDevice, fence, nullptr);
-			return res;
+			signaled = submission.ticket;
 		}
-		if (m_debugOutputEnabled)
+	}
+
+	retireSubmissions(queue, signaled);
+
+	return _ticket.value <= queue.completedTicket;
+}
+
+void IBLLib::vkHelper::retireSubmissions(Queue& _queue, uint64_t _ticket)
+{
+	while (_queue.pendingSubmissions.empty() == false && _queue.pendingSubmissions.front().ticket <= _ticket)
+	{
+		Submission& submission = _queue.pendingSubmissions.front();
+
+		if (submission.fence != VK_NULL_HANDLE)
 		{
-			printf("Executing %u command buffers\n", submitInfo.commandBufferCount);
+			vkResetFences(m_logicalDevice, 1u, &submission.fence);
+			m_freeFences.push_back(submission.fence);
 		}
+
+		_queue.freeCommandBuffers.insert(_queue.freeCommandBuffers.end(), submission.recycleOnCompletion.begin(), submission.recycleOnCompletion.end());
+
+		_queue.completedTicket = submission.ticket;
+		_queue.pendingSubmissions.pop_front();
 	}
+}
 
-	// wait / block for execution to be complete
-	if ((res = vkWaitForFences(m_logicalDevice, 1u, &fence, VK_TRUE, UINT64_MAX)) != VK_SUCCESS)
+VkResult IBLLib::vkHelper::createSemaphore(VkSemaphore& _outSemaphore)
+{
+	if (m_logicalDevice == VK_NULL_HANDLE)
 	{
-		printf("Failed to wait for fence [%u]\n", res);
+		return VK_RESULT_MAX_ENUM;
 	}
 
-	if ((res = vkQueueWaitIdle(m_queue)) != VK_SUCCESS)
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkResult res = vkCreateSemaphore(m_logicalDevice, &semaphoreInfo, nullptr, &_outSemaphore);
+	if (res != VK_SUCCESS)
 	{
-		printf("Failed to wait for queue [%u]\n", res);
+		printf("Failed to create semaphore [%u]\n", res);
+		return res;
 	}
 
-	vkDestroyFence(m_logicalDevice, fence, nullptr);
+	m_semaphores.push_back({ _outSemaphore, m_currentScope });
 
 	return res;
 }
@@ -626,21 +1184,22 @@ VkResult IBLLib::vkHelper::loadShaderModule(VkShaderModule& _outShader, const ui
 		return res;
 	}
 
-	m_shaderModules.emplace_back(_outShader);
+	m_shaderModules.push_back({ _outShader, m_currentScope });
 
 	return res;
 }
 
 VkResult IBLLib::vkHelper::loadShaderModule(VkShaderModule& _outShader, const char* _path)
 {
-	std::vector<char> blob;
+	// mappings are page aligned, so the SPIR-V words can be passed directly
+	MappedFile blob;
 
-	if (readFile(_path, blob) == false)
+	if (blob.open(_path, MappedFile::Access::Random) == false)
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
 
-	return loadShaderModule(_outShader, reinterpret_cast<const uint32_t*>(blob.data()), static_cast<uint32_t>(blob.size()));
+	return loadShaderModule(_outShader, reinterpret_cast<const uint32_t*>(blob.getData()), static_cast<uint32_t>(blob.getSize()));
 }
 
 VkResult IBLLib::vkHelper::createDecriptorSetLayout(VkDescriptorSetLayout& _outLayout, const VkDescriptorSetLayoutCreateInfo* _pCreateInfo)
@@ -659,7 +1218,7 @@ VkResult IBLLib::vkHelper::createDecriptorSetLayout(VkDescriptorSetLayout& _outL
 		return res;
 	}
 
-	m_descriptorSetLayouts.emplace_back(_outLayout);
+	m_descriptorSetLayouts.push_back({ _outLayout, m_currentScope });
 
 	return res;
 }
@@ -677,9 +1236,61 @@ VkResult IBLLib::vkHelper::addDecriptorSetLayout(std::vector<VkDescriptorSetLayo
 	return res;
 }
 
+VkResult IBLLib::vkHelper::createDescriptorPool(uint32_t _setCount, uint32_t _combinedImageSamplerCount)
+{
+	if (m_logicalDevice == VK_NULL_HANDLE || getDescriptorPool() != VK_NULL_HANDLE)
+	{
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	VkResult res = VK_SUCCESS;
+
+	// all passes only bind combined image samplers
+	VkDescriptorPoolSize size{};
+	size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	size.descriptorCount = _combinedImageSamplerCount;
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{};
+	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.pNext = nullptr;
+	descriptorPoolCreateInfo.pPoolSizes = &size;
+	descriptorPoolCreateInfo.poolSizeCount = 1u;
+	descriptorPoolCreateInfo.maxSets = _setCount;
+
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	if ((res = vkCreateDescriptorPool(m_logicalDevice, &descriptorPoolCreateInfo, nullptr, &pool)) != VK_SUCCESS)
+	{
+		printf("Failed to create descriptor pool [%u]\n", res);
+		return res;
+	}
+
+	m_descriptorPools.push_back({ pool, m_currentScope });
+
+	if (m_debugOutputEnabled)
+	{
+		printf("Descriptor pool created for %u sets and %u combined image samplers\n", _setCount, _combinedImageSamplerCount);
+	}
+
+	return res;
+}
+
+VkDescriptorPool IBLLib::vkHelper::getDescriptorPool() const
+{
+	for (const Scoped<VkDescriptorPool>& pool : m_descriptorPools)
+	{
+		if (pool.scope == m_currentScope)
+		{
+			return pool.handle;
+		}
+	}
+
+	return VK_NULL_HANDLE;
+}
+
 VkResult IBLLib::vkHelper::createDescriptorSet(VkDescriptorSet& _outDescriptorSet, VkDescriptorSetLayout _layout) const
 {
-	if (m_logicalDevice == VK_NULL_HANDLE || m_descriptorPool == VK_NULL_HANDLE)
+	const VkDescriptorPool pool = getDescriptorPool();
+	if (m_logicalDevice == VK_NULL_HANDLE || pool == VK_NULL_HANDLE)
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
@@ -691,7 +1302,7 @@ VkResult IBLLib::vkHelper::createDescriptorSet(VkDescriptorSet& _outDescriptorSe
 	info.pNext = nullptr;
 	info.pSetLayouts = &_layout;
 	info.descriptorSetCount = 1u;
-	info.descriptorPool = m_descriptorPool;
+	info.descriptorPool = pool;
 
 	if ((res = vkAllocateDescriptorSets(m_logicalDevice, &info, &_outDescriptorSet)) != VK_SUCCESS)
 	{
@@ -703,7 +1314,8 @@ VkResult IBLLib::vkHelper::createDescriptorSet(VkDescriptorSet& _outDescriptorSe
 
 VkResult IBLLib::vkHelper::createDescriptorSets(std::vector<VkDescriptorSet>& _outDescriptorSets, const std::vector<VkDescriptorSetLayout>& _layouts) const
 {
-	if (m_logicalDevice == VK_NULL_HANDLE || m_descriptorPool == VK_NULL_HANDLE)
+	const VkDescriptorPool pool = getDescriptorPool();
+	if (m_logicalDevice == VK_NULL_HANDLE || pool == VK_NULL_HANDLE)
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
@@ -717,7 +1329,7 @@ VkResult IBLLib::vkHelper::createDescriptorSets(std::vector<VkDescriptorSet>& _o
 	info.pNext = nullptr;
 	info.pSetLayouts = _layouts.data();
 	info.descriptorSetCount = static_cast<uint32_t>(_layouts.size());
-	info.descriptorPool = m_descriptorPool;
+	info.descriptorPool = pool;
 
 	if ((res = vkAllocateDescriptorSets(m_logicalDevice, &info, _outDescriptorSets.data())) != VK_SUCCESS)
 	{
@@ -762,7 +1374,7 @@ VkResult IBLLib::vkHelper::createPipelineLayout(VkPipelineLayout& _outLayout, co
 		return res;
 	}
 
-	m_pipelineLayouts.emplace_back(_outLayout);
+	m_pipelineLayouts.push_back({ _outLayout, m_currentScope });
 
 	return res;
 }
@@ -793,7 +1405,7 @@ VkResult IBLLib::vkHelper::createPipelineLayout(VkPipelineLayout& _outLayout, co
 		return res;
 	}
 
-	m_pipelineLayouts.emplace_back(_outLayout);
+	m_pipelineLayouts.push_back({ _outLayout, m_currentScope });
 
 	return res;
 }
@@ -807,6 +1419,9 @@ VkResult IBLLib::vkHelper::createPipeline(VkPipeline& _outPipeline, const VkGrap
 
 	VkResult res = VK_SUCCESS;
 
+	// creation time is dominated by shader compilation unless the pipeline cache hits
+	const auto start = std::chrono::steady_clock::now();
+
 	if ((res = vkCreateGraphicsPipelines(m_logicalDevice, m_pipelineCache, 1u, _pCreateInfo, nullptr, &_outPipeline)) != VK_SUCCESS)
 	{
 		_outPipeline = VK_NULL_HANDLE;
@@ -814,7 +1429,10 @@ VkResult IBLLib::vkHelper::createPipeline(VkPipeline& _outPipeline, const VkGrap
 		return res;
 	}
 
-	m_pipelines.emplace_back(_outPipeline);
+	m_pipelineMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	++m_pipelineCount;
+
+	m_pipelines.push_back({ _outPipeline, m_currentScope });
 
 	return res;
 }
@@ -835,7 +1453,7 @@ VkResult IBLLib::vkHelper::createRenderPass(VkRenderPass& _outRenderPass, const
 		return res;
 	}
 
-	m_renderPasses.emplace_back(_outRenderPass);
+	m_renderPasses.push_back({ _outRenderPass, m_currentScope });
 
 	return res;
 }
@@ -850,7 +1468,7 @@ bool IBLLib::vkHelper::getMemoryTypeIndex(const VkMemoryRequirements& _requireme
 	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
 	{
 		if ((_requirements.memoryTypeBits & (1 << i)) &&
-			(m_memoryProperties.memoryTypes[i].propertyFlags & _properties))
+			(m_memoryProperties.memoryTypes[i].propertyFlags & _properties) == _properties)
 		{
 			_outIndex = i;
 			return true;
@@ -860,7 +1478,7 @@ bool IBLLib::vkHelper::getMemoryTypeIndex(const VkMemoryRequirements& _requireme
 	return false;
 }
 
-VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, uint32_t _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags, VkSharingMode _sharingMode, VkBufferCreateFlags _flags)
+VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, VkDeviceSize _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags, VkSharingMode _sharingMode, VkBufferCreateFlags _flags, AllocationScope _scope)
 {
 	if (m_logicalDevice == VK_NULL_HANDLE)
 	{
@@ -873,7 +1491,7 @@ VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, uint32_
 	bufferInfo.size = _byteSize;
 	bufferInfo.usage = _usage;
 	bufferInfo.sharingMode = _sharingMode;
-	bufferInfo.pQueueFamilyIndices = &m_queueFamilyIndex;
+	bufferInfo.pQueueFamilyIndices = &getQueue(QueueType::Graphics).familyIndex;
 	bufferInfo.queueFamilyIndexCount = 1u;
 	bufferInfo.flags = _flags;
 
@@ -886,33 +1504,33 @@ VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, uint32_
 		return res;
 	}
 
-	m_buffers.emplace_back();
-	Buffer& buffer = m_buffers.back();
+	Buffer& buffer = m_buffers[_outBuffer];
 
 	buffer.buffer = _outBuffer;
 	buffer.info = bufferInfo;
+	buffer.scope = m_currentScope;
 
 	VkMemoryRequirements requirements{};
 	vkGetBufferMemoryRequirements(m_logicalDevice, _outBuffer, &requirements);
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.pNext = nullptr;
-	allocInfo.allocationSize = requirements.size;
-
-	if (getMemoryTypeIndex(requirements, _memoryFlags, allocInfo.memoryTypeIndex) == false)
+	uint32_t memoryTypeIndex = 0u;
+	if (getMemoryTypeIndex(requirements, _memoryFlags, memoryTypeIndex) == false)
 	{
-		printf("Unsupported memory requirements [%u]\n", res);
-		return res;
+		// callers may retry with different memory flags
+		destroyBuffer(_outBuffer);
+		_outBuffer = VK_NULL_HANDLE;
+		return VK_ERROR_FEATURE_NOT_PRESENT;
 	}
 
-	if ((res = vkAllocateMemory(m_logicalDevice, &allocInfo, nullptr, &buffer.memory)) != VK_SUCCESS)
+	if ((res = m_allocator.allocate(requirements, memoryTypeIndex, true, _scope, buffer.memory)) != VK_SUCCESS)
 	{
 		printf("Failed to allocate buffer [%u]\n", res);
+		destroyBuffer(_outBuffer);
+		_outBuffer = VK_NULL_HANDLE;
 		return res;
 	}
 
-	if ((res = vkBindBufferMemory(m_logicalDevice, _outBuffer, buffer.memory, 0u)) != VK_SUCCESS)
+	if ((res = vkBindBufferMemory(m_logicalDevice, _outBuffer, buffer.memory.memory, buffer.memory.offset)) != VK_SUCCESS)
 	{
 		printf("Failed to bind buffer memory [%u]\n", res);
 	}
@@ -924,14 +1542,11 @@ void IBLLib::vkHelper::destroyBuffer(VkBuffer _buffer)
 {
 	if (m_logicalDevice != VK_NULL_HANDLE)
 	{
-		for (auto it = m_buffers.begin(), end = m_buffers.end(); it != end; ++it)
+		auto it = m_buffers.find(_buffer);
+		if (it != m_buffers.end())
 		{
-			if (it->buffer == _buffer)
-			{
-				it->destroy(m_logicalDevice);
-				m_buffers.erase(it);
-				break;
-			}
+			it->second.destroy(m_logicalDevice, m_allocator);
+			m_buffers.erase(it);
 		}
 	}
 }
@@ -945,22 +1560,20 @@ VkResult IBLLib::vkHelper::writeBufferData(VkBuffer _buffer, const void* _pData,
 		return res;
 	}
 
-	for (const Buffer& buf : m_buffers)
+	auto it = m_buffers.find(_buffer);
+	if (it != m_buffers.end() && it->second.memory.mapped != nullptr)
 	{
-		if (buf.buffer == _buffer && buf.memory != VK_NULL_HANDLE)
-		{
-			void* data = nullptr;
-			if ((res = vkMapMemory(m_logicalDevice, buf.memory, 0u, _bytes, 0, &data)) != VK_SUCCESS)
-			{
-				printf("Failed to map buffer memory [%u]\n", res);
-				return res;
-			}
+		const Buffer& buf = it->second;
 
-			// write data
-			memcpy(data, _pData, _bytes);
-			vkUnmapMemory(m_logicalDevice, buf.memory);
-			return res;
+		// write data
+		memcpy(buf.memory.mapped, _pData, _bytes);
+
+		if ((res = m_allocator.flush(buf.memory, 0u, _bytes)) != VK_SUCCESS)
+		{
+			printf("Failed to flush buffer memory [%u]\n", res);
 		}
+
+		return res;
 	}
 
 	printf("Not a valid buffer\n");
@@ -977,23 +1590,21 @@ VkResult IBLLib::vkHelper::readBufferData(VkBuffer _buffer, void* _pData, size_t
 		return res;
 	}
 
-	for (const Buffer& buf : m_buffers)
+	auto it = m_buffers.find(_buffer);
+	if (it != m_buffers.end() && it->second.memory.mapped != nullptr)
 	{
-		if (buf.buffer == _buffer && buf.memory != VK_NULL_HANDLE)
-		{
-			void* data = nullptr;
-			if ((res = vkMapMemory(m_logicalDevice, buf.memory, _offset, _bytes, 0, &data)) != VK_SUCCESS)
-			{
-				printf("Failed to map buffer memory [%u]\n", res);
-				return res;
-			}
+		const Buffer& buf = it->second;
 
-			// read data
-			memcpy(_pData, data, _bytes);			
-
-			vkUnmapMemory(m_logicalDevice, buf.memory);
+		if ((res = m_allocator.invalidate(buf.memory, _offset, _bytes)) != VK_SUCCESS)
+		{
+			printf("Failed to invalidate buffer memory [%u]\n", res);
 			return res;
 		}
+
+		// read data
+		memcpy(_pData, static_cast<const uint8_t*>(buf.memory.mapped) + _offset, _bytes);
+
+		return res;
 	}
 
 	printf("Not a valid buffer\n");
@@ -1001,11 +1612,53 @@ VkResult IBLLib::vkHelper::readBufferData(VkBuffer _buffer, void* _pData, size_t
 	return res;
 }
 
+void* IBLLib::vkHelper::getMappedData(VkBuffer _buffer) const
+{
+	auto it = m_buffers.find(_buffer);
+	return it != m_buffers.end() ? it->second.memory.mapped : nullptr;
+}
+
+VkResult IBLLib::vkHelper::flushBufferData(VkBuffer _buffer, VkDeviceSize _offset, VkDeviceSize _bytes) const
+{
+	auto it = m_buffers.find(_buffer);
+	if (it == m_buffers.end())
+	{
+		printf("Not a valid buffer\n");
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	VkResult res = m_allocator.flush(it->second.memory, _offset, _bytes);
+	if (res != VK_SUCCESS)
+	{
+		printf("Failed to flush buffer memory [%u]\n", res);
+	}
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::invalidateBufferData(VkBuffer _buffer, VkDeviceSize _offset, VkDeviceSize _bytes) const
+{
+	auto it = m_buffers.find(_buffer);
+	if (it == m_buffers.end())
+	{
+		printf("Not a valid buffer\n");
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	VkResult res = m_allocator.invalidate(it->second.memory, _offset, _bytes);
+	if (res != VK_SUCCESS)
+	{
+		printf("Failed to invalidate buffer memory [%u]\n", res);
+	}
+
+	return res;
+}
+
 VkResult IBLLib::vkHelper::createImage2DAndAllocate(
 	VkImage& _outImage, uint32_t _width, uint32_t _height,
 	VkFormat _format, VkImageUsageFlags _usage, 
 	uint32_t _mipLevels, uint32_t _arrayLayers,
-	VkImageTiling _tiling, VkMemoryPropertyFlags _memoryFlags, VkSharingMode _sharingMode, VkImageCreateFlags _flags)
+	VkImageTiling _tiling, VkMemoryPropertyFlags _memoryFlags, VkSharingMode _sharingMode, VkImageCreateFlags _flags, AllocationScope _scope)
 {
 	if (m_logicalDevice == VK_NULL_HANDLE)
 	{
@@ -1036,33 +1689,33 @@ VkResult IBLLib::vkHelper::createImage2DAndAllocate(
 		return res;
 	}
 
-	m_images.emplace_back();
-	Image& img = m_images.back();
+	Image& img = m_images[_outImage];
 
 	img.image = _outImage;
 	img.info = imageInfo;
+	img.scope = m_currentScope;
 
 	VkMemoryRequirements requirements{};
 	vkGetImageMemoryRequirements(m_logicalDevice, _outImage, &requirements);
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.pNext = nullptr;
-	allocInfo.allocationSize = requirements.size;
-
-	if (getMemoryTypeIndex(requirements, _memoryFlags, allocInfo.memoryTypeIndex) == false)
+	uint32_t memoryTypeIndex = 0u;
+	if (getMemoryTypeIndex(requirements, _memoryFlags, memoryTypeIndex) == false)
 	{
 		printf("Unsupported memory requirements [%u]\n", res);
-		return res;
+		destroyImage(_outImage);
+		_outImage = VK_NULL_HANDLE;
+		return VK_ERROR_FEATURE_NOT_PRESENT;
 	}
 
-	if ((res = vkAllocateMemory(m_logicalDevice, &allocInfo, nullptr, &img.memory)) != VK_SUCCESS)
+	if ((res = m_allocator.allocate(requirements, memoryTypeIndex, _tiling == VK_IMAGE_TILING_LINEAR, _scope, img.memory)) != VK_SUCCESS)
 	{
 		printf("Failed to allocate image [%u]\n", res);
+		destroyImage(_outImage);
+		_outImage = VK_NULL_HANDLE;
 		return res;
 	}
 
-	if ((res = vkBindImageMemory(m_logicalDevice, _outImage, img.memory, 0u)) != VK_SUCCESS)
+	if ((res = vkBindImageMemory(m_logicalDevice, _outImage, img.memory.memory, img.memory.offset)) != VK_SUCCESS)
 	{
 		printf("Failed to bind image memory [%u]\n", res);
 	}
@@ -1070,7 +1723,7 @@ VkResult IBLLib::vkHelper::createImage2DAndAllocate(
 	return res;
 }
 
-void IBLLib::vkHelper::Image::destroy(VkDevice _device)
+void IBLLib::vkHelper::Image::destroy(VkDevice _device, vkAllocator& _allocator)
 {
 	for (const VkImageView& view : views)
 	{
@@ -1084,14 +1737,13 @@ void IBLLib::vkHelper::Image::destroy(VkDevice _device)
 		image = VK_NULL_HANDLE;
 	}
 
-	if (memory != VK_NULL_HANDLE)
+	if (memory.memory != VK_NULL_HANDLE)
 	{
-		vkFreeMemory(_device, memory, nullptr);
-		memory = VK_NULL_HANDLE;
+		_allocator.free(memory);
 	}
 }
 
-void IBLLib::vkHelper::Buffer::destroy(VkDevice _device)
+void IBLLib::vkHelper::Buffer::destroy(VkDevice _device, vkAllocator& _allocator)
 {
 	if (buffer != VK_NULL_HANDLE)
 	{
@@ -1099,10 +1751,9 @@ void IBLLib::vkHelper::Buffer::destroy(VkDevice _device)
 		buffer = VK_NULL_HANDLE;
 	}
 
-	if (memory != VK_NULL_HANDLE)
+	if (memory.memory != VK_NULL_HANDLE)
 	{
-		vkFreeMemory(_device, memory, nullptr);
-		memory = VK_NULL_HANDLE;
+		_allocator.free(memory);
 	}
 }
 
@@ -1110,14 +1761,11 @@ void IBLLib::vkHelper::destroyImage(VkImage _image)
 {
 	if (m_logicalDevice != VK_NULL_HANDLE)
 	{
-		for (auto it = m_images.begin(), end = m_images.end(); it != end; ++it)
+		auto it = m_images.find(_image);
+		if (it != m_images.end())
 		{
-			if (it->image == _image)
-			{
-				it->destroy(m_logicalDevice);
-				m_images.erase(it);
-				break;
-			}
+			it->second.destroy(m_logicalDevice, m_allocator);
+			m_images.erase(it);
 		}
 	}
 }
@@ -1129,90 +1777,91 @@ VkResult IBLLib::vkHelper::createImageView(VkImageView& _outView, VkImage _image
 		return VK_RESULT_MAX_ENUM;
 	}
 
-	for (Image& img : m_images)
+	auto it = m_images.find(_image);
+	if (it == m_images.end())
 	{
-		if (img.image == _image)
-		{
-			VkImageViewCreateInfo info{};
-			info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			info.pNext = nullptr;
-			info.format = _format == VK_FORMAT_UNDEFINED ? img.info.format : _format;
-			info.flags = 0u;
-			info.image = _image;
-			info.components = _swizzle;
-			info.viewType = _type;
-			info.subresourceRange = _range;
+		return VK_RESULT_MAX_ENUM;
+	}
 
-			VkResult res = vkCreateImageView(m_logicalDevice, &info, nullptr, &_outView);
+	Image& img = it->second;
 
-			if (res == VK_SUCCESS)
-			{
-				img.views.emplace_back(_outView);			
-			}
-			else
-			{
-				printf("Failed to create image view [%u]\n", res);
-			}
+	VkImageViewCreateInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	info.pNext = nullptr;
+	info.format = _format == VK_FORMAT_UNDEFINED ? img.info.format : _format;
+	info.flags = 0u;
+	info.image = _image;
+	info.components = _swizzle;
+	info.viewType = _type;
+	info.subresourceRange = _range;
 
-			return res;
-		}
+	VkResult res = vkCreateImageView(m_logicalDevice, &info, nullptr, &_outView);
+
+	if (res == VK_SUCCESS)
+	{
+		img.views.emplace_back(_outView);			
+	}
+	else
+	{
+		printf("Failed to create image view [%u]\n", res);
 	}
 
-	return VK_RESULT_MAX_ENUM;
+	return res;
 }
 
 void IBLLib::vkHelper::copyBufferToBasicImage2D(VkCommandBuffer _cmdBuffer, VkBuffer _src, VkImage _dst) const
 {
-	for (const Image& img : m_images)
+	auto it = m_images.find(_dst);
+	if (it != m_images.end())
 	{
-		if (img.image == _dst)
-		{
-			VkBufferImageCopy region{};
-			region.bufferOffset = 0u;
-			region.bufferRowLength = 0u;
-			region.bufferImageHeight = 0u;
+		const Image& img = it->second;
 
-			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			region.imageSubresource.mipLevel = 0u;
-			region.imageSubresource.baseArrayLayer = 0u;
-			region.imageSubresource.layerCount = img.info.arrayLayers;// 1u;
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0u;
+		region.bufferRowLength = 0u;
+		region.bufferImageHeight = 0u;
 
-			region.imageOffset = { 0, 0, 0 };
-			region.imageExtent = img.info.extent;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0u;
+		region.imageSubresource.baseArrayLayer = 0u;
+		region.imageSubresource.layerCount = img.info.arrayLayers;// 1u;
 
-			vkCmdCopyBufferToImage(_cmdBuffer, _src, _dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &region);
-			return;
-		}
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = img.info.extent;
+
+		vkCmdCopyBufferToImage(_cmdBuffer, _src, _dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &region);
 	}
 }
 
+void IBLLib::vkHelper::copyBufferToImage2D(VkCommandBuffer _cmdBuffer, VkBuffer _src, VkImage _dst, const VkBufferImageCopy& _region) const
+{
+	vkCmdCopyBufferToImage(_cmdBuffer, _src, _dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &_region);
+}
+
 void IBLLib::vkHelper::copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, VkImageSubresourceLayers _imageSubresource) const
 {
-	for (const Image& img : m_images)
+	auto it = m_images.find(_src);
+	if (it == m_images.end())
 	{
-		if (img.image == _src)
-		{
-			VkBufferImageCopy region{};
-			region.bufferOffset = 0u;
-			region.bufferRowLength = 0u;
-			region.bufferImageHeight = 0u;
+		printf("image not found\n");
+		return;
+	}
 
-			region.imageSubresource = _imageSubresource;
+	VkBufferImageCopy region{};
+	region.bufferOffset = 0u;
+	region.bufferRowLength = 0u;
+	region.bufferImageHeight = 0u;
 
-			region.imageOffset = { 0, 0, 0 };
-			region.imageExtent = img.info.extent;
-		
-			vkCmdCopyImageToBuffer(_cmdBuffer, _src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				_dst,	//	VkBuffer
-				1u,		//	uint32_t  regionCount,
-				&region	//	const VkBufferImageCopy* pRegions);
-				);
+	region.imageSubresource = _imageSubresource;
 
-			return;
-		}
-	}
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = it->second.info.extent;
 
-	printf("image not found\n");
+	vkCmdCopyImageToBuffer(_cmdBuffer, _src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		_dst,	//	VkBuffer
+		1u,		//	uint32_t  regionCount,
+		&region	//	const VkBufferImageCopy* pRegions);
+		);
 }
 
 void IBLLib::vkHelper::copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, const VkBufferImageCopy& _region) const
@@ -1227,14 +1876,15 @@ void IBLLib::vkHelper::imageBarrier(VkCommandBuffer _cmdBuffer, VkImage _image,
 									VkImageLayout oldLayout, VkImageLayout newLayout, 
 									VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess, 
 									VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess, 
-									VkImageSubresourceRange _subresourceRange) const
+									VkImageSubresourceRange _subresourceRange,
+									uint32_t _srcQueueFamily, uint32_t _dstQueueFamily) const
 {
 	VkImageMemoryBarrier barrier{};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout = oldLayout;
 	barrier.newLayout = newLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.srcQueueFamilyIndex = _srcQueueFamily;
+	barrier.dstQueueFamilyIndex = _dstQueueFamily;
 	barrier.image = _image;
 	barrier.subresourceRange = _subresourceRange;
 	barrier.srcAccessMask = _srcAccess;
@@ -1250,6 +1900,64 @@ void IBLLib::vkHelper::imageBarrier(VkCommandBuffer _cmdBuffer, VkImage _image,
 	);
 }
 
+void IBLLib::vkHelper::transferImageOwnership(VkCommandBuffer _releaseCmdBuffer, VkCommandBuffer _acquireCmdBuffer, VkImage _image,
+											  QueueType _srcQueue, QueueType _dstQueue,
+											  VkImageLayout _oldLayout, VkImageLayout _newLayout,
+											  VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess,
+											  VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess,
+											  VkImageSubresourceRange _subresourceRange) const
+{
+	const uint32_t srcFamily = getQueueFamilyIndex(_srcQueue);
+	const uint32_t dstFamily = getQueueFamilyIndex(_dstQueue);
+
+	if (srcFamily == dstFamily)
+	{
+		// the semaphore between the submissions makes the transitioned image available to the other queue
+		imageBarrier(_releaseCmdBuffer, _image, _oldLayout, _newLayout,
+					 _srcStage, _srcAccess,
+					 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0u,
+					 _subresourceRange);
+		return;
+	}
+
+	// release, dst access is ignored
+	imageBarrier(_releaseCmdBuffer, _image, _oldLayout, _newLayout,
+				 _srcStage, _srcAccess,
+				 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0u,
+				 _subresourceRange, srcFamily, dstFamily);
+
+	// acquire, src access is ignored. chained to the semaphore wait at _dstStage
+	imageBarrier(_acquireCmdBuffer, _image, _oldLayout, _newLayout,
+				 _dstStage, 0u,
+				 _dstStage, _dstAccess,
+				 _subresourceRange, srcFamily, dstFamily);
+}
+
+void IBLLib::vkHelper::bufferBarrier(VkCommandBuffer _cmdBuffer, VkBuffer _buffer,
+									 VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess,
+									 VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess,
+									 VkDeviceSize _offset, VkDeviceSize _size) const
+{
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = _buffer;
+	barrier.offset = _offset;
+	barrier.size = _size;
+	barrier.srcAccessMask = _srcAccess;
+	barrier.dstAccessMask = _dstAccess;
+
+	vkCmdPipelineBarrier(
+		_cmdBuffer,
+		_srcStage, _dstStage,
+		0u,
+		0u, nullptr,
+		1u, &barrier,
+		0u, nullptr
+	);
+}
+
 VkResult IBLLib::vkHelper::createFramebuffer(VkFramebuffer& _outFramebuffer, VkRenderPass _renderPass, uint32_t _width, uint32_t _height, const std::vector<VkImageView>& _attachments, uint32_t _layers)
 {
 	if (m_logicalDevice == VK_NULL_HANDLE)
@@ -1277,22 +1985,21 @@ VkResult IBLLib::vkHelper::createFramebuffer(VkFramebuffer& _outFramebuffer, VkR
 		return res;
 	}
 
-	m_frameBuffers.emplace_back(_outFramebuffer);
+	m_frameBuffers.push_back({ _outFramebuffer, m_currentScope });
 
 	return res;
 }
 
 VkResult IBLLib::vkHelper::createFramebuffer(VkFramebuffer& _outFramebuffer, VkRenderPass _renderPass, VkImage _image)
 {
-	for (const Image& img : m_images)
+	auto it = m_images.find(_image);
+	if (it == m_images.end())
 	{
-		if (img.image == _image)
-		{
-			return createFramebuffer(_outFramebuffer, _renderPass, img.info.extent.width, img.info.extent.height, img.views, img.info.arrayLayers);
-		}
+		return VK_RESULT_MAX_ENUM;
 	}
 
-	return VK_RESULT_MAX_ENUM;
+	const Image& img = it->second;
+	return createFramebuffer(_outFramebuffer, _renderPass, img.info.extent.width, img.info.extent.height, img.views, img.info.arrayLayers);
 }
 
 void IBLLib::vkHelper::beginRenderPass(VkCommandBuffer _cmdBuffer, VkRenderPass _renderPass, VkFramebuffer _framebuffer, const VkRect2D& _area, const std::vector<VkClearValue>& _clearValues, VkSubpassContents _contents) const
@@ -1350,7 +2057,7 @@ VkResult IBLLib::vkHelper::createSampler(VkSampler& _outSampler, VkSamplerCreate
 	}
 	else
 	{
-		m_samplers.emplace_back(_outSampler);
+		m_samplers.push_back({ _outSampler, m_currentScope });
 	}
 
 	return res;
@@ -1358,15 +2065,16 @@ VkResult IBLLib::vkHelper::createSampler(VkSampler& _outSampler, VkSamplerCreate
 
 const VkImageCreateInfo* IBLLib::vkHelper::getCreateInfo(const VkImage _image)
 {
-	for (const Image& img : m_images)
-	{
-		if (img.image == _image)
-		{
-			return &img.info;
-		}
-	}
+	auto it = m_images.find(_image);
+	return it != m_images.end() ? &it->second.info : nullptr;
+}
+
+VkFormatFeatureFlags IBLLib::vkHelper::getFormatFeatures(VkFormat _format, VkImageTiling _tiling) const
+{
+	VkFormatProperties properties{};
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevice, _format, &properties);
 
-	return nullptr;
+	return _tiling == VK_IMAGE_TILING_LINEAR ? properties.linearTilingFeatures : properties.optimalTilingFeatures;
 }
 
 const VkSpecializationInfo* IBLLib::SpecConstantFactory::getInfo()
@@ -1727,8 +2435,28 @@ void IBLLib::RenderPassDesc::addAttachment(VkFormat _format, VkAttachmentLoadOp
 	ref.layout = _finalLayout;
 }
 
+void IBLLib::RenderPassDesc::setViewMask(uint32_t _viewMask)
+{
+	m_viewMask = _viewMask;
+}
+
 const VkRenderPassCreateInfo* IBLLib::RenderPassDesc::getInfo()
 {
+	if (m_viewMask != 0u)
+	{
+		// all views see the same geometry
+		m_multiview.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+		m_multiview.subpassCount = 1u;
+		m_multiview.pViewMasks = &m_viewMask;
+		m_multiview.correlationMaskCount = 1u;
+		m_multiview.pCorrelationMasks = &m_viewMask;
+		m_info.pNext = &m_multiview;
+	}
+	else
+	{
+		m_info.pNext = nullptr;
+	}
+
 	m_info.pAttachments = m_attachments.data();
 	m_info.attachmentCount = static_cast<uint32_t>(m_attachments.size());
 
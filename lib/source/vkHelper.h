@@ -2,9 +2,28 @@
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <deque>
+#include <cstring>
+#include <unordered_map>
+#include <string>
+#include "vkAllocator.h"
 
 namespace IBLLib
 {
+	enum class QueueType : uint32_t
+	{
+		Graphics = 0,
+		Transfer, // dedicated transfer family if present, otherwise a second graphics queue or the graphics queue itself
+		Count
+	};
+
+	// identifies a queue submission, values increase monotonically per queue and a completed ticket implies all earlier tickets of the same queue completed
+	struct SubmissionTicket
+	{
+		uint64_t value = 0u;
+		QueueType queue = QueueType::Graphics;
+	};
+
 	class vkHelper
 	{
 		friend class DescriptorSetInfo;
@@ -13,16 +32,31 @@ namespace IBLLib
 		vkHelper();
 		~vkHelper();
 
-		VkResult initialize(uint32_t _phyDeviceIndex = 0u, uint32_t _descriptorPoolSizeFactor = 1u, bool _debugOutput = true);
+		// the pipeline cache is kept in _pipelineCacheDirectory, IBLSAMPLER_PIPELINE_CACHE_DIR or the working directory (in that order),
+		// in a file keyed by vendor, device, driver version and pipeline cache UUID
+		VkResult initialize(uint32_t _phyDeviceIndex = 0u, bool _debugOutput = true, const char* _pipelineCacheDirectory = nullptr);
 
 		void shutdown();
 
-		VkResult createCommandBuffer(VkCommandBuffer& _outCmdBuffer, VkCommandBufferLevel _level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) const;
+		bool isInitialized() const { return m_logicalDevice != VK_NULL_HANDLE; }
+
+		// resources except command buffers belong to the scope that is current when they are created, scope 0 lives until shutdown.
+		// a long-lived instance runs each job in a scope of its own and releases it when the job is done, while later jobs are in flight
+		uint32_t createScope() { return ++m_lastScope; }
+		void setScope(uint32_t _scope) { m_currentScope = _scope; }
+		uint32_t getScope() const { return m_currentScope; }
+
+		// destroys the resources of _scope, the submissions using them must have completed. scope 0 is released by shutdown
+		void releaseScope(uint32_t _scope);
+
+		// primary command buffers are taken from the recycled ones returned by destroyCommandBuffer before new ones are allocated
+		VkResult createCommandBuffer(VkCommandBuffer& _outCmdBuffer, VkCommandBufferLevel _level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, QueueType _queue = QueueType::Graphics);
 
 		// command buffers are owned by this vkHelper instance, do not reset or destory manually
-		VkResult createCommandBuffers(std::vector<VkCommandBuffer>& _outCmdBuffers, uint32_t _count, VkCommandBufferLevel _level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) const;
+		VkResult createCommandBuffers(std::vector<VkCommandBuffer>& _outCmdBuffers, uint32_t _count, VkCommandBufferLevel _level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, QueueType _queue = QueueType::Graphics);
 
-		void destroyCommandBuffer(VkCommandBuffer _cmdBuffer) const;
+		// returns the command buffer to the pool, if it is still in flight it is recycled once its submission completed
+		void destroyCommandBuffer(VkCommandBuffer _cmdBuffer);
 
 		VkResult beginCommandBuffer(VkCommandBuffer _cmdBuffer, VkCommandBufferUsageFlags _flags = 0u) const;
 
@@ -32,10 +66,34 @@ namespace IBLLib
 
 		VkResult endCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers) const;
 
-		VkResult executeCommandBuffer(VkCommandBuffer _cmdBuffer) const;
+		VkResult executeCommandBuffer(VkCommandBuffer _cmdBuffer);
 
 		// make sure there are no dependencies between command buffers. this method is blocking
-		VkResult executeCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers) const;
+		VkResult executeCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers);
+
+		// non-blocking, the command buffers must not be re-recorded before the returned ticket completed.
+		// command buffers must have been created for _queue, _waitStages holds one stage mask per wait semaphore
+		VkResult submit(const std::vector<VkCommandBuffer>& _cmdBuffers, SubmissionTicket& _outTicket, QueueType _queue = QueueType::Graphics,
+			const std::vector<VkSemaphore>& _waitSemaphores = {}, const std::vector<VkPipelineStageFlags>& _waitStages = {}, const std::vector<VkSemaphore>& _signalSemaphores = {});
+
+		// blocks until _ticket completed or _timeout (ns) elapsed, returns VK_TIMEOUT in the latter case
+		VkResult wait(SubmissionTicket _ticket, uint64_t _timeout = UINT64_MAX);
+
+		// polls the timeline semaphore or the fences of the pending submissions without blocking
+		bool isComplete(SubmissionTicket _ticket);
+
+		// waits for all pending submissions on all queues
+		VkResult waitIdle();
+
+		// semaphores are owned by this vkHelper instance, a semaphore can be signaled again once the submission waiting on it completed
+		VkResult createSemaphore(VkSemaphore& _outSemaphore);
+
+		uint32_t getQueueFamilyIndex(QueueType _queue) const { return m_queues[static_cast<uint32_t>(_queue)].familyIndex; }
+
+		// image copies on _queue have to start and end at multiples of it or at the subresource border, (0,0,0) only allows whole mip levels
+		VkExtent3D getMinImageTransferGranularity(QueueType _queue) const { return m_queues[static_cast<uint32_t>(_queue)].minImageTransferGranularity; }
+
+		const VkPhysicalDeviceLimits& getDeviceLimits() const { return m_deviceLimits; }
 
 		VkResult loadShaderModule(VkShaderModule& _outShader, const uint32_t* _spvBlob, size_t _spvBlobByteSize);
 
@@ -50,6 +108,9 @@ namespace IBLLib
 		// this variant adds the created layout to the end of _outLayouts
 		VkResult addDecriptorSetLayout(std::vector<VkDescriptorSetLayout>& _outLayouts, const VkDescriptorSetLayoutCreateInfo* _pCreateInfo);
 
+		// one pool per scope, sized for the sets and combined image samplers of all passes of a job. sets are allocated from the pool of the current scope
+		VkResult createDescriptorPool(uint32_t _setCount, uint32_t _combinedImageSamplerCount);
+
 		// sets are owned by this vkHelper instance descriptor pool, dont free manually
 		VkResult createDescriptorSet(VkDescriptorSet& _outDescriptorSet, VkDescriptorSetLayout _layout) const;
 
@@ -75,26 +136,36 @@ namespace IBLLib
 		// returns true if memory type is supported by the device
 		bool getMemoryTypeIndex(const VkMemoryRequirements& _requirements, VkMemoryPropertyFlags _properties, uint32_t& _outIndex);
 
-		VkResult createBufferAndAllocate(VkBuffer& _outBuffer, uint32_t _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VkSharingMode _sharingMode = VK_SHARING_MODE_EXCLUSIVE, VkBufferCreateFlags _flags = 0u);
+		// memory is sub-allocated from blocks owned by this vkHelper instance, use AllocationScope::Transient for per-job staging resources
+		VkResult createBufferAndAllocate(VkBuffer& _outBuffer, VkDeviceSize _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VkSharingMode _sharingMode = VK_SHARING_MODE_EXCLUSIVE, VkBufferCreateFlags _flags = 0u, AllocationScope _scope = AllocationScope::Persistent);
 
 		void destroyBuffer(VkBuffer _buffer);
 
 		VkResult writeBufferData(VkBuffer _buffer, const void* _pData, size_t _bytes);
 		VkResult readBufferData(VkBuffer _buffer, void* _pData, size_t _bytes, size_t _offset=0u);
 
+		// host visible buffers stay mapped for their whole lifetime, returns nullptr for device local buffers
+		void* getMappedData(VkBuffer _buffer) const;
+
+		// call after writing / before reading mapped data, no-op for host coherent memory
+		VkResult flushBufferData(VkBuffer _buffer, VkDeviceSize _offset = 0u, VkDeviceSize _bytes = VK_WHOLE_SIZE) const;
+		VkResult invalidateBufferData(VkBuffer _buffer, VkDeviceSize _offset = 0u, VkDeviceSize _bytes = VK_WHOLE_SIZE) const;
+
 		VkResult createImage2DAndAllocate(VkImage& _outImage, uint32_t _width, uint32_t _height,
 			VkFormat _format, VkImageUsageFlags _usage,
 			uint32_t _mipLevels = 1u, uint32_t _arrayLayers = 1u,
 			VkImageTiling _tiling = VK_IMAGE_TILING_OPTIMAL,
 			VkMemoryPropertyFlags _memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			VkSharingMode _sharingMode = VK_SHARING_MODE_EXCLUSIVE, 
-			VkImageCreateFlags _flags = 0);
+			VkImageCreateFlags _flags = 0,
+			AllocationScope _scope = AllocationScope::Persistent);
 
 		void destroyImage(VkImage _image);
 
 		VkResult createImageView(VkImageView& _outView, VkImage _image, VkImageSubresourceRange _range = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u }, VkFormat _format = VK_FORMAT_UNDEFINED, VkImageViewType _type = VK_IMAGE_VIEW_TYPE_2D, VkComponentMapping  _swizzle = { VK_COMPONENT_SWIZZLE_IDENTITY , VK_COMPONENT_SWIZZLE_IDENTITY ,VK_COMPONENT_SWIZZLE_IDENTITY ,VK_COMPONENT_SWIZZLE_IDENTITY });
 
 		void copyBufferToBasicImage2D(VkCommandBuffer _cmdBuffer, VkBuffer _src, VkImage _dst) const;
+		void copyBufferToImage2D(VkCommandBuffer _cmdBuffer, VkBuffer _src, VkImage _dst, const VkBufferImageCopy& _region) const;
 		void copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, VkImageSubresourceLayers _imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT ,0u, 0u, 1u}) const;
 		void copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, const VkBufferImageCopy& _region) const;
 
@@ -102,7 +173,30 @@ namespace IBLLib
 			VkImageLayout _oldLayout, VkImageLayout _newLayout,
 			VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess,
 			VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess,
-			VkImageSubresourceRange _subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u}) const;
+			VkImageSubresourceRange _subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u},
+			uint32_t _srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t _dstQueueFamily = VK_QUEUE_FAMILY_IGNORED) const;
+
+		// records the queue family ownership transfer of _image from _srcQueue to _dstQueue including the layout transition:
+		// the release into _releaseCmdBuffer (submitted to _srcQueue) and the acquire into _acquireCmdBuffer (submitted to _dstQueue).
+		// if both queues share a family only the layout transition is recorded into _releaseCmdBuffer.
+		// the acquiring submission has to wait on a semaphore signaled by the releasing one at _dstStage
+		void transferImageOwnership(VkCommandBuffer _releaseCmdBuffer, VkCommandBuffer _acquireCmdBuffer, VkImage _image,
+			QueueType _srcQueue, QueueType _dstQueue,
+			VkImageLayout _oldLayout, VkImageLayout _newLayout,
+			VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess,
+			VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess,
+			VkImageSubresourceRange _subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u }) const;
+
+		void bufferBarrier(VkCommandBuffer _cmdBuffer, VkBuffer _buffer,
+			VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess,
+			VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess,
+			VkDeviceSize _offset = 0u, VkDeviceSize _size = VK_WHOLE_SIZE) const;
+
+		// make transfer writes to a readback buffer visible to the host once the submission has completed
+		void transitionBufferToHostRead(VkCommandBuffer _cmdBuffer, VkBuffer _buffer) const
+		{
+			bufferBarrier(_cmdBuffer, _buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+		}
 
 		void transitionImageToTransferWrite(VkCommandBuffer _cmdBuffer, VkImage _image, VkImageLayout _oldLayout = VK_IMAGE_LAYOUT_UNDEFINED) const
 		{
@@ -138,45 +232,133 @@ namespace IBLLib
 
 		const VkImageCreateInfo* getCreateInfo(const VkImage _image);
 
+		VkFormatFeatureFlags getFormatFeatures(VkFormat _format, VkImageTiling _tiling = VK_IMAGE_TILING_OPTIMAL) const;
+
+		// Vulkan 1.1 multiview is enabled if instance and device support it, render passes may then use RenderPassDesc::setViewMask
+		bool isMultiviewEnabled() const { return m_multiviewEnabled; }
+
+		MemoryStatistics getMemoryStatistics() const { return m_allocator.getStatistics(); }
+		void printMemoryStatistics() const { m_allocator.printStatistics(); }
+		// pipeline creation time, low with a warm pipeline cache
+		void printPipelineStatistics() const;
+
+		// _count timestamp queries for vkCmdWriteTimestamp on the graphics queue, reset them with vkCmdResetQueryPool before writing.
+		// fails if the graphics queue does not support timestamps
+		VkResult createTimestampQueryPool(VkQueryPool& _outPool, uint32_t _count);
+		// waits for both timestamps and returns the time between them
+		VkResult getTimestampMilliseconds(VkQueryPool _pool, uint32_t _begin, uint32_t _end, double& _outMilliseconds) const;
+
 	private:
 		struct Buffer
 		{
 			VkBufferCreateInfo info{};
 			VkBuffer buffer = VK_NULL_HANDLE;
-			VkDeviceMemory memory = VK_NULL_HANDLE;
-			void destroy(VkDevice _device);
+			MemoryAllocation memory;
+			uint32_t scope = 0u;
+			void destroy(VkDevice _device, vkAllocator& _allocator);
 		};
 
 		struct Image
 		{
 			VkImageCreateInfo info{};
 			VkImage image = VK_NULL_HANDLE;
-			VkDeviceMemory memory = VK_NULL_HANDLE;
+			MemoryAllocation memory;
 			std::vector<VkImageView> views;
-			void destroy(VkDevice _device);
+			uint32_t scope = 0u;
+			void destroy(VkDevice _device, vkAllocator& _allocator);
+		};
+
+		template <class T>
+		struct Scoped
+		{
+			T handle;
+			uint32_t scope;
 		};
 
+		static constexpr uint32_t AllScopes = UINT32_MAX;
+
+		// destroys the handles of _scope (all handles for AllScopes) with _destroy
+		template <class T, class Destroy>
+		static void destroyScoped(std::vector<Scoped<T>>& _handles, uint32_t _scope, Destroy _destroy);
+		void destroyResources(uint32_t _scope);
+
+		// pool of the current scope, VK_NULL_HANDLE if none was created
+		VkDescriptorPool getDescriptorPool() const;
+
 		VkInstance m_instance = VK_NULL_HANDLE;
 		VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
 		VkPhysicalDeviceFeatures m_deviceFeatures{};
 		VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+		VkPhysicalDeviceLimits m_deviceLimits{};
+		VkPhysicalDeviceProperties m_deviceProperties{};
+		uint32_t m_instanceApiVersion = VK_API_VERSION_1_0;
+		bool m_multiviewEnabled = false;
+		// Vulkan 1.2 or VK_KHR_timeline_semaphore, submissions are tracked with recycled fences otherwise
+		bool m_timelineSemaphoresEnabled = false;
+		PFN_vkWaitSemaphores m_waitSemaphores = nullptr;
+		PFN_vkGetSemaphoreCounterValue m_getSemaphoreCounterValue = nullptr;
+
+		struct Submission
+		{
+			uint64_t ticket = 0u;
+			VkFence fence = VK_NULL_HANDLE; // VK_NULL_HANDLE with timeline semaphores
+			std::vector<VkCommandBuffer> cmdBuffers;
+			std::vector<VkCommandBuffer> recycleOnCompletion; // destroyed by the user while in flight
+		};
+
+		struct Queue
+		{
+			VkQueue queue = VK_NULL_HANDLE;
+			uint32_t familyIndex = 0u;
+			uint32_t timestampValidBits = 0u;
+			VkExtent3D minImageTransferGranularity = { 1u, 1u, 1u };
+			VkCommandPool commandPool = VK_NULL_HANDLE;
+			VkSemaphore timeline = VK_NULL_HANDLE; // signaled with the ticket of each submission if timeline semaphores are enabled
+
+			// ordered by ticket
+			std::deque<Submission> pendingSubmissions;
+			std::vector<VkCommandBuffer> freeCommandBuffers;
+			uint64_t lastSubmittedTicket = 0u;
+			uint64_t completedTicket = 0u;
+		};
+
+		Queue& getQueue(QueueType _queue) { return m_queues[static_cast<uint32_t>(_queue)]; }
+
+		// merges the cache file written by other processes since initialize and replaces it atomically
+		void storePipelineCache();
+
+		VkResult acquireFence(VkFence& _outFence);
+		// retires all pending submissions of _queue up to and including _ticket, their fences must be signaled
+		void retireSubmissions(Queue& _queue, uint64_t _ticket);
 
 		VkDevice m_logicalDevice = VK_NULL_HANDLE;
-		VkQueue m_queue = VK_NULL_HANDLE;
-		uint32_t m_queueFamilyIndex = 0u;
-		VkCommandPool m_commandPool = VK_NULL_HANDLE;
-		VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+		Queue m_queues[static_cast<uint32_t>(QueueType::Count)];
+		// queue a command buffer was created for
+		std::unordered_map<VkCommandBuffer, QueueType> m_commandBufferQueues;
+		std::vector<VkFence> m_freeFences;
+		std::vector<Scoped<VkSemaphore>> m_semaphores;
+		std::vector<Scoped<VkDescriptorPool>> m_descriptorPools;
 		VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
-
-		std::vector<VkShaderModule> m_shaderModules;
-		std::vector<VkDescriptorSetLayout> m_descriptorSetLayouts;
-		std::vector<VkPipelineLayout> m_pipelineLayouts;
-		std::vector<VkPipeline> m_pipelines;
-		std::vector<VkRenderPass> m_renderPasses;
-		std::vector<VkFramebuffer> m_frameBuffers;
-		std::vector<Buffer> m_buffers;
-		std::vector<Image> m_images;
-		std::vector<VkSampler> m_samplers;
+		std::string m_pipelineCachePath;
+		size_t m_pipelineCacheLoadedSize = 0u; // 0 if no valid cache was found
+		uint32_t m_pipelineCount = 0u;
+		double m_pipelineMilliseconds = 0.0;
+		vkAllocator m_allocator;
+
+		uint32_t m_currentScope = 0u;
+		uint32_t m_lastScope = 0u;
+
+		std::vector<Scoped<VkShaderModule>> m_shaderModules;
+		std::vector<Scoped<VkDescriptorSetLayout>> m_descriptorSetLayouts;
+		std::vector<Scoped<VkPipelineLayout>> m_pipelineLayouts;
+		std::vector<Scoped<VkPipeline>> m_pipelines;
+		std::vector<Scoped<VkRenderPass>> m_renderPasses;
+		std::vector<Scoped<VkFramebuffer>> m_frameBuffers;
+		std::vector<Scoped<VkQueryPool>> m_queryPools;
+		// keyed by handle, references stay valid until the resource is destroyed
+		std::unordered_map<VkBuffer, Buffer> m_buffers;
+		std::unordered_map<VkImage, Image> m_images;
+		std::vector<Scoped<VkSampler>> m_samplers;
 
 		bool m_debugOutputEnabled;
 	};
@@ -317,10 +499,15 @@ namespace IBLLib
 
 		// TODO: suppasses & dependencies
 
+		// renders the subpass once per set bit, gl_ViewIndex selects the layer of every attachment. requires vkHelper::isMultiviewEnabled
+		void setViewMask(uint32_t _viewMask);
+
 		const VkRenderPassCreateInfo* getInfo();
 	private:
 		VkRenderPassCreateInfo m_info{};
 		VkSubpassDescription m_subpass{};
+		VkRenderPassMultiviewCreateInfo m_multiview{};
+		uint32_t m_viewMask = 0u;
 		//VkSubpassDependency m_subpassDependency{};
 		std::vector<VkAttachmentReference> m_attachmentRefs;
 		std::vector<VkAttachmentDescription> m_attachments;